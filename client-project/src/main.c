@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
+#include <signal.h>
 
 #if defined _WIN32
 #include <winsock2.h>
@@ -15,7 +17,9 @@
 #else
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netdb.h>
@@ -23,12 +27,31 @@
 #endif
 
 #include "protocol.h"
+#include "shm_ring.h"
+#include "siphash.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#endif
 
 // Correzione problema lettura caratteri speciali in console Windows
 #if defined _WIN32
 #define DEG_C_SUFFIX "C"
+#define DEG_F_SUFFIX "F"
 #else
 #define DEG_C_SUFFIX "°C"
+#define DEG_F_SUFFIX "°F"
 #endif
 
 /*
@@ -103,94 +126,1272 @@ static const char *my_inet_ntop(int af, const void *src, char *dst, size_t size)
 }
 
 /*
- * print_usage
- * Stampa il formato corretto dell'utilizzo del programma.
+ * print_usage
+ * Stampa il formato corretto dell'utilizzo del programma.
+ *
+ * static void print_usage(const char *progname)
+{
+    printf("Usage: %s [-s server] [-p port] -r \"type city\"\n", progname);
+}
+*/
+
+/*
+ * send_all
+ * Invia tutti i byte dal buffer attraverso il socket.
+ * Per UDP con connect(), invia il datagram completo in una singola chiamata.
+ *
+ * Parametri:
+ *  - sock: file descriptor del socket
+ *  - buf: buffer contenente i dati da inviare
+ *  - len: numero di byte da inviare
+ *
+ * Restituisce 0 in caso di successo, -1 in caso di errore.
+ */
+int send_all(int sock, const void *buf, size_t len)
+{
+    int sent = send(sock, buf, (int)len, 0);
+    if (sent < 0)
+        return -1;
+    if ((size_t)sent != len)
+        return -1;
+    return 0;
+}
+
+/*
+ * recv_all
+ * Riceve esattamente il numero specificato di byte dal socket.
+ * Per UDP con connect(), riceve un datagram completo.
+ *
+ * Parametri:
+ *  - sock: file descriptor del socket
+ *  - buf: buffer dove memorizzare i dati ricevuti
+ *  - len: numero di byte da ricevere
+ *
+ * Restituisce 0 in caso di successo, -1 in caso di errore o chiusura connessione.
+ */
+int recv_all(int sock, void *buf, size_t len)
+{
+    int r = recv(sock, buf, (int)len, 0);
+    if (r <= 0)
+        return -1;
+    if ((size_t)r != len)
+        return -1;
+    return 0;
+}
+
+/*
+ * Modalità autenticata (-k id:chiave): ogni richiesta parte seguita dal
+ * trailer con key id, istante, contatore e MAC SipHash-2-4 (vedi
+ * protocol.h). Il contatore parte dall'istante corrente in nanosecondi,
+ * così resta crescente anche tra esecuzioni successive con la stessa
+ * chiave (purché non più di un client alla volta la usi).
+ */
+static int auth_enabled = 0;
+static uint32_t auth_id = 0;
+static unsigned char auth_key[SIPHASH_KEY_SIZE];
+static uint64_t auth_counter = 0;
+
+static void put64be(unsigned char *dst, uint64_t v)
+{
+    uint32_t hi = htonl((uint32_t)(v >> 32));
+    uint32_t lo = htonl((uint32_t)v);
+    memcpy(dst, &hi, 4);
+    memcpy(dst + 4, &lo, 4);
+}
+
+/*
+ * auth_parse
+ * Legge la chiave nel formato "id:chiave", con la chiave di 128 bit in
+ * esadecimale (32 cifre), e abilita la modalità autenticata.
+ *
+ * Restituisce 1 se la chiave è valida, 0 altrimenti.
+ */
+static int auth_parse(const char *s)
+{
+    char *end;
+    unsigned long id = strtoul(s, &end, 10);
+    if (end == s || *end != ':' || id > 0xFFFFFFFFul || strlen(end + 1) != 2 * SIPHASH_KEY_SIZE)
+        return 0;
+    const char *hex = end + 1;
+    for (int i = 0; i < SIPHASH_KEY_SIZE; ++i)
+    {
+        unsigned int byte;
+        if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+            sscanf(&hex[2 * i], "%2x", &byte) != 1)
+            return 0;
+        auth_key[i] = (unsigned char)byte;
+    }
+    auth_id = (uint32_t)id;
+#if defined _WIN32
+    auth_counter = (uint64_t)time(NULL) * 1000000000ull;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    auth_counter = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+    auth_enabled = 1;
+    return 1;
+}
+
+/*
+ * auth_sign
+ * Copia la richiesta di len byte in out e vi aggiunge il trailer firmato
+ * (out deve avere spazio per len + AUTH_TRAILER_SIZE byte).
+ *
+ * Restituisce la lunghezza del datagram firmato.
+ */
+static size_t auth_sign(unsigned char *out, const void *req, size_t len)
+{
+    memmove(out, req, len);
+    unsigned char *t = out + len;
+    uint32_t id = htonl(auth_id);
+    uint32_t ts = htonl((uint32_t)time(NULL));
+    memcpy(t, &id, 4);
+    memcpy(t + 4, &ts, 4);
+    put64be(t + 8, ++auth_counter);
+    put64be(t + AUTH_MAC_OFFSET, siphash24(auth_key, out, len + AUTH_MAC_OFFSET));
+    return len + AUTH_TRAILER_SIZE;
+}
+
+/*
+ * send_request
+ * Invia una richiesta sul socket connesso, firmata se la modalità
+ * autenticata è attiva.
+ *
+ * Restituisce 0 in caso di successo, -1 in caso di errore.
+ */
+static int send_request(int sock, const void *buf, size_t len)
+{
+    unsigned char signed_buf[BUFFER_SIZE + AUTH_TRAILER_SIZE];
+    if (!auth_enabled)
+        return send_all(sock, buf, len);
+    if (len > BUFFER_SIZE)
+        return -1;
+    return send_all(sock, signed_buf, auth_sign(signed_buf, buf, len));
+}
+
+/*
+ * ntohf
+ * Converte un uint32_t ricevuto in network byte order nella corrispondente
+ * variabile `float` in host byte order. Il float viene trasmesso in rete
+ * come bit pattern (uint32_t) e qui si usano ntohl + memcpy per rispettare
+ * l'endianness e le aliasing rules.
+ */
+float ntohf(uint32_t i)
+{
+    i = ntohl(i);
+    float f;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+/*
+ * validaporta
+ * Verifica che la stringa fornita rappresenti un numero intero
+ * compreso nell'intervallo delle porte valide (1-65535).
+ * Se valida, scrive il valore in `out_port` e restituisce 1.
+ * Altrimenti restituisce 0.
+ */
+int validaporta(const char *s, int *out_port)
+{
+    char *end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (errno != 0)
+        return 0;
+    if (*end != '\0')
+        return 0;
+    if (v < 1 || v > 65535)
+        return 0;
+    *out_port = (int)v;
+    return 1;
+}
+
+/*
+ * type_label / type_unit
+ * Nome italiano e unità di misura associati al tipo di richiesta.
+ */
+static const char *type_label(char type)
+{
+    switch (type)
+    {
+    case 't':
+        return "Temperatura";
+    case 'h':
+        return "Umidita'";
+    case 'w':
+        return "Vento";
+    case 'p':
+        return "Pressione";
+    default:
+        return "?";
+    }
+}
+
+static const char *type_unit(char type)
+{
+    switch (type)
+    {
+    case 't':
+        return DEG_C_SUFFIX;
+    case 'h':
+        return "%";
+    case 'w':
+        return " km/h";
+    case 'p':
+        return " hPa";
+    default:
+        return "";
+    }
+}
+
+/*
+ * Unità delle richieste compatte (-u): nome sulla riga di comando, misura
+ * a cui appartiene, codice UNIT_* e suffisso di stampa.
+ */
+static const struct
+{
+    const char *name;
+    char type;
+    unsigned char code;
+    const char *suffix;
+} unit_names[] = {
+    { "C", 't', UNIT_CELSIUS, DEG_C_SUFFIX },
+    { "F", 't', UNIT_FAHRENHEIT, DEG_F_SUFFIX },
+    { "%", 'h', UNIT_PERCENT, "%" },
+    { "km/h", 'w', UNIT_KMH, " km/h" },
+    { "m/s", 'w', UNIT_MS, " m/s" },
+    { "hPa", 'p', UNIT_HPA, " hPa" },
+    { "inHg", 'p', UNIT_INHG, " inHg" },
+};
+
+#define COMPACT_TYPES "thwp" // ordine dei formati per misura
+
+static const char *unit_suffix(unsigned char code)
+{
+    for (size_t i = 0; i < sizeof(unit_names) / sizeof(unit_names[0]); ++i)
+    {
+        if (unit_names[i].code == code)
+            return unit_names[i].suffix;
+    }
+    return "";
+}
+
+/*
+ * parse_units
+ * Interpreta la lista di -u, "unità[:decimali]" separate da virgole (es.
+ * "F,inHg:2,m/s"): ogni unità imposta il formato della propria misura in
+ * fmts (ordine COMPACT_TYPES); le misure non citate restano invariate.
+ *
+ * Restituisce 1 se la lista è valida, 0 altrimenti.
+ */
+static int parse_units(const char *list, unsigned char fmts[4])
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", list);
+    for (char *item = strtok(buf, ","); item != NULL; item = strtok(NULL, ","))
+    {
+        unsigned dec = 1;
+        char *colon = strchr(item, ':');
+        if (colon)
+        {
+            char *end;
+            long d = strtol(colon + 1, &end, 10);
+            if (*end != '\0' || colon[1] == '\0' || d < 0 || d > 15)
+                return 0;
+            dec = (unsigned)d;
+            *colon = '\0';
+        }
+        size_t u = 0;
+        while (u < sizeof(unit_names) / sizeof(unit_names[0]))
+        {
+            const char *a = item, *b = unit_names[u].name;
+            while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b))
+            {
+                a++;
+                b++;
+            }
+            if (*a == '\0' && *b == '\0')
+                break;
+            u++;
+        }
+        if (u == sizeof(unit_names) / sizeof(unit_names[0]))
+            return 0;
+        fmts[strchr(COMPACT_TYPES, unit_names[u].type) - COMPACT_TYPES] = COMPACT_FMT(unit_names[u].code, dec);
+    }
+    return 1;
+}
+
+/*
+ * format_fixed
+ * Scrive in out il valore in virgola fissa v × 10^-dec senza passare per
+ * la virgola mobile (es. v = -105, dec = 2 -> "-1.05").
+ */
+static void format_fixed(char *out, size_t cap, int v, unsigned dec)
+{
+    unsigned mag = (unsigned)(v < 0 ? -v : v);
+    unsigned p = 1;
+    for (unsigned i = 0; i < dec; ++i)
+        p *= 10;
+    if (dec == 0)
+        snprintf(out, cap, "%s%u", v < 0 ? "-" : "", mag);
+    else
+        snprintf(out, cap, "%s%u.%0*u", v < 0 ? "-" : "", mag / p, (int)dec, mag % p);
+}
+
+/*
+ * print_history
+ * Decodifica e stampa la risposta a una richiesta REQ_HISTORY: la lista
+ * dei campioni (HIST_MODE_RANGE) oppure min/max/media (HIST_MODE_AGGR).
+ *
+ * Parametri:
+ *  - resp, len: datagram di risposta ricevuto
+ *  - city: nome città da mostrare
+ *  - name, ip: server che ha risposto
+ *
+ * Restituisce 0 se la risposta è ben formata, 1 altrimenti.
+ */
+static int print_history(const unsigned char *resp, int len, const char *city,
+                         const char *name, const char *ip)
+{
+    if (len < 8)
+    {
+        fprintf(stderr, "Risposta storico troncata\n");
+        return 1;
+    }
+    uint32_t net_status;
+    memcpy(&net_status, resp, 4);
+    uint32_t status = ntohl(net_status);
+    char rtype = (char)resp[4];
+    unsigned char mode = resp[5];
+    uint16_t net_count;
+    memcpy(&net_count, &resp[6], 2);
+    int count = ntohs(net_count);
+
+    if (status == STATUS_CITY_NOT_AVAILABLE)
+    {
+        printf("Ricevuto risultato dal server %s (ip %s). Citta' non disponibile\n", name, ip);
+        return 0;
+    }
+    if (status != STATUS_SUCCESS)
+    {
+        printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", name, ip);
+        return 0;
+    }
+
+    if (mode == HIST_MODE_AGGR)
+    {
+        uint32_t bits[3];
+        if (len < 20)
+        {
+            fprintf(stderr, "Risposta storico troncata\n");
+            return 1;
+        }
+        memcpy(bits, &resp[8], sizeof(bits));
+        if (count == 0)
+        {
+            printf("Ricevuto risultato dal server %s (ip %s). %s: %s, nessun campione\n",
+                   name, ip, city, type_label(rtype));
+            return 0;
+        }
+        printf("Ricevuto risultato dal server %s (ip %s). %s: %s min %.1f%s, max %.1f%s, media %.1f%s (%d campioni)\n",
+               name, ip, city, type_label(rtype),
+               ntohf(bits[0]), type_unit(rtype),
+               ntohf(bits[1]), type_unit(rtype),
+               ntohf(bits[2]), type_unit(rtype), count);
+        return 0;
+    }
+
+    if (len < 8 + count * 8)
+    {
+        fprintf(stderr, "Risposta storico troncata\n");
+        return 1;
+    }
+    printf("Ricevuto risultato dal server %s (ip %s). %s: storico %s (%d campioni)\n",
+           name, ip, city, type_label(rtype), count);
+    for (int i = 0; i < count; ++i)
+    {
+        uint32_t net_ts, net_f;
+        memcpy(&net_ts, &resp[8 + i * 8], 4);
+        memcpy(&net_f, &resp[12 + i * 8], 4);
+        time_t ts = (time_t)ntohl(net_ts);
+        char when[16] = "--:--:--";
+        struct tm *tmv = localtime(&ts);
+        if (tmv)
+            strftime(when, sizeof(when), "%H:%M:%S", tmv);
+        printf("  %s  %.1f%s\n", when, ntohf(net_f), type_unit(rtype));
+    }
+    return 0;
+}
+
+/* Impostato dal gestore di SIGINT per chiudere la modalità --watch. */
+static volatile sig_atomic_t watch_stop = 0;
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    watch_stop = 1;
+}
+
+/*
+ * send_subscribe
+ * Invia una richiesta REQ_SUBSCRIBE (o REQ_UNSUBSCRIBE se unsubscribe è
+ * diverso da zero) con il cookie dell'ultima conferma sul socket UDP già
+ * connesso al server.
+ *
+ * Restituisce 0 in caso di successo, -1 in caso di errore.
+ */
+static int send_subscribe(int sock, const char *city, unsigned char typemask,
+                          const unsigned char *cookie, int unsubscribe)
+{
+    unsigned char req[SUBSCRIBE_REQUEST_SIZE];
+    memset(req, 0, sizeof(req));
+    memcpy(&req[68], cookie, SUB_COOKIE_SIZE);
+    if (unsubscribe)
+    {
+        req[0] = REQ_UNSUBSCRIBE;
+        return send_request(sock, req, sizeof(req));
+    }
+    req[0] = REQ_SUBSCRIBE;
+    memcpy(&req[1], city, strlen(city));
+    req[65] = typemask;
+    uint16_t lease = htons(SUB_LEASE_DEFAULT);
+    memcpy(&req[66], &lease, 2);
+    return send_request(sock, req, sizeof(req));
+}
+
+/*
+ * run_watch
+ * Modalità --watch: si iscrive agli aggiornamenti push del server e stampa
+ * ogni datagram PUSH_UPDATE ricevuto. Il primo invio riceve il cookie di
+ * verifica, che si rimanda subito; l'iscrizione viene rinnovata a metà
+ * del lease concesso con l'ultimo cookie ricevuto. Con Ctrl-C si cancella
+ * l'iscrizione e si esce.
+ *
+ * Parametri:
+ *  - sock: socket UDP connesso al server
+ *  - type: tipo di misura, '*' per tutte
+ *  - city: città da seguire, stringa vuota per tutte
+ *  - name, ip: server da mostrare nei messaggi
+ *
+ * Restituisce 0 all'uscita regolare, 1 in caso di errore.
+ */
+static int run_watch(int sock, char type, const char *city, const char *name, const char *ip)
+{
+    static const char *city_names[CITY_COUNT] = CITY_NAMES;
+    unsigned char typemask;
+    switch (tolower((unsigned char)type))
+    {
+    case '*':
+        typemask = 0;
+        break;
+    case 't':
+        typemask = SUB_TYPE_T;
+        break;
+    case 'h':
+        typemask = SUB_TYPE_H;
+        break;
+    case 'w':
+        typemask = SUB_TYPE_W;
+        break;
+    case 'p':
+        typemask = SUB_TYPE_P;
+        break;
+    default:
+        printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", name, ip);
+        return 1;
+    }
+
+    signal(SIGINT, on_sigint);
+    unsigned char cookie[SUB_COOKIE_SIZE] = {0};
+    if (send_subscribe(sock, city, typemask, cookie, 0) != 0)
+    {
+        fprintf(stderr, "Failed to send request\n");
+        return 1;
+    }
+    time_t renew_at = time(NULL) + SUB_LEASE_DEFAULT / 2;
+    uint32_t expected_seq = 0;
+    int have_seq = 0;
+
+    while (!watch_stop)
+    {
+        if (time(NULL) >= renew_at)
+        {
+            send_subscribe(sock, city, typemask, cookie, 0);
+            renew_at = time(NULL) + SUB_LEASE_DEFAULT / 2;
+        }
+
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(sock, &rfds);
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        int ready = select(sock + 1, &rfds, NULL, NULL, &tv);
+        if (ready <= 0)
+            continue; // timeout o EINTR (Ctrl-C)
+
+        unsigned char buf[BUFFER_SIZE];
+        int len = recv(sock, (char *)buf, (int)sizeof(buf), 0);
+        if (len <= 0)
+            continue;
+
+        if (buf[0] == PUSH_UPDATE && len >= PUSH_HEADER_SIZE)
+        {
+            int count = buf[1];
+            uint32_t net_seq;
+            memcpy(&net_seq, &buf[2], 4);
+            uint32_t seq = ntohl(net_seq);
+            if (have_seq && seq != expected_seq)
+                printf("(persi %u aggiornamenti)\n", (unsigned)(seq - expected_seq));
+            expected_seq = seq + 1;
+            have_seq = 1;
+            if (len < PUSH_HEADER_SIZE + count * PUSH_ENTRY_SIZE)
+                continue;
+            printf("Aggiornamento #%u dal server %s (ip %s):\n", (unsigned)seq, name, ip);
+            for (int i = 0; i < count; ++i)
+            {
+                const unsigned char *e = &buf[PUSH_HEADER_SIZE + i * PUSH_ENTRY_SIZE];
+                uint32_t net_f;
+                memcpy(&net_f, &e[2], 4);
+                char rtype = (char)e[1];
+                printf("  %s: %s = %.1f%s\n", e[0] < CITY_COUNT ? city_names[e[0]] : "?",
+                       type_label(rtype), ntohf(net_f), type_unit(rtype));
+            }
+            fflush(stdout);
+        }
+        else if (len == SUB_ACK_SIZE && buf[4] == REQ_SUBSCRIBE)
+        {
+            uint32_t net_status;
+            memcpy(&net_status, buf, 4);
+            uint32_t status = ntohl(net_status);
+            if (status == STATUS_COOKIE_REQUIRED)
+            {
+                // Cookie nuovo o scaduto: si rimanda subito l'iscrizione (un
+                // cookie già rifiutato si riprova solo al rinnovo)
+                int fresh = memcmp(cookie, &buf[8], SUB_COOKIE_SIZE) != 0;
+                memcpy(cookie, &buf[8], SUB_COOKIE_SIZE);
+                if (fresh)
+                    send_subscribe(sock, city, typemask, cookie, 0);
+                continue;
+            }
+            if (status == STATUS_SUCCESS)
+                memcpy(cookie, &buf[8], SUB_COOKIE_SIZE);
+            if (status == STATUS_CITY_NOT_AVAILABLE)
+            {
+                printf("Ricevuto risultato dal server %s (ip %s). Citta' non disponibile\n", name, ip);
+                return 1;
+            }
+            if (status != STATUS_SUCCESS)
+            {
+                printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", name, ip);
+                return 1;
+            }
+            uint16_t net_lease;
+            memcpy(&net_lease, &buf[6], 2);
+            int lease = ntohs(net_lease);
+            if (lease > 1)
+                renew_at = time(NULL) + lease / 2;
+        }
+    }
+
+    send_subscribe(sock, city, typemask, cookie, 1);
+    return 0;
+}
+
+static uint16_t get16(const unsigned char *src)
+{
+    uint16_t v;
+    memcpy(&v, src, 2);
+    return ntohs(v);
+}
+
+/*
+ * print_snapshot
+ * Stampa la tabella città x misure ricostruita dagli snapshot multicast.
+ */
+static void print_snapshot(uint32_t seq, int frags, int total,
+                           float table[CITY_COUNT][4], unsigned char present[CITY_COUNT][4])
+{
+    static const char *city_names[CITY_COUNT] = CITY_NAMES;
+    static const char types[4] = {'t', 'h', 'w', 'p'};
+    printf("Snapshot #%u (%d frammenti, %d valori):\n", (unsigned)seq, frags, total);
+    for (int c = 0; c < CITY_COUNT; ++c)
+    {
+        printf("  %-8s", city_names[c]);
+        for (int t = 0; t < 4; ++t)
+        {
+            if (present[c][t])
+                printf("  %s %.1f%s", type_label(types[t]), table[c][t], type_unit(types[t]));
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/*
+ * run_listen
+ * Modalità --listen: si unisce al gruppo multicast, ricostruisce la
+ * tabella completa dai frammenti di ogni snapshot e segnala snapshot o
+ * frammenti mancanti (buchi nella sequenza).
+ *
+ * Parametri:
+ *  - group, port: gruppo multicast e porta
+ *  - ifaddr: indirizzo dell'interfaccia su cui ricevere (NULL = qualsiasi)
+ *
+ * Restituisce 0 all'uscita (Ctrl-C), 1 in caso di errore.
+ */
+static int run_listen(const char *group, int port, const char *ifaddr)
+{
+    int sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons((uint16_t)port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        perror("bind");
+        closesocket(sock);
+        return 1;
+    }
+
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (my_inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1 ||
+        (ifaddr && my_inet_pton(AF_INET, ifaddr, &mreq.imr_interface) != 1))
+    {
+        fprintf(stderr, "Indirizzo multicast non valido\n");
+        closesocket(sock);
+        return 1;
+    }
+    if (!ifaddr)
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char *)&mreq, sizeof(mreq)) < 0)
+    {
+        perror("IP_ADD_MEMBERSHIP");
+        closesocket(sock);
+        return 1;
+    }
+    printf("In ascolto degli snapshot su %s:%d\n", group, port);
+
+    float table[CITY_COUNT][4];
+    unsigned char present[CITY_COUNT][4];
+    memset(table, 0, sizeof(table));
+    memset(present, 0, sizeof(present));
+    uint32_t cur_seq = 0;
+    int have_cur = 0, complete = 0;
+    int frag_count = 0, frags_seen = 0;
+    uint64_t received = 0; // bit f = frammento f dello snapshot corrente
+
+    signal(SIGINT, on_sigint);
+    while (!watch_stop)
+    {
+        unsigned char buf[BUFFER_SIZE * 4];
+        int len = recv(sock, (char *)buf, (int)sizeof(buf), 0);
+        if (len < SNAPSHOT_HEADER_SIZE || buf[0] != SNAPSHOT_FRAGMENT)
+            continue; // EINTR o datagram estraneo
+
+        uint32_t net_seq;
+        memcpy(&net_seq, &buf[2], 4);
+        uint32_t seq = ntohl(net_seq);
+        int frag = get16(&buf[6]);
+        int frags = get16(&buf[8]);
+        int first = get16(&buf[10]);
+        int n = get16(&buf[12]);
+        int total = get16(&buf[14]);
+        if (frags < 1 || frags > SNAPSHOT_MAX_FRAGS || frag >= frags || first + n > total ||
+            len < SNAPSHOT_HEADER_SIZE + n * PUSH_ENTRY_SIZE)
+            continue;
+
+        if (!have_cur || (int32_t)(seq - cur_seq) > 0)
+        {
+            // Inizia un nuovo snapshot: segnala ciò che manca del precedente
+            if (have_cur && !complete)
+                printf("Snapshot #%u incompleto: ricevuti %d/%d frammenti\n",
+                       (unsigned)cur_seq, frags_seen, frag_count);
+            if (have_cur && seq - cur_seq > 1)
+                printf("Persi %u snapshot (#%u..#%u)\n", (unsigned)(seq - cur_seq - 1),
+                       (unsigned)(cur_seq + 1), (unsigned)(seq - 1));
+            cur_seq = seq;
+            have_cur = 1;
+            complete = 0;
+            frag_count = frags;
+            frags_seen = 0;
+            received = 0;
+        }
+        else if (seq != cur_seq || complete)
+        {
+            continue; // frammento in ritardo di uno snapshot già chiuso
+        }
+
+        if (received & ((uint64_t)1 << frag))
+            continue; // duplicato
+        received |= (uint64_t)1 << frag;
+        frags_seen++;
+        for (int i = 0; i < n; ++i)
+        {
+            const unsigned char *e = &buf[SNAPSHOT_HEADER_SIZE + i * PUSH_ENTRY_SIZE];
+            int t;
+            switch (e[1])
+            {
+            case 't':
+                t = 0;
+                break;
+            case 'h':
+                t = 1;
+                break;
+            case 'w':
+                t = 2;
+                break;
+            case 'p':
+                t = 3;
+                break;
+            default:
+                t = -1;
+                break;
+            }
+            if (e[0] >= CITY_COUNT || t < 0)
+                continue;
+            uint32_t net_f;
+            memcpy(&net_f, &e[2], 4);
+            table[e[0]][t] = ntohf(net_f);
+            present[e[0]][t] = 1;
+        }
+
+        if (frags_seen == frag_count)
+        {
+            complete = 1;
+            print_snapshot(cur_seq, frag_count, total, table, present);
+        }
+    }
+
+    setsockopt(sock, IPPROTO_IP, IP_DROP_MEMBERSHIP, (const char *)&mreq, sizeof(mreq));
+    closesocket(sock);
+    return 0;
+}
+
+/*
+ * Trasporti disponibili, selezionati dall'URI passato con -s:
+ *  - udp://host[:porta]  (default, equivalente a -s host -p porta)
+ *  - unix:///percorso    socket Unix datagram del server (-u)
+ *  - shm://nome          memoria condivisa del server (-S, solo Linux)
+ */
+#define TRANSPORT_UDP  0
+#define TRANSPORT_UNIX 1
+#define TRANSPORT_SHM  2
+
+typedef struct
+{
+    int kind;
+    int sock;                 // UDP e Unix: socket connesso al server
+#if !defined _WIN32
+    char local_path[108];     // Unix: percorso locale del client
+#endif
+#if defined(__linux__)
+    shm_region_t *region;     // SHM: regione mappata
+    shm_slot_t *slot;         // SHM: slot riservato a questo client
+#endif
+} transport_t;
+
+#if defined(__linux__)
+/*
+ * shm_attach
+ * Mappa la regione condivisa /name del server e riserva uno slot libero
+ * (o quello di un client terminato senza rilasciarlo).
+ *
+ * Restituisce 0 in caso di successo, -1 in caso di errore.
+ */
+static int shm_attach(transport_t *t, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0)
+        return -1;
+    void *p = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+    t->region = (shm_region_t *)p;
+    if (t->region->magic != SHM_MAGIC || t->region->version != SHM_VERSION)
+    {
+        munmap(p, sizeof(shm_region_t));
+        return -1;
+    }
+    for (int i = 0; i < SHM_SLOTS; ++i)
+    {
+        shm_slot_t *s = &t->region->slot[i];
+        uint32_t expected = SHM_SLOT_FREE;
+        int claimed = atomic_compare_exchange_strong(&s->state, &expected, SHM_SLOT_INIT);
+        if (!claimed && expected == SHM_SLOT_BUSY)
+        {
+            // Slot di un processo non più esistente: lo si recupera
+            int32_t owner = atomic_load(&s->owner);
+            if (kill(owner, 0) < 0 && errno == ESRCH)
+                claimed = atomic_compare_exchange_strong(&s->state, &expected, SHM_SLOT_INIT);
+        }
+        if (claimed)
+        {
+            shm_ring_reset(&s->req);
+            shm_ring_reset(&s->resp);
+            atomic_store(&s->owner, (int32_t)getpid());
+            atomic_store_explicit(&s->state, SHM_SLOT_BUSY, memory_order_release);
+            t->slot = s;
+            return 0;
+        }
+    }
+    munmap(p, sizeof(shm_region_t));
+    return -1;
+}
+#endif
+
+/*
+ * transport_open
+ * Apre il trasporto verso il server: socket UDP o Unix connesso, oppure
+ * slot della memoria condivisa.
+ *
+ * Parametri:
+ *  - t: struttura da inizializzare
+ *  - kind: TRANSPORT_*
+ *  - addr: indirizzo del server (solo UDP)
+ *  - target: percorso del socket Unix o nome della memoria condivisa
+ *
+ * Restituisce 0 in caso di successo, -1 in caso di errore.
+ */
+static int transport_open(transport_t *t, int kind, const struct sockaddr_in *addr, const char *target)
+{
+    memset(t, 0, sizeof(*t));
+    t->kind = kind;
+    t->sock = -1;
+    if (kind == TRANSPORT_UDP)
+    {
+        t->sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (t->sock < 0)
+        {
+            perror("socket");
+            return -1;
+        }
+        if (connect(t->sock, (const struct sockaddr *)addr, sizeof(*addr)) < 0)
+        {
+            perror("connect");
+            closesocket(t->sock);
+            return -1;
+        }
+        return 0;
+    }
+#if !defined _WIN32
+    if (kind == TRANSPORT_UNIX)
+    {
+        // Il client deve avere un proprio indirizzo per ricevere la risposta
+        struct sockaddr_un local, remote;
+        memset(&local, 0, sizeof(local));
+        memset(&remote, 0, sizeof(remote));
+        local.sun_family = remote.sun_family = AF_UNIX;
+        snprintf(t->local_path, sizeof(t->local_path), "/tmp/weather-client-%d.sock", (int)getpid());
+        memcpy(local.sun_path, t->local_path, strlen(t->local_path));
+        strncpy(remote.sun_path, target, sizeof(remote.sun_path) - 1);
+        t->sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        unlink(t->local_path);
+        if (t->sock < 0 || bind(t->sock, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+            connect(t->sock, (struct sockaddr *)&remote, sizeof(remote)) < 0)
+        {
+            perror("unix socket");
+            if (t->sock >= 0)
+                closesocket(t->sock);
+            unlink(t->local_path);
+            return -1;
+        }
+        return 0;
+    }
+#endif
+#if defined(__linux__)
+    if (kind == TRANSPORT_SHM)
+    {
+        if (shm_attach(t, target) < 0)
+        {
+            fprintf(stderr, "Memoria condivisa /%s non disponibile\n", target);
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    (void)target;
+    fprintf(stderr, "Trasporto non supportato su questa piattaforma\n");
+    return -1;
+}
+
+/*
+ * transport_send / transport_recv
+ * Invio di un datagram di richiesta e ricezione di un datagram di
+ * risposta sul trasporto scelto. transport_recv restituisce la lunghezza
+ * ricevuta, -1 in caso di errore o timeout.
+ */
+static int transport_send(transport_t *t, const void *buf, size_t len)
+{
+#if defined(__linux__)
+    if (t->kind == TRANSPORT_SHM)
+    {
+        unsigned char signed_buf[BUFFER_SIZE + AUTH_TRAILER_SIZE];
+        if (auth_enabled && len <= BUFFER_SIZE)
+        {
+            len = auth_sign(signed_buf, buf, len);
+            buf = signed_buf;
+        }
+        if (shm_ring_push(&t->slot->req, buf, (uint32_t)len) < 0)
+            return -1;
+        // Sveglia il thread del server se sta dormendo sul doorbell
+        atomic_fetch_add(&t->region->doorbell, 1);
+        if (atomic_load(&t->region->server_sleeping))
+            shm_futex(&t->region->doorbell, FUTEX_WAKE, 1, NULL);
+        return 0;
+    }
+#endif
+    return send_request(t->sock, buf, len);
+}
+
+static int transport_recv(transport_t *t, void *buf, size_t cap)
+{
+#if defined(__linux__)
+    if (t->kind == TRANSPORT_SHM)
+    {
+        int len;
+        while ((len = shm_ring_pop(&t->slot->resp, buf, (uint32_t)cap)) < 0)
+        {
+            if (shm_ring_wait(&t->slot->resp, 5000) < 0)
+                return -1;
+        }
+        return len;
+    }
+#endif
+    int r = recv(t->sock, buf, (int)cap, 0);
+    return r > 0 ? r : -1;
+}
+
+static void transport_close(transport_t *t)
+{
+#if defined(__linux__)
+    if (t->kind == TRANSPORT_SHM)
+    {
+        atomic_store_explicit(&t->slot->state, SHM_SLOT_FREE, memory_order_release);
+        munmap(t->region, sizeof(shm_region_t));
+        return;
+    }
+#endif
+    closesocket(t->sock);
+#if !defined _WIN32
+    if (t->kind == TRANSPORT_UNIX)
+        unlink(t->local_path);
+#endif
+}
+
+/*
+ * build_request
+ * Prepara la richiesta standard in formato binario fisso: 1 byte per il
+ * tipo e 64 byte per la città (terminata da '\0').
+ */
+static void build_request(unsigned char reqbuf[REQUEST_SIZE], char type, const char *city)
+{
+    memset(reqbuf, 0, REQUEST_SIZE);
+    reqbuf[0] = (unsigned char)type;
+    size_t clen = strlen(city);
+    if (clen > 63)
+        clen = 63;
+    memcpy(&reqbuf[1], city, clen);
+}
+
+static double now_us(void)
+{
+#if defined _WIN32
+    LARGE_INTEGER freq, cnt;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (double)cnt.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#endif
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+#define BURST_MAX 64 // richieste per lotto (segmenti di un invio GSO)
+
+/*
+ * burst_send
+ * Invia k copie della richiesta di len byte. Su UDP (Linux) parte un solo
+ * datagram con UDP_SEGMENT che il kernel suddivide in k segmenti da len
+ * (più il trailer, firmato per ogni segmento, in modalità autenticata);
+ * se l'offload non è disponibile si ricade su k invii distinti.
  *
- * static void print_usage(const char *progname)
+ * Restituisce il numero di chiamate di sistema usate, -1 in caso di errore.
+ */
+static int burst_send(transport_t *t, const unsigned char *reqbuf, size_t len, int k)
 {
-    printf("Usage: %s [-s server] [-p port] -r \"type city\"\n", progname);
+#if defined(__linux__)
+    static int gso_disabled = 0;
+    if (t->kind == TRANSPORT_UDP && k > 1 && !gso_disabled)
+    {
+        unsigned char buf[BURST_MAX * (COMPACT_REQUEST_SIZE(4) + AUTH_TRAILER_SIZE)];
+        size_t seg = auth_enabled ? len + AUTH_TRAILER_SIZE : len;
+        for (int i = 0; i < k; ++i)
+        {
+            if (auth_enabled)
+                auth_sign(&buf[i * seg], reqbuf, len);
+            else
+                memcpy(&buf[i * seg], reqbuf, len);
+        }
+        struct iovec iov = { buf, (size_t)k * seg };
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        memset(control, 0, sizeof(control));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t gso_size = (uint16_t)seg;
+        memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        if (sendmsg(t->sock, &msg, 0) >= 0)
+            return 1;
+        if (errno != EINVAL && errno != EIO && errno != ENOPROTOOPT)
+            return -1;
+        gso_disabled = 1;
+    }
+#endif
+    for (int i = 0; i < k; ++i)
+    {
+        if (transport_send(t, reqbuf, len) != 0)
+            return -1;
+    }
+    return k;
 }
-*/
 
 /*
- * send_all
- * Invia tutti i byte dal buffer attraverso il socket.
- * Per UDP con connect(), invia il datagram completo in una singola chiamata.
- *
- * Parametri:
- *  - sock: file descriptor del socket
- *  - buf: buffer contenente i dati da inviare
- *  - len: numero di byte da inviare
+ * burst_recv
+ * Riceve k risposte da resplen byte. Con UDP_GRO attivo sul socket una
+ * sola ricezione può restituire più risposte accorpate: la dimensione del
+ * segmento arriva nel messaggio di controllo UDP_GRO.
  *
- * Restituisce 0 in caso di successo, -1 in caso di errore.
+ * Restituisce il numero di chiamate di sistema usate, -1 in caso di
+ * errore, timeout o risposta di lunghezza inattesa.
  */
-int send_all(int sock, const void *buf, size_t len)
+static int burst_recv(transport_t *t, int k, int resplen)
 {
-    int sent = send(sock, buf, (int)len, 0);
-    if (sent < 0)
-        return -1;
-    if ((size_t)sent != len)
-        return -1;
-    return 0;
+    unsigned char buf[BURST_MAX * BUFFER_SIZE];
+    int got = 0, calls = 0;
+    while (got < k)
+    {
+        int len, seg;
+#if defined(__linux__)
+        if (t->kind == TRANSPORT_UDP)
+        {
+            struct iovec iov = { buf, sizeof(buf) };
+            char control[CMSG_SPACE(sizeof(int))];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            len = (int)recvmsg(t->sock, &msg, 0);
+            seg = len;
+            for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); len > 0 && cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+            {
+                if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+                    memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+            }
+        }
+        else
+#endif
+        {
+            len = transport_recv(t, buf, sizeof(buf));
+            seg = len;
+        }
+        calls++;
+        if (len <= 0 || seg != resplen || len % resplen != 0)
+            return -1;
+        got += len / resplen;
+    }
+    return got == k ? calls : -1;
 }
 
 /*
- * recv_all
- * Riceve esattamente il numero specificato di byte dal socket.
- * Per UDP con connect(), riceve un datagram completo.
- *
- * Parametri:
- *  - sock: file descriptor del socket
- *  - buf: buffer dove memorizzare i dati ricevuti
- *  - len: numero di byte da ricevere
+ * run_bench
+ * Modalità --bench: invia n richieste sequenziali sul trasporto scelto e
+ * riporta la latenza di andata e ritorno (min, media, p50, p99, max).
+ * Con --burst k ogni iterazione invia k richieste insieme e attende le k
+ * risposte: la latenza è quella del lotto, e si riportano anche il costo
+ * per richiesta e le chiamate di sistema per richiesta. La richiesta è
+ * già preparata (standard o compatta) e ogni risposta deve essere lunga
+ * resplen byte.
  *
- * Restituisce 0 in caso di successo, -1 in caso di errore o chiusura connessione.
+ * Restituisce 0 in caso di successo, 1 se una richiesta fallisce.
  */
-int recv_all(int sock, void *buf, size_t len)
+static int run_bench(transport_t *t, const char *uri, const unsigned char *reqbuf, size_t reqlen,
+                     int resplen, int n, int burst)
 {
-    int r = recv(sock, buf, (int)len, 0);
-    if (r <= 0)
-        return -1;
-    if ((size_t)r != len)
-        return -1;
+    double *lat = (double *)malloc(sizeof(double) * (size_t)n);
+    if (!lat)
+        return 1;
+#if defined(__linux__)
+    if (burst > 1 && t->kind == TRANSPORT_UDP)
+    {
+        // Risposte accorpate dal server (GSO) ricevute in un'unica chiamata
+        int on = 1;
+        setsockopt(t->sock, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        struct timeval tv = { 5, 0 };
+        setsockopt(t->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+#endif
+
+    // Riscaldamento: cache, TLB e percorso del server
+    for (int i = 0; i < 100 && i < n; ++i)
+    {
+        if (burst_send(t, reqbuf, reqlen, burst) < 0 || burst_recv(t, burst, resplen) < 0)
+        {
+            fprintf(stderr, "Failed to receive response\n");
+            free(lat);
+            return 1;
+        }
+    }
+    double total = 0.0;
+    long long calls = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        double t0 = now_us();
+        int sc = burst_send(t, reqbuf, reqlen, burst);
+        int rc = sc < 0 ? -1 : burst_recv(t, burst, resplen);
+        if (rc < 0)
+        {
+            fprintf(stderr, "Failed to receive response\n");
+            free(lat);
+            return 1;
+        }
+        lat[i] = now_us() - t0;
+        total += lat[i];
+        calls += sc + rc;
+    }
+    qsort(lat, (size_t)n, sizeof(double), cmp_double);
+    printf("%-28s n=%d  min %.1f us  media %.1f us  p50 %.1f us  p99 %.1f us  max %.1f us\n",
+           uri, n, lat[0], total / n, lat[n / 2], lat[(int)((n - 1) * 0.99)], lat[n - 1]);
+    if (burst > 1)
+    {
+        double reqs = (double)n * burst;
+        printf("%-28s burst=%d  %.2f us/richiesta  %.0f richieste/s  %.2f syscall/richiesta (client)\n",
+               "", burst, total / reqs, reqs / (total / 1e6), (double)calls / reqs);
+    }
+    free(lat);
     return 0;
 }
 
 /*
- * ntohf
- * Converte un uint32_t ricevuto in network byte order nella corrispondente
- * variabile `float` in host byte order. Il float viene trasmesso in rete
- * come bit pattern (uint32_t) e qui si usano ntohl + memcpy per rispettare
- * l'endianness e le aliasing rules.
+ * build_compact
+ * Prepara la richiesta compatta (REQ_COMPACT) per una misura della città,
+ * o per tutte con il tipo '*', con i formati scelti con -u.
+ *
+ * Restituisce il numero di misure richieste.
  */
-float ntohf(uint32_t i)
+static int build_compact(unsigned char req[COMPACT_REQUEST_SIZE(4)], char type, const char *city,
+                         const unsigned char fmts[4])
 {
-    i = ntohl(i);
-    float f;
-    memcpy(&f, &i, sizeof(f));
-    return f;
+    memset(req, 0, COMPACT_REQUEST_SIZE(4));
+    req[0] = REQ_COMPACT;
+    size_t clen = strlen(city);
+    memcpy(&req[1], city, clen > 63 ? 63 : clen);
+    int n = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        char ti = COMPACT_TYPES[i];
+        if (type == '*' || tolower((unsigned char)type) == ti)
+        {
+            req[66 + 2 * n] = (unsigned char)(type == '*' ? ti : type);
+            req[67 + 2 * n] = fmts[i];
+            n++;
+        }
+    }
+    if (n == 0)
+    {
+        // Tipo sconosciuto: lo si invia comunque e decide il server
+        req[66] = (unsigned char)type;
+        n = 1;
+    }
+    req[65] = (unsigned char)n;
+    return n;
 }
 
 /*
- * validaporta
- * Verifica che la stringa fornita rappresenti un numero intero
- * compreso nell'intervallo delle porte valide (1-65535).
- * Se valida, scrive il valore in `out_port` e restituisce 1.
- * Altrimenti restituisce 0.
+ * run_compact
+ * Richiesta compatta: valori in virgola fissa nelle unità e con le cifre
+ * decimali scelte con -u. Il server può concedere meno cifre di quelle
+ * richieste: si stampano quelle concesse, nel formato della risposta.
+ *
+ * Parametri:
+ *  - t: trasporto aperto
+ *  - type: tipo di misura ('*' per tutte)
+ *  - city: nome città
+ *  - fmts: formato richiesto per misura (ordine COMPACT_TYPES)
+ *  - name, ip: server da mostrare
+ *
+ * Restituisce 0 se la risposta è ben formata, 1 altrimenti.
  */
-int validaporta(const char *s, int *out_port)
+static int run_compact(transport_t *t, char type, char *city, const unsigned char fmts[4],
+                       const char *name, const char *ip)
 {
-    char *end;
-    errno = 0;
-    long v = strtol(s, &end, 10);
-    if (errno != 0)
-        return 0;
-    if (*end != '\0')
-        return 0;
-    if (v < 1 || v > 65535)
-        return 0;
-    *out_port = (int)v;
-    return 1;
+    unsigned char req[COMPACT_REQUEST_SIZE(4)];
+    int n = build_compact(req, type, city, fmts);
+    unsigned char resp[BUFFER_SIZE];
+    int len = -1;
+    if (transport_send(t, req, COMPACT_REQUEST_SIZE(n)) == 0)
+        len = transport_recv(t, resp, sizeof(resp));
+    if (len < 2)
+    {
+        fprintf(stderr, "Failed to receive response\n");
+        return 1;
+    }
+
+    if (city[0])
+        city[0] = (char)toupper((unsigned char)city[0]);
+    char message[512];
+    if (resp[0] == STATUS_SUCCESS && len == COMPACT_RESPONSE_SIZE(resp[1]))
+    {
+        size_t off = (size_t)snprintf(message, sizeof(message), "%s:", city);
+        for (int i = 0; i < resp[1] && off < sizeof(message); ++i)
+        {
+            const unsigned char *item = &resp[2 + 4 * i];
+            int16_t v = (int16_t)(item[2] << 8 | item[3]);
+            char num[32];
+            format_fixed(num, sizeof(num), v, COMPACT_DEC(item[1]));
+            off += (size_t)snprintf(message + off, sizeof(message) - off, "%s %s = %s%s",
+                                    i ? "," : "", type_label((char)item[0]), num,
+                                    unit_suffix((unsigned char)COMPACT_UNIT(item[1])));
+        }
+    }
+    else if (resp[0] == STATUS_CITY_NOT_AVAILABLE)
+        snprintf(message, sizeof(message), "Citta' non disponibile");
+    else if (resp[0] == STATUS_INVALID_REQUEST)
+        snprintf(message, sizeof(message), "Richiesta non valida");
+    else
+        snprintf(message, sizeof(message), "Errore");
+    printf("Ricevuto risultato dal server %s (ip %s). %s\n", name, ip, message);
+    return resp[0] == STATUS_SUCCESS && len != COMPACT_RESPONSE_SIZE(resp[1]);
 }
 
 int main(int argc, char *argv[])
@@ -198,12 +1399,41 @@ int main(int argc, char *argv[])
     const char *server = SERVER_IP; // unified constant from protocol.h
     int port = SERVER_PORT;         // unified constant from protocol.h
     const char *request = NULL;
+    long history_secs = 0; // > 0: richiesta storico sugli ultimi N secondi
+    int history_aggr = 0;  // 1: min/max/media invece dei singoli campioni
+    int watch = 0;         // 1: modalità push (--watch)
+    const char *listen_group = NULL; // --listen: ricezione snapshot multicast
+    int listen_port = MCAST_PORT;
+    const char *listen_if = NULL;    // -I: interfaccia per il multicast
+    int bench = 0;                   // --bench N: misura la latenza di N richieste
+    int burst = 1;                   // --burst K: richieste per lotto in --bench
+    int compact = 0;                 // -c: risposta compatta in virgola fissa
+    unsigned char fmts[4];           // -u: formato per misura (ordine COMPACT_TYPES)
+    for (int i = 0; i < 4; ++i)
+        fmts[i] = COMPACT_FMT(UNIT_DEFAULT, 1);
 
     /*
      * Parsing degli argomenti da linea di comando
      * -s server : indirizzo del server (opzionale)
      * -p port   : porta del server (opzionale)
      * -r request: stringa obbligatoria con il formato "type city"
+     * -H secs   : storico della misura negli ultimi secs secondi (opzionale)
+     * -a        : con -H, restituisce solo min/max/media (opzionale)
+     * --watch   : si iscrive agli aggiornamenti push; -r diventa un filtro
+     *             opzionale ("* bari" per tutte le misure di una città)
+     * --listen gruppo[:porta] : riceve gli snapshot multicast del server
+     * -I ifaddr : interfaccia su cui unirsi al gruppo (es. 127.0.0.1)
+     * --bench N : invia N richieste -r e riporta la latenza di andata e ritorno
+     * --burst K : con --bench, invia le richieste a lotti di K (max 64);
+     *             con -c/-u si misurano le richieste compatte
+     * -k id:chiave : firma le richieste per un server in modalità
+     *             autenticata (-K); chiave di 128 bit in esadecimale
+     * -c        : risposta compatta in virgola fissa (REQ_COMPACT); con
+     *             -r "* città" chiede tutte le misure in un solo datagram
+     * -u lista  : unità e decimali per misura, "unità[:decimali]" separate
+     *             da virgole (C F % km/h m/s hPa inHg); implica -c
+     * Con -s si può indicare un URI: udp://host[:porta], unix:///percorso,
+     * shm://nome (vedi transport_open).
      */
     for (int i = 1; i < argc; ++i)
     {
@@ -224,6 +1454,83 @@ int main(int argc, char *argv[])
         {
             request = argv[++i];
         }
+        else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc)
+        {
+            char *end;
+            history_secs = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || history_secs <= 0)
+            {
+                fprintf(stderr, "Intervallo storico non valido: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            history_aggr = 1;
+        }
+        else if (strcmp(argv[i], "--watch") == 0)
+        {
+            watch = 1;
+        }
+        else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc)
+        {
+            static char group[64];
+            strncpy(group, argv[++i], sizeof(group) - 1);
+            char *colon = strchr(group, ':');
+            if (colon)
+            {
+                *colon = '\0';
+                if (!validaporta(colon + 1, &listen_port))
+                {
+                    fprintf(stderr, "Porta non valida: %s\n", colon + 1);
+                    return 1;
+                }
+            }
+            listen_group = group;
+        }
+        else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc)
+        {
+            listen_if = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            bench = atoi(argv[++i]);
+            if (bench <= 0)
+            {
+                fprintf(stderr, "Numero di richieste non valido: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+        {
+            if (!auth_parse(argv[++i]))
+            {
+                fprintf(stderr, "Chiave non valida: %s (atteso id:32 cifre esadecimali)\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            compact = 1;
+        }
+        else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+        {
+            if (!parse_units(argv[++i], fmts))
+            {
+                fprintf(stderr, "Unita' non valide: %s (atteso es. F:2,inHg,m/s)\n", argv[i]);
+                return 1;
+            }
+            compact = 1;
+        }
+        else if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc)
+        {
+            burst = atoi(argv[++i]);
+            if (burst <= 0 || burst > BURST_MAX)
+            {
+                fprintf(stderr, "Dimensione del lotto non valida: %s\n", argv[i]);
+                return 1;
+            }
+        }
         else
         {
             // print_usage(argv[0]);
@@ -231,7 +1538,7 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (!request)
+    if (!request && !watch && !listen_group)
     {
         // print_usage(argv[0]);
         return 1;
@@ -250,48 +1557,105 @@ int main(int argc, char *argv[])
     }
 #endif
 
-    /* Resolve server address (IPv4) and perform forward/reverse DNS
-     * lookup early so we can display canonical server name and IP even
-     * when the client detects a local request parsing error. */
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons((uint16_t)port);
-    if (my_inet_pton(AF_INET, server, &server_addr.sin_addr) != 1)
+    if (listen_group)
     {
-        struct hostent *he = gethostbyname(server);
-        if (!he)
-        {
-            fprintf(stderr, "Failed to resolve server address\n");
+        int rc = run_listen(listen_group, listen_port, listen_if);
 #if defined _WIN32
-            WSACleanup();
+        WSACleanup();
 #endif
-            return 1;
+        return rc;
+    }
+
+    /*
+     * Selezione del trasporto dall'URI (se presente) passato con -s.
+     * Per i trasporti locali non c'è risoluzione DNS: come nome del server
+     * si mostra l'URI e come IP "locale".
+     */
+    int transport = TRANSPORT_UDP;
+    const char *target = NULL;
+    static char uri_host[256];
+    const char *uri = server;
+    if (strncmp(server, "udp://", 6) == 0)
+    {
+        strncpy(uri_host, server + 6, sizeof(uri_host) - 1);
+        char *colon = strchr(uri_host, ':');
+        if (colon)
+        {
+            *colon = '\0';
+            if (!validaporta(colon + 1, &port))
+            {
+                fprintf(stderr, "Porta non valida: %s\n", colon + 1);
+                return 1;
+            }
         }
-        server_addr.sin_addr = *(struct in_addr *)he->h_addr_list[0];
+        server = uri_host;
+    }
+    else if (strncmp(server, "unix://", 7) == 0)
+    {
+        transport = TRANSPORT_UNIX;
+        target = server + 7;
+    }
+    else if (strncmp(server, "shm://", 6) == 0)
+    {
+        transport = TRANSPORT_SHM;
+        target = server + 6;
+    }
+    else if (strstr(server, "://") != NULL)
+    {
+        fprintf(stderr, "Trasporto non supportato: %s\n", server);
+        return 1;
     }
 
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     char resolved_ip[INET_ADDRSTRLEN] = "";
     char resolved_name[256] = "";
-    my_inet_ntop(AF_INET, &server_addr.sin_addr, resolved_ip, sizeof(resolved_ip));
+    if (transport != TRANSPORT_UDP)
     {
-        struct in_addr addr = server_addr.sin_addr;
-        struct hostent *he2 = gethostbyaddr((const char *)&addr, sizeof(addr), AF_INET);
-        if (he2 && he2->h_name)
+        snprintf(resolved_name, sizeof(resolved_name), "%s", uri);
+        snprintf(resolved_ip, sizeof(resolved_ip), "locale");
+    }
+    else
+    {
+        /* Resolve server address (IPv4) and perform forward/reverse DNS
+         * lookup early so we can display canonical server name and IP even
+         * when the client detects a local request parsing error. */
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons((uint16_t)port);
+        if (my_inet_pton(AF_INET, server, &server_addr.sin_addr) != 1)
         {
-            size_t len = strlen(he2->h_name);
-            if (len >= sizeof(resolved_name))
-                len = sizeof(resolved_name) - 1;
-            memcpy(resolved_name, he2->h_name, len);
-            resolved_name[len] = '\0';
+            struct hostent *he = gethostbyname(server);
+            if (!he)
+            {
+                fprintf(stderr, "Failed to resolve server address\n");
+    #if defined _WIN32
+                WSACleanup();
+    #endif
+                return 1;
+            }
+            server_addr.sin_addr = *(struct in_addr *)he->h_addr_list[0];
         }
-        else
+
+        my_inet_ntop(AF_INET, &server_addr.sin_addr, resolved_ip, sizeof(resolved_ip));
         {
-            size_t len = strlen(resolved_ip);
-            if (len >= sizeof(resolved_name))
-                len = sizeof(resolved_name) - 1;
-            memcpy(resolved_name, resolved_ip, len);
-            resolved_name[len] = '\0';
+            struct in_addr addr = server_addr.sin_addr;
+            struct hostent *he2 = gethostbyaddr((const char *)&addr, sizeof(addr), AF_INET);
+            if (he2 && he2->h_name)
+            {
+                size_t len = strlen(he2->h_name);
+                if (len >= sizeof(resolved_name))
+                    len = sizeof(resolved_name) - 1;
+                memcpy(resolved_name, he2->h_name, len);
+                resolved_name[len] = '\0';
+            }
+            else
+            {
+                size_t len = strlen(resolved_ip);
+                if (len >= sizeof(resolved_name))
+                    len = sizeof(resolved_name) - 1;
+                memcpy(resolved_name, resolved_ip, len);
+                resolved_name[len] = '\0';
+            }
         }
     }
 
@@ -308,79 +1672,153 @@ int main(int argc, char *argv[])
      *  - "t bari"  -> type='t', city='bari'  (valido)
      *  - "pippo bari" -> token 'pippo' ha lunghezza>1 -> richiesta non valida
      */
-    const char *p = request;
-    while (*p && isspace((unsigned char)*p))
-        p++;
-    const char *token_start = p;
-    while (*p && !isspace((unsigned char)*p))
-        p++;
-    size_t token_len = (size_t)(p - token_start);
-    if (token_len != 1)
-    {
-        // Token non valido: stampiamo il messaggio richiesto senza contattare il server
-        printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", resolved_name, resolved_ip);
-        return 1;
-    }
-    char type = token_start[0];
-    while (*p && isspace((unsigned char)*p))
-        p++;
+    char type = '*'; // in modalità --watch senza -r: tutte le misure
     char city[64];
     memset(city, 0, sizeof(city));
-    /* Validate city: no tabs allowed and max length 63 (plus null). */
-    if (strchr(p, '\t') != NULL)
+    if (request)
     {
-        printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", resolved_name, resolved_ip);
-        return 1;
+        const char *p = request;
+        while (*p && isspace((unsigned char)*p))
+            p++;
+        const char *token_start = p;
+        while (*p && !isspace((unsigned char)*p))
+            p++;
+        size_t token_len = (size_t)(p - token_start);
+        if (token_len != 1)
+        {
+            // Token non valido: stampiamo il messaggio richiesto senza contattare il server
+            printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", resolved_name, resolved_ip);
+            return 1;
+        }
+        type = token_start[0];
+        while (*p && isspace((unsigned char)*p))
+            p++;
+        /* Validate city: no tabs allowed and max length 63 (plus null). */
+        if (strchr(p, '\t') != NULL)
+        {
+            printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", resolved_name, resolved_ip);
+            return 1;
+        }
+        size_t city_len = strlen(p);
+        if (city_len == 0 || city_len > 63)
+        {
+            printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", resolved_name, resolved_ip);
+            return 1;
+        }
+        memcpy(city, p, city_len);
+        city[city_len] = '\0';
     }
-    size_t city_len = strlen(p);
-    if (city_len == 0 || city_len > 63)
+
+    /* (DNS resolution already performed earlier) */
+
+    transport_t tr;
+    if (transport_open(&tr, transport, &server_addr, target) != 0)
     {
-        printf("Ricevuto risultato dal server %s (ip %s). Richiesta non valida\n", resolved_name, resolved_ip);
+#if defined _WIN32
+        WSACleanup();
+#endif
         return 1;
     }
-    memcpy(city, p, city_len);
-    city[city_len] = '\0';
+    int sock = tr.sock;
 
-    /* (DNS resolution already performed earlier) */
+    if (bench)
+    {
+        int rc = 1;
+        if (!request)
+            fprintf(stderr, "--bench richiede -r \"type city\"\n");
+        else if (compact)
+        {
+            unsigned char creq[COMPACT_REQUEST_SIZE(4)];
+            int items = build_compact(creq, type, city, fmts);
+            rc = run_bench(&tr, uri, creq, COMPACT_REQUEST_SIZE(items), COMPACT_RESPONSE_SIZE(items),
+                           bench, burst);
+        }
+        else
+        {
+            unsigned char reqbuf[REQUEST_SIZE];
+            build_request(reqbuf, type, city);
+            rc = run_bench(&tr, uri, reqbuf, REQUEST_SIZE, RESPONSE_SIZE, bench, burst);
+        }
+        transport_close(&tr);
+#if defined _WIN32
+        WSACleanup();
+#endif
+        return rc;
+    }
 
-    int sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock < 0)
+    if (watch)
     {
-        perror("socket");
+        int rc = 1;
+        // Le iscrizioni push sono legate all'indirizzo UDP del client
+        if (transport != TRANSPORT_UDP)
+            fprintf(stderr, "--watch richiede il trasporto udp://\n");
+        else
+            rc = run_watch(sock, type, city, resolved_name, resolved_ip);
+        transport_close(&tr);
 #if defined _WIN32
         WSACleanup();
 #endif
-        return 1;
+        return rc;
     }
 
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    /*
+     * Richiesta storico: 75 byte (vedi protocol.h). L'intervallo parte da
+     * "adesso - history_secs" e resta aperto verso il presente (to = 0).
+     */
+    if (history_secs > 0)
     {
-        perror("connect");
-        closesocket(sock);
+        unsigned char hreq[HISTORY_REQUEST_SIZE];
+        memset(hreq, 0, sizeof(hreq));
+        hreq[0] = REQ_HISTORY;
+        memcpy(&hreq[1], city, strlen(city));
+        hreq[65] = (unsigned char)type;
+        hreq[66] = history_aggr ? HIST_MODE_AGGR : HIST_MODE_RANGE;
+        time_t now = time(NULL);
+        uint32_t from = htonl((uint32_t)(now > history_secs ? now - history_secs : 1));
+        memcpy(&hreq[67], &from, 4);
+
+        unsigned char hresp[BUFFER_SIZE];
+        int hlen = -1;
+        if (transport_send(&tr, hreq, sizeof(hreq)) == 0)
+            hlen = transport_recv(&tr, hresp, sizeof(hresp));
+        int rc = 1;
+        if (hlen < 0)
+            fprintf(stderr, "Failed to receive response\n");
+        else
+        {
+            if (city[0])
+                city[0] = (char)toupper((unsigned char)city[0]);
+            rc = print_history(hresp, hlen, city, resolved_name, resolved_ip);
+        }
+        transport_close(&tr);
 #if defined _WIN32
         WSACleanup();
 #endif
-        return 1;
+        return rc;
+    }
+
+    if (compact)
+    {
+        int rc = run_compact(&tr, type, city, fmts, resolved_name, resolved_ip);
+        transport_close(&tr);
+#if defined _WIN32
+        WSACleanup();
+#endif
+        return rc;
     }
 
     /*
      * Preparazione della richiesta in formato binario fisso: 1 byte per il
-     * tipo e 64 byte per la città. Si invia con send_all per assicurare che
-     * tutti i byte vengano trasmessi.
+     * tipo e 64 byte per la città. Si invia con transport_send (send_all
+     * per UDP) per assicurare che tutti i byte vengano trasmessi.
      */
     // Prepare and send request: fixed 65 bytes (1 type + 64 city)
-    unsigned char reqbuf[65];
-    memset(reqbuf, 0, sizeof(reqbuf));
-    reqbuf[0] = (unsigned char)type;
-    size_t clen = strlen(city);
-    if (clen > 63)
-        clen = 63;
-    memcpy(&reqbuf[1], city, clen);
-    reqbuf[1 + clen] = '\0';
-    if (send_all(sock, reqbuf, sizeof(reqbuf)) != 0)
+    unsigned char reqbuf[REQUEST_SIZE];
+    build_request(reqbuf, type, city);
+    if (transport_send(&tr, reqbuf, sizeof(reqbuf)) != 0)
     {
         fprintf(stderr, "Failed to send request\n");
-        closesocket(sock);
+        transport_close(&tr);
 #if defined _WIN32
         WSACleanup();
 #endif
@@ -395,11 +1833,11 @@ int main(int argc, char *argv[])
      * Si usa recv_all per assicurare la ricezione completa dei 9 byte.
      */
     // Receive response: 4 bytes status (network), 1 byte type, 4 bytes float
-    unsigned char respbuf[9];
-    if (recv_all(sock, respbuf, sizeof(respbuf)) != 0)
+    unsigned char respbuf[RESPONSE_SIZE];
+    if (transport_recv(&tr, respbuf, sizeof(respbuf)) != RESPONSE_SIZE)
     {
         fprintf(stderr, "Failed to receive response\n");
-        closesocket(sock);
+        transport_close(&tr);
 #if defined _WIN32
         WSACleanup();
 #endif
@@ -428,7 +1866,7 @@ int main(int argc, char *argv[])
 #endif
     int got_peer = 0;
     char peer_ip[INET_ADDRSTRLEN] = "";
-    if (getpeername(sock, (struct sockaddr *)&peer_addr, &peer_len) == 0)
+    if (transport == TRANSPORT_UDP && getpeername(sock, (struct sockaddr *)&peer_addr, &peer_len) == 0)
     {
         my_inet_ntop(AF_INET, &peer_addr.sin_addr, peer_ip, sizeof(peer_ip));
         got_peer = 1;
@@ -537,7 +1975,7 @@ int main(int argc, char *argv[])
 
     printf("Ricevuto risultato dal server %s (ip %s). %s\n", print_name, print_ip, message);
 
-    closesocket(sock);
+    transport_close(&tr);
 #if defined _WIN32
     WSACleanup();
 #endif
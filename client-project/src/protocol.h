@@ -19,6 +19,91 @@
 #define STATUS_CITY_NOT_AVAILABLE 1u
 #define STATUS_INVALID_REQUEST    2u
 
+// Dimensione della richiesta standard (1 byte tipo + 64 byte città)
+#define REQUEST_SIZE 65
+// Dimensione della risposta standard (4 byte status + 1 tipo + 4 float)
+#define RESPONSE_SIZE 9
+
+// Richieste estese (mirrors server header): opcode non alfabetico nel primo byte
+#define REQ_HISTORY     0x01
+#define REQ_SUBSCRIBE   0x02
+#define REQ_UNSUBSCRIBE 0x03
+#define REQ_COMPACT     0x04
+#define PUSH_UPDATE     0x82
+#define SNAPSHOT_FRAGMENT 0x83
+
+// Elenco condiviso delle città (stesso ordine del server): le posizioni
+// sono gli indici usati nei datagram push.
+#define CITY_COUNT 10
+#define CITY_NAMES { "Bari","Roma","Milano","Napoli","Torino", \
+        "Palermo","Genova","Bologna","Firenze","Venezia" }
+
+// Richiesta storico (75 byte): [0] REQ_HISTORY, [1..64] città, [65] tipo,
+// [66] modalità, [67..70] from, [71..74] to (uint32 unix time, network order)
+// Risposta: [0..3] status, [4] tipo, [5] modalità, [6..7] numero campioni,
+// poi campioni (4 byte ts + 4 byte float) oppure min/max/media (float).
+#define HISTORY_REQUEST_SIZE 75
+#define HISTORY_MAX_SAMPLES  60
+#define HIST_MODE_RANGE 0u
+#define HIST_MODE_AGGR  1u
+
+// Iscrizione (76 byte): [0] REQ_SUBSCRIBE, [1..64] città (vuota = tutte),
+// [65] maschera tipi (SUB_TYPE_*, 0 = tutti), [66..67] lease in secondi,
+// [68..75] cookie dell'ultima conferma (zeri al primo invio).
+// Cancellazione (76 byte): [0] REQ_UNSUBSCRIBE, [68..75] cookie
+// dell'ultima conferma, il resto ignorato.
+// Conferma (16 byte): [0..3] status, [4] opcode, [6..7] lease concesso,
+// [8..15] cookie; con STATUS_COOKIE_REQUIRED l'iscrizione o la
+// cancellazione va rimandata con il cookie ricevuto (verifica che il
+// mittente sia raggiungibile).
+// Push: [0] PUSH_UPDATE, [1] numero voci, [2..5] sequenza, poi voci da
+// 6 byte: [0] indice città, [1] tipo, [2..5] float (network order).
+#define SUBSCRIBE_REQUEST_SIZE 76
+#define SUB_ACK_SIZE           16
+#define SUB_COOKIE_SIZE        8
+#define STATUS_COOKIE_REQUIRED 3u
+#define PUSH_HEADER_SIZE       6
+#define PUSH_ENTRY_SIZE        6
+#define SUB_TYPE_T 0x01u
+#define SUB_TYPE_H 0x02u
+#define SUB_TYPE_W 0x04u
+#define SUB_TYPE_P 0x08u
+#define SUB_LEASE_DEFAULT 30
+
+// Richiesta compatta (66 + 2n byte): [0] REQ_COMPACT, [1..64] città, [65] n,
+// poi n coppie tipo/formato (unità nei 4 bit bassi, decimali negli alti).
+// Risposta (2 + 4n byte): [0] status, [1] n, poi tipo, formato concesso e
+// valore × 10^decimali (int16, network order) per ogni misura.
+#define COMPACT_MAX_ITEMS 8
+#define COMPACT_REQUEST_SIZE(n)  (66 + 2 * (n))
+#define COMPACT_RESPONSE_SIZE(n) (2 + 4 * (n))
+#define COMPACT_FMT(unit, dec) (unsigned char)(((dec) << 4) | (unit))
+#define COMPACT_UNIT(fmt) ((fmt) & 0x0Fu)
+#define COMPACT_DEC(fmt)  (((fmt) >> 4) & 0x0Fu)
+#define UNIT_DEFAULT    0u
+#define UNIT_CELSIUS    1u
+#define UNIT_FAHRENHEIT 2u
+#define UNIT_PERCENT    3u
+#define UNIT_KMH        4u
+#define UNIT_MS         5u
+#define UNIT_HPA        6u
+#define UNIT_INHG       7u
+#define UNIT_COUNT      8
+
+// Frammento di snapshot multicast: [0] SNAPSHOT_FRAGMENT, [2..5] sequenza,
+// [6..7] indice frammento, [8..9] numero frammenti, [10..11] prima voce,
+// [12..13] voci nel frammento, [14..15] voci totali, poi voci come nei push.
+#define SNAPSHOT_HEADER_SIZE 16
+#define SNAPSHOT_MAX_FRAGS   64
+#define MCAST_GROUP "239.255.0.1"
+#define MCAST_PORT  56701
+
+// Modalità autenticata (mirrors server header): trailer di 24 byte dopo
+// la richiesta: [0..3] key id, [4..7] unix time, [8..15] contatore,
+// [16..23] MAC SipHash-2-4 di richiesta e primi 16 byte (network order).
+#define AUTH_TRAILER_SIZE 24
+#define AUTH_MAC_OFFSET   16
+
 // Request (client -> server)
 typedef struct {
     char type;      // 't','h','w','p'
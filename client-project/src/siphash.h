@@ -0,0 +1,76 @@
+/*
+ * siphash.h
+ *
+ * SipHash-2-4 (Aumasson, Bernstein) con chiave di 128 bit e uscita di
+ * 64 bit: MAC delle richieste in modalità autenticata (vedi protocol.h).
+ * Su datagram di un centinaio di byte costa poche decine di nanosecondi.
+ *
+ * Il file è identico nel client e nel server (come protocol.h).
+ */
+
+#ifndef SIPHASH_H_
+#define SIPHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIPHASH_KEY_SIZE 16
+
+static inline uint64_t siphash_load64(const unsigned char *p) {
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24
+			| (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+#define SIPHASH_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPHASH_ROUND(v0, v1, v2, v3) do { \
+		v0 += v1; v1 = SIPHASH_ROTL(v1, 13); v1 ^= v0; v0 = SIPHASH_ROTL(v0, 32); \
+		v2 += v3; v3 = SIPHASH_ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = SIPHASH_ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = SIPHASH_ROTL(v1, 17); v1 ^= v2; v2 = SIPHASH_ROTL(v2, 32); \
+	} while (0)
+
+static inline uint64_t siphash24(const unsigned char key[SIPHASH_KEY_SIZE], const unsigned char *in, size_t len) {
+	uint64_t k0 = siphash_load64(key);
+	uint64_t k1 = siphash_load64(key + 8);
+	uint64_t v0 = 0x736f6d6570736575ull ^ k0;
+	uint64_t v1 = 0x646f72616e646f6dull ^ k1;
+	uint64_t v2 = 0x6c7967656e657261ull ^ k0;
+	uint64_t v3 = 0x7465646279746573ull ^ k1;
+
+	const unsigned char *end = in + (len & ~(size_t)7);
+	for (; in != end; in += 8) {
+		uint64_t m = siphash_load64(in);
+		v3 ^= m;
+		SIPHASH_ROUND(v0, v1, v2, v3);
+		SIPHASH_ROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+	// Ultimo blocco: byte rimanenti e lunghezza nel byte più alto
+	uint64_t b = (uint64_t)len << 56;
+	switch (len & 7) {
+		case 7: b |= (uint64_t)in[6] << 48; // fall through
+		case 6: b |= (uint64_t)in[5] << 40; // fall through
+		case 5: b |= (uint64_t)in[4] << 32; // fall through
+		case 4: b |= (uint64_t)in[3] << 24; // fall through
+		case 3: b |= (uint64_t)in[2] << 16; // fall through
+		case 2: b |= (uint64_t)in[1] << 8;  // fall through
+		case 1: b |= (uint64_t)in[0];       // fall through
+		default: break;
+	}
+	v3 ^= b;
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	v0 ^= b;
+	v2 ^= 0xff;
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#undef SIPHASH_ROUND
+#undef SIPHASH_ROTL
+
+#endif /* SIPHASH_H_ */
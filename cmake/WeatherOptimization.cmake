@@ -0,0 +1,53 @@
+# Modalità di ottimizzazione (WEATHER_LTO, WEATHER_PGO) e funzione
+# weather_pgo(target) che applica i profili ai target del percorso caldo.
+
+if(WEATHER_LTO)
+	include(CheckIPOSupported)
+	check_ipo_supported(RESULT weather_ipo OUTPUT weather_ipo_error LANGUAGES C)
+	if(weather_ipo)
+		set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)
+	else()
+		message(WARNING "LTO non supportata dal compilatore: ${weather_ipo_error}")
+	endif()
+endif()
+
+string(TOUPPER "${WEATHER_PGO}" WEATHER_PGO)
+set(weather_pgo_compile "")
+set(weather_pgo_link "")
+if(WEATHER_PGO STREQUAL "GENERATE")
+	# Aggiornamento atomico dei contatori: pipeline e cattura usano thread
+	include(CheckCCompilerFlag)
+	check_c_compiler_flag(-fprofile-update=atomic weather_has_atomic_profile)
+	set(weather_pgo_compile -fprofile-generate=${WEATHER_PGO_DIR})
+	if(weather_has_atomic_profile)
+		list(APPEND weather_pgo_compile -fprofile-update=atomic)
+	endif()
+	set(weather_pgo_link -fprofile-generate=${WEATHER_PGO_DIR})
+elseif(WEATHER_PGO STREQUAL "USE")
+	if(CMAKE_C_COMPILER_ID MATCHES "Clang")
+		# Clang legge un unico file unito con llvm-profdata (vedi pgo.cmake)
+		set(weather_pgo_compile -fprofile-use=${WEATHER_PGO_DIR}/weather.profdata)
+	else()
+		# GCC cerca i .gcda per percorso dell'oggetto: la build USE deve
+		# avvenire nella stessa cartella della build GENERATE. Il codice non
+		# esercitato dall'addestramento resta ottimizzato normalmente.
+		include(CheckCCompilerFlag)
+		check_c_compiler_flag(-fprofile-partial-training weather_has_partial_training)
+		set(weather_pgo_compile -fprofile-use=${WEATHER_PGO_DIR} -Wno-missing-profile)
+		if(weather_has_partial_training)
+			list(APPEND weather_pgo_compile -fprofile-partial-training)
+		endif()
+	endif()
+	set(weather_pgo_link ${weather_pgo_compile})
+elseif(NOT WEATHER_PGO STREQUAL "OFF")
+	message(FATAL_ERROR "WEATHER_PGO deve essere OFF, GENERATE o USE (non ${WEATHER_PGO})")
+endif()
+
+function(weather_pgo target)
+	if(weather_pgo_compile)
+		target_compile_options(${target} PRIVATE ${weather_pgo_compile})
+		target_link_libraries(${target} PRIVATE ${weather_pgo_link})
+	endif()
+endfunction()
+
+message(STATUS "Ottimizzazione: ${CMAKE_BUILD_TYPE}, LTO ${WEATHER_LTO}, PGO ${WEATHER_PGO}")
@@ -0,0 +1,218 @@
+# Pipeline PGO (cmake --build <build> --target pgo, oppure
+# cmake -DSOURCE_DIR=. -DWORK_DIR=build/pgo -P cmake/pgo.cmake):
+#
+#   1. build di riferimento -O2 semplice               WORK_DIR/o2
+#   2. build strumentata con LTO (WEATHER_PGO=GENERATE) WORK_DIR/opt
+#   3. addestramento: scripts/pgo_train.sh con traffico realistico
+#   4. ricompilazione nella stessa cartella con WEATHER_PGO=USE
+#   5. confronto: bench_server (rapporto per ogni caso pipeline/, media
+#      geometrica e casi peggiorati) e lo stesso carico di addestramento
+#      contro i due server, con lo stesso client -O2
+#
+# Variabili: SOURCE_DIR, WORK_DIR, GENERATOR e C_COMPILER (facoltativi),
+# TRAIN_REQUESTS (richieste per client nell'addestramento, 20000).
+
+if(NOT SOURCE_DIR OR NOT WORK_DIR)
+	message(FATAL_ERROR "Uso: cmake -DSOURCE_DIR=... -DWORK_DIR=... -P pgo.cmake")
+endif()
+if(NOT TRAIN_REQUESTS)
+	set(TRAIN_REQUESTS 20000)
+endif()
+
+set(o2_dir ${WORK_DIR}/o2)
+set(opt_dir ${WORK_DIR}/opt)
+set(profile_dir ${WORK_DIR}/profiles)
+
+set(common_args -DCMAKE_BUILD_TYPE=Release)
+if(GENERATOR)
+	list(APPEND common_args -G ${GENERATOR})
+endif()
+if(C_COMPILER)
+	list(APPEND common_args -DCMAKE_C_COMPILER=${C_COMPILER})
+endif()
+
+function(run_step what)
+	message(STATUS "pgo: ${what}")
+	execute_process(COMMAND ${ARGN} RESULT_VARIABLE rc)
+	if(NOT rc EQUAL 0)
+		message(FATAL_ERROR "pgo: ${what} non riuscito (${rc})")
+	endif()
+endfunction()
+
+function(build_tree dir)
+	run_step("configurazione ${dir}" ${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${dir} ${common_args} ${ARGN})
+	run_step("compilazione ${dir}" ${CMAKE_COMMAND} --build ${dir} --parallel)
+endfunction()
+
+# Esegue il carico di addestramento con il server indicato; in out_rate il
+# throughput complessivo in richieste/s
+function(run_load server requests out_rate)
+	execute_process(
+		COMMAND ${CMAKE_COMMAND} -E env SERVER=${server} CLIENT=${o2_dir}/client
+			sh ${SOURCE_DIR}/scripts/pgo_train.sh ${requests}
+		RESULT_VARIABLE rc
+		OUTPUT_VARIABLE out)
+	message("${out}")
+	if(NOT rc EQUAL 0)
+		message(FATAL_ERROR "pgo: carico contro ${server} non riuscito (${rc})")
+	endif()
+	string(REGEX MATCH "Totale: [0-9]+ richieste in [0-9.]+ s \\(([0-9]+) richieste/s\\)" _ "${out}")
+	set(${out_rate} ${CMAKE_MATCH_1} PARENT_SCOPE)
+endfunction()
+
+# Casi pipeline/ di bench_server: nomi e ns/op in picosecondi, nello
+# stesso ordine
+function(bench_cases dir out_names out_ps)
+	run_step("bench_server ${dir}" ${dir}/bench_server --filter pipeline/ --min-ms 200
+		--out ${dir}/bench_server.json)
+	file(STRINGS ${dir}/bench_server.json lines)
+	set(names "")
+	set(values "")
+	foreach(line IN LISTS lines)
+		if(line MATCHES "\"bench\":\"([^\"]+)\",\"ns_per_op\":([0-9]+)\\.([0-9][0-9][0-9])")
+			list(APPEND names ${CMAKE_MATCH_1})
+			math(EXPR ps "${CMAKE_MATCH_2} * 1000 + ${CMAKE_MATCH_3}")
+			list(APPEND values ${ps})
+		endif()
+	endforeach()
+	set(${out_names} ${names} PARENT_SCOPE)
+	set(${out_ps} ${values} PARENT_SCOPE)
+endfunction()
+
+# Rapporto num/den in milionesimi (arrotondato)
+function(ratio_micro num den out)
+	if(den EQUAL 0)
+		set(${out} 0 PARENT_SCOPE)
+		return()
+	endif()
+	math(EXPR micro "(${num} * 1000000 + ${den} / 2) / ${den}")
+	set(${out} ${micro} PARENT_SCOPE)
+endfunction()
+
+# Rapporto in milionesimi come testo con tre decimali
+function(format_ratio micro out)
+	if(micro EQUAL 0)
+		set(${out} "n/d" PARENT_SCOPE)
+		return()
+	endif()
+	math(EXPR milli "(${micro} + 500) / 1000")
+	math(EXPR whole "${milli} / 1000")
+	math(EXPR frac "${milli} % 1000")
+	string(LENGTH "${frac}" len)
+	while(len LESS 3)
+		set(frac "0${frac}")
+		string(LENGTH "${frac}" len)
+	endwhile()
+	set(${out} "${whole}.${frac}" PARENT_SCOPE)
+endfunction()
+
+# Media geometrica di rapporti in milionesimi: math() conosce solo gli
+# interi, quindi si cerca per bisezione il più grande g con g^n <= prodotto
+# (entrambi in virgola fissa, riscalati a ogni moltiplicazione)
+function(geomean_micro values out)
+	list(LENGTH values n)
+	if(n EQUAL 0)
+		set(${out} 0 PARENT_SCOPE)
+		return()
+	endif()
+	set(prod 1000000)
+	set(hi 0)
+	foreach(v IN LISTS values)
+		math(EXPR prod "${prod} * ${v} / 1000000")
+		if(v GREATER hi)
+			set(hi ${v})
+		endif()
+	endforeach()
+	set(lo 0)
+	while(lo LESS hi)
+		math(EXPR mid "(${lo} + ${hi} + 1) / 2")
+		set(pow 1000000)
+		foreach(i RANGE 1 ${n})
+			math(EXPR pow "${pow} * ${mid} / 1000000")
+			if(pow GREATER prod)
+				break()
+			endif()
+		endforeach()
+		if(pow GREATER prod)
+			math(EXPR hi "${mid} - 1")
+		else()
+			set(lo ${mid})
+		endif()
+	endwhile()
+	set(${out} ${lo} PARENT_SCOPE)
+endfunction()
+
+# Picosecondi come nanosecondi con un decimale
+function(format_ns ps out)
+	math(EXPR tenths "(${ps} + 50) / 100")
+	math(EXPR whole "${tenths} / 10")
+	math(EXPR frac "${tenths} % 10")
+	set(${out} "${whole}.${frac}" PARENT_SCOPE)
+endfunction()
+
+build_tree(${o2_dir} -DWEATHER_LTO=OFF -DWEATHER_PGO=OFF)
+
+# I profili precedenti non devono mescolarsi con quelli nuovi
+file(REMOVE_RECURSE ${profile_dir})
+file(MAKE_DIRECTORY ${profile_dir})
+build_tree(${opt_dir} -DWEATHER_LTO=ON -DWEATHER_PGO=GENERATE -DWEATHER_PGO_DIR=${profile_dir})
+message(STATUS "pgo: addestramento con traffico realistico")
+run_load(${opt_dir}/server ${TRAIN_REQUESTS} train_rate)
+
+file(GLOB raw_profiles ${profile_dir}/*.profraw)
+if(raw_profiles)
+	# Clang: i profili grezzi vanno uniti in un unico file
+	get_filename_component(compiler_dir "${C_COMPILER}" DIRECTORY)
+	find_program(LLVM_PROFDATA NAMES llvm-profdata HINTS ${compiler_dir})
+	if(NOT LLVM_PROFDATA)
+		message(FATAL_ERROR "pgo: llvm-profdata non trovato")
+	endif()
+	run_step("unione dei profili" ${LLVM_PROFDATA} merge -o ${profile_dir}/weather.profdata ${raw_profiles})
+endif()
+
+build_tree(${opt_dir} -DWEATHER_PGO=USE)
+
+message(STATUS "pgo: confronto con la build -O2")
+bench_cases(${o2_dir} o2_names o2_ps)
+bench_cases(${opt_dir} opt_names opt_ps)
+run_load(${o2_dir}/server ${TRAIN_REQUESTS} o2_rate)
+run_load(${opt_dir}/server ${TRAIN_REQUESTS} opt_rate)
+
+# Un rapporto per caso: una somma dei tempi nasconderebbe le regressioni
+# dei casi veloci dietro i guadagni di quelli lenti
+set(report "Speedup LTO+PGO rispetto a -O2:\n")
+set(ratios "")
+set(regressed "")
+list(LENGTH o2_names ncases)
+if(ncases GREATER 0)
+	math(EXPR last "${ncases} - 1")
+	foreach(i RANGE ${last})
+		list(GET o2_names ${i} name)
+		list(GET o2_ps ${i} before)
+		list(FIND opt_names ${name} j)
+		if(j LESS 0)
+			continue()
+		endif()
+		list(GET opt_ps ${j} after)
+		ratio_micro(${before} ${after} r)
+		list(APPEND ratios ${r})
+		format_ns(${before} before_ns)
+		format_ns(${after} after_ns)
+		format_ratio(${r} r_text)
+		string(APPEND report "  bench_server ${name}: ${before_ns} ns -> ${after_ns} ns (x${r_text})\n")
+		if(r LESS 1000000)
+			list(APPEND regressed "${name} (x${r_text})")
+		endif()
+	endforeach()
+endif()
+geomean_micro("${ratios}" geo)
+format_ratio(${geo} geo_text)
+ratio_micro(${opt_rate} ${o2_rate} load)
+format_ratio(${load} load_text)
+string(APPEND report "  bench_server pipeline/*, media geometrica: x${geo_text}\n"
+	"  carico di addestramento: ${o2_rate} -> ${opt_rate} richieste/s (x${load_text})\n")
+if(regressed)
+	list(JOIN regressed ", " regressed_text)
+	string(APPEND report "Casi più lenti con LTO+PGO: ${regressed_text}\n")
+endif()
+message("${report}Eseguibili ottimizzati in ${opt_dir}")
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# bench_gso.sh
+#
+# Confronta il costo per richiesta con lotti di richieste verso lo stesso
+# client: server con ricezione/invio singoli, pipeline con recvmmsg/
+# sendmmsg (-P 1) e offload di segmentazione UDP (-G). Il client invia
+# ogni lotto con UDP_SEGMENT e riceve con UDP_GRO. Uso:
+#   SERVER=./server CLIENT=./client scripts/bench_gso.sh [lotti] [richieste_per_lotto]
+#
+
+SERVER=${SERVER:-./server}
+CLIENT=${CLIENT:-./client}
+N=${1:-5000}
+BURST=${2:-32}
+PORT=56792
+
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+
+for mode in "" "-P 1" "-G"; do
+	"$SERVER" -p "$PORT" $mode > /dev/null &
+	SERVER_PID=$!
+	sleep 0.5
+	echo "server ${mode:-(singolo)}:"
+	"$CLIENT" -s "udp://127.0.0.1:$PORT" -r "t bari" --bench "$N" --burst "$BURST" || exit 1
+	kill $SERVER_PID
+	wait $SERVER_PID 2>/dev/null
+done
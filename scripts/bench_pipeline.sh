@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# bench_pipeline.sh
+#
+# Confronta il loop run-to-completion con il server a pipeline (-P) sotto
+# il carico di più client concorrenti: per ogni modalità riporta la
+# latenza media per client e il throughput complessivo. Uso:
+#   SERVER=./server CLIENT=./client scripts/bench_pipeline.sh [client] [richieste] [corsie]
+#
+
+SERVER=${SERVER:-./server}
+CLIENT=${CLIENT:-./client}
+CLIENTS=${1:-4}
+N=${2:-20000}
+LANES=${3:-$(nproc 2>/dev/null || echo 2)}
+PORT=56791
+
+run_mode() {
+	label=$1
+	shift
+	"$SERVER" -p "$PORT" "$@" > /dev/null &
+	pid=$!
+	sleep 0.5
+	start=$(date +%s.%N)
+	i=0
+	clients=""
+	while [ $i -lt "$CLIENTS" ]; do
+		"$CLIENT" -p "$PORT" -r "t bari" --bench "$N" > "/tmp/bench_pipeline.$i" &
+		clients="$clients $!"
+		i=$((i + 1))
+	done
+	for c in $clients; do
+		wait "$c"
+	done
+	end=$(date +%s.%N)
+	kill $pid 2>/dev/null
+	wait $pid 2>/dev/null
+	cat /tmp/bench_pipeline.* | awk -v label="$label" -v t0="$start" -v t1="$end" -v total=$((CLIENTS * N)) '
+		{ for (i = 1; i <= NF; i++) if ($i == "media") { sum += $(i + 1); n++ } }
+		END { printf "%-22s latenza media %.1f us, throughput %.0f richieste/s\n", label, sum / n, total / (t1 - t0) }'
+	rm -f /tmp/bench_pipeline.*
+}
+
+run_mode "run-to-completion"
+run_mode "pipeline ($LANES corsie)" -P "$LANES"
@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# bench_transports.sh
+#
+# Confronta la latenza di andata e ritorno dei tre trasporti (UDP su
+# loopback, socket Unix datagram, memoria condivisa) verso lo stesso
+# server. Uso:
+#   SERVER=./server CLIENT=./client scripts/bench_transports.sh [richieste]
+#
+
+SERVER=${SERVER:-./server}
+CLIENT=${CLIENT:-./client}
+N=${1:-20000}
+PORT=56790
+SOCK=/tmp/weather-bench.sock
+SHM=weather-bench
+
+"$SERVER" -p "$PORT" -u "$SOCK" -S "$SHM" > /dev/null &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+sleep 0.5
+
+for uri in "udp://127.0.0.1:$PORT" "unix://$SOCK" "shm://$SHM"; do
+	"$CLIENT" -s "$uri" -r "t bari" --bench "$N" || exit 1
+done
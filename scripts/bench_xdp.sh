@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# bench_xdp.sh
+#
+# Prova il percorso AF_XDP senza schede di rete dedicate: crea una coppia
+# veth con un capo in un namespace di rete separato, avvia il server con
+# -X sul capo locale e misura la latenza dal namespace, prima con AF_XDP
+# e poi con il solo socket UDP. Richiede i privilegi di root. Uso:
+#   SERVER=./server CLIENT=./client scripts/bench_xdp.sh [richieste]
+#
+
+SERVER=${SERVER:-./server}
+CLIENT=${CLIENT:-./client}
+N=${1:-20000}
+PORT=56791
+NS=weather-xdp
+HOST_IP=10.201.0.1
+PEER_IP=10.201.0.2
+
+cleanup() {
+	kill $SERVER_PID 2>/dev/null
+	ip link del wxdp0 2>/dev/null
+	ip netns del "$NS" 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+ip netns add "$NS" || exit 1
+ip link add wxdp0 type veth peer name wxdp1 || exit 1
+ip link set wxdp1 netns "$NS"
+ip addr add "$HOST_IP/24" dev wxdp0
+ip link set wxdp0 up
+ip netns exec "$NS" ip addr add "$PEER_IP/24" dev wxdp1
+ip netns exec "$NS" ip link set wxdp1 up
+sleep 1
+
+for mode in xdp udp; do
+	if [ "$mode" = xdp ]; then
+		"$SERVER" -s "$HOST_IP" -p "$PORT" -X wxdp0 > /dev/null &
+	else
+		"$SERVER" -s "$HOST_IP" -p "$PORT" > /dev/null &
+	fi
+	SERVER_PID=$!
+	sleep 0.5
+	printf '%s: ' "$mode"
+	ip netns exec "$NS" "$CLIENT" -s "$HOST_IP" -p "$PORT" -r "t bari" --bench "$N" || exit 1
+	kill $SERVER_PID
+	wait $SERVER_PID 2>/dev/null
+done
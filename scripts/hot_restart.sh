@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# hot_restart.sh
+#
+# Riavvio a caldo sotto carico: alcuni client inviano richieste senza
+# sosta mentre il server viene sostituito più volte da una nuova
+# generazione (-T) che riceve i socket da quella in servizio (-R). Ogni
+# client attende ogni risposta: una sola richiesta persa lo blocca fino
+# al timeout e lo script fallisce. Uso:
+#   SERVER=./server CLIENT=./client scripts/hot_restart.sh [client] [richieste] [riavvii] [opzioni server]
+#
+
+SERVER=${SERVER:-./server}
+CLIENT=${CLIENT:-./client}
+CLIENTS=${1:-4}
+N=${2:-200000}
+RESTARTS=${3:-3}
+OPTS=${4:-"-P 2"}
+PORT=56793
+CTL=/tmp/weather-restart.ctl
+
+"$SERVER" -p "$PORT" -R "$CTL" $OPTS > /dev/null &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+sleep 0.5
+
+PIDS=""
+for i in $(seq "$CLIENTS"); do
+	timeout 60 "$CLIENT" -p "$PORT" -r "t bari" --bench "$N" > /dev/null &
+	PIDS="$PIDS $!"
+done
+
+for i in $(seq "$RESTARTS"); do
+	sleep 1
+	OLD_PID=$SERVER_PID
+	"$SERVER" -p "$PORT" -R "$CTL" -T "$CTL" $OPTS > /dev/null &
+	SERVER_PID=$!
+	wait $OLD_PID
+	echo "riavvio $i: generazione $OLD_PID sostituita da $SERVER_PID"
+done
+
+FAILED=0
+for pid in $PIDS; do
+	wait $pid || FAILED=$((FAILED + 1))
+done
+if [ "$FAILED" -ne 0 ]; then
+	echo "$FAILED client su $CLIENTS hanno perso risposte"
+	exit 1
+fi
+echo "$CLIENTS client x $N richieste completate senza perdite durante $RESTARTS riavvii"
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# pgo_train.sh
+#
+# Traffico realistico per l'addestramento PGO (e per misurare le build a
+# parità di carico): richieste meteo distribuite su tutte le città e
+# misure, con maiuscole, spazi finali e una quota di richieste non valide
+# (città sconosciute, caratteri vietati, tipi errati), più alcune query
+# di storico. Lo stesso carico passa per il loop singolo, la pipeline
+# (-P) e l'offload GSO (-G). Il server viene fermato con SIGTERM perché
+# una build strumentata scriva i profili all'uscita. Uso:
+#   SERVER=./server CLIENT=./client scripts/pgo_train.sh [richieste_per_client]
+#
+
+SERVER=${SERVER:-./server}
+CLIENT=${CLIENT:-./client}
+N=${1:-20000}
+PORT=56794
+
+# Richieste e peso relativo (numero di client che le ripetono)
+MIX="t bari:4
+h milano:3
+w roma:3
+p napoli:2
+t Torino:2
+h palermo:2
+t GENOVA:1
+w bologna  :1
+p firenze:1
+t venezia:1
+t parigi:1
+h b@ri:1
+x roma:1"
+
+SERVER_PID=
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+
+total=0
+elapsed=0
+run_mode() {
+	label=$1
+	burst=$2
+	shift 2
+	"$SERVER" -p "$PORT" "$@" > /dev/null &
+	SERVER_PID=$!
+	sleep 0.5
+	start=$(date +%s.%N)
+	pids=""
+	echo "$MIX" | {
+		while IFS=: read -r req weight; do
+			i=0
+			while [ $i -lt "$weight" ]; do
+				"$CLIENT" -p "$PORT" -r "$req" --bench "$N" --burst "$burst" > /dev/null &
+				pids="$pids $!"
+				i=$((i + 1))
+			done
+		done
+		status=0
+		for p in $pids; do
+			wait "$p" || status=1
+		done
+		exit $status
+	} || { echo "pgo_train: client fallito ($label)" >&2; exit 1; }
+	for req in "t bari" "h milano" "p napoli"; do
+		"$CLIENT" -p "$PORT" -r "$req" -H 60 > /dev/null
+		"$CLIENT" -p "$PORT" -r "$req" -H 60 -a > /dev/null
+	done
+	end=$(date +%s.%N)
+	kill -TERM "$SERVER_PID"
+	wait "$SERVER_PID" 2>/dev/null
+	SERVER_PID=
+	clients=$(echo "$MIX" | awk -F: '{ s += $2 } END { print s }')
+	count=$((clients * N * burst))
+	secs=$(awk "BEGIN { print $end - $start }")
+	awk "BEGIN { printf \"%-12s %8d richieste in %6.2f s (%.0f richieste/s)\\n\", \"$label\", $count, $secs, $count / $secs }"
+	total=$((total + count))
+	elapsed=$(awk "BEGIN { print $elapsed + $secs }")
+}
+
+run_mode "singolo" 1
+run_mode "pipeline" 4 -P 2
+run_mode "gso" 4 -G
+awk "BEGIN { printf \"Totale: %d richieste in %.2f s (%.0f richieste/s)\\n\", $total, $elapsed, $total / $elapsed }"
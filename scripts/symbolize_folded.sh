@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# symbolize_folded.sh
+#
+# Risolve i frame "server+0x..." di un profilo folded scritto con -O (le
+# funzioni static non compaiono nella tabella dei simboli esportati) nei
+# nomi di funzione, con addr2line sull'eseguibile che ha prodotto il
+# profilo; gli altri frame restano invariati. Uso:
+#   SERVER=./server scripts/symbolize_folded.sh profilo.folded > risolto.folded
+#
+
+SERVER=${SERVER:-./server}
+IN=${1:?"Uso: SERVER=./server $0 profilo.folded"}
+NAME=$(basename "$SERVER")
+
+# Una sola invocazione di addr2line per tutti gli offset distinti
+MAP=$(mktemp)
+trap 'rm -f "$MAP"' EXIT
+grep -o "$NAME+0x[0-9a-f]*" "$IN" | sort -u | sed "s/^$NAME+//" > "$MAP.in"
+addr2line -f -e "$SERVER" $(cat "$MAP.in") | awk 'NR % 2 == 1' | paste -d' ' "$MAP.in" - > "$MAP"
+rm -f "$MAP.in"
+
+awk -v name="$NAME" '
+	NR == FNR { sym[name "+" $1] = ($2 == "??" ? name "+" $1 : $2); next }
+	{
+		n = split($0, f, ";")
+		line = ""
+		for (i = 1; i <= n; i++) {
+			fr = f[i]
+			if (i == n) {
+				# ultimo frame seguito dal conteggio
+				split(fr, last, " ")
+				fr = last[1]
+			}
+			if (fr in sym) {
+				fr = sym[fr]
+			}
+			line = line (i > 1 ? ";" : "") fr
+		}
+		print line " " last[2]
+	}' "$MAP" "$IN"
@@ -0,0 +1,75 @@
+/*
+ * bench_history.c
+ *
+ * Benchmark delle aggregazioni sullo storico: confronta la riduzione
+ * min/max/somma SIMD con quella scalare sul ring contiguo e misura il
+ * costo di history_aggregate/history_range su un buffer pieno.
+ *
+ * Compilazione (dalla radice del repository):
+ *   cmake --build build --target bench_history
+ */
+
+#include "../src/history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITERATIONS 2000000
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Impedisce al compilatore di eliminare i risultati calcolati
+static volatile float sink;
+
+int main(void) {
+	float samples[HISTORY_LEN];
+	srand(1);
+	for (int i = 0; i < HISTORY_LEN; ++i) {
+		samples[i] = ((float)(rand() % 501) / 10.0f) - 10.0f;
+		history_record(0, 't', samples[i], (uint32_t)(1000 + i));
+	}
+
+	float mn, mx, sum, mn2, mx2, sum2;
+	history_reduce_scalar(samples, HISTORY_LEN, &mn, &mx, &sum);
+	history_reduce(samples, HISTORY_LEN, &mn2, &mx2, &sum2);
+	if (mn != mn2 || mx != mx2 || (sum - sum2) > 0.01f || (sum2 - sum) > 0.01f) {
+		printf("Risultati divergenti: scalare %.1f/%.1f/%.1f, simd %.1f/%.1f/%.1f\n",
+				mn, mx, sum, mn2, mx2, sum2);
+		return 1;
+	}
+
+	double t0 = now_ns();
+	for (int i = 0; i < ITERATIONS; ++i) {
+		history_reduce_scalar(samples, HISTORY_LEN, &mn, &mx, &sum);
+		sink = sum;
+	}
+	double t1 = now_ns();
+	for (int i = 0; i < ITERATIONS; ++i) {
+		history_reduce(samples, HISTORY_LEN, &mn, &mx, &sum);
+		sink = sum;
+	}
+	double t2 = now_ns();
+	history_aggr_t ag;
+	for (int i = 0; i < ITERATIONS; ++i) {
+		history_aggregate(0, 't', 0, 0, &ag);
+		sink = ag.avg;
+	}
+	double t3 = now_ns();
+	uint32_t ts[HISTORY_LEN];
+	for (int i = 0; i < ITERATIONS; ++i) {
+		history_range(0, 't', 1010, 1050, ts, samples, HISTORY_LEN);
+		sink = samples[0];
+	}
+	double t4 = now_ns();
+
+	printf("reduce scalare   (%d campioni): %6.1f ns/op\n", HISTORY_LEN, (t1 - t0) / ITERATIONS);
+	printf("reduce simd      (%d campioni): %6.1f ns/op\n", HISTORY_LEN, (t2 - t1) / ITERATIONS);
+	printf("history_aggregate (ring pieno): %6.1f ns/op\n", (t3 - t2) / ITERATIONS);
+	printf("history_range    (41 campioni): %6.1f ns/op\n", (t4 - t3) / ITERATIONS);
+	return 0;
+}
@@ -0,0 +1,549 @@
+/*
+ * bench_server.c
+ *
+ * Microbenchmark del percorso di richiesta del server, senza rete: ogni
+ * stadio (typecheck, citycheck, generatori, extractcity, validazione,
+ * build_weather_response, serializzazione) e la pipeline completa in
+ * memoria (datagram da 65 byte -> risposta da 9 byte) su input realistici
+ * e avversari, le richieste compatte in virgola fissa (casi compact) e la
+ * verifica dei datagram autenticati (casi auth). Per ogni
+ * caso stampa una riga JSON con ns/op, cicli/op e allocazioni/op,
+ * leggibile da script.
+ *
+ * Con --baseline file confronta i ns/op con un'esecuzione precedente
+ * (salvata con --out o ridirigendo l'output) e termina con codice 1 se un
+ * caso peggiora oltre la tolleranza (--tolerance, in percentuale).
+ *
+ * Compilazione (dalla radice del repository):
+ *   cmake --build build --target bench_server
+ * Uso:
+ *   build/bench_server [--filter prefisso] [--min-ms ms] [--out file]
+ *                      [--baseline file] [--tolerance pct]
+ */
+
+#include "../src/auth.h"
+#include "../src/protocol.h"
+#include "../src/siphash.h"
+#include "../src/units.h"
+#include "../src/validate.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define REPEATS     5   // ripetizioni per caso: si riporta la mediana
+#define MAX_RESULTS 128
+
+/*
+ * Conteggio delle allocazioni: con glibc le funzioni di allocazione del
+ * programma sostituiscono quelle della libreria e inoltrano a __libc_*.
+ * Con i sanitizer (che intercettano a loro volta l'allocatore) la
+ * sostituzione scavalcherebbe i loro controlli: si rinuncia al conteggio
+ * e allocs_per_op vale -1.
+ */
+static unsigned long long alloc_count = 0;
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define BENCH_SANITIZED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define BENCH_SANITIZED 1
+#endif
+
+#if defined(__GLIBC__) && !defined(BENCH_SANITIZED)
+#define ALLOC_TRACKED 1
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t n) {
+	alloc_count++;
+	return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) {
+	alloc_count++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n) {
+	alloc_count++;
+	return __libc_realloc(p, n);
+}
+#else
+#define ALLOC_TRACKED 0
+#endif
+
+/*
+ * Cicli: contatore hardware via perf_event_open se consentito, altrimenti
+ * il TSC (cicli di riferimento) su x86, altrimenti non disponibili.
+ */
+static int perf_fd = -1;
+static const char *cycles_source = "none";
+
+static void cycles_init(void) {
+#if defined(__linux__)
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	perf_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+		cycles_source = "perf";
+		return;
+	}
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	cycles_source = "tsc";
+#endif
+}
+
+static uint64_t cycles_now(void) {
+#if defined(__linux__)
+	if (perf_fd >= 0) {
+		uint64_t v = 0;
+		if (read(perf_fd, &v, sizeof(v)) == (ssize_t)sizeof(v)) {
+			return v;
+		}
+	}
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Impedisce al compilatore di eliminare i risultati calcolati
+static volatile unsigned sink;
+
+/*
+ * Classi di input: datagram grezzi da REQUEST_SIZE byte
+ */
+typedef struct {
+	const char *name;
+	char type;
+	const char *city;
+} input_class_t;
+
+static const input_class_t classes[] = {
+	{ "realistic", 't', "Roma" },
+	{ "mixed_case", 'H', "rEgGiO cAlAbRiA" },
+	{ "unknown", 'w', "Atlantide" },
+	{ "forbidden", 'p', "Mil@no" },
+	{ "long", 't', "Llanfairpwllgwyngyllgogerychwyrndrobwllllantysiliogogogochxyzw" },
+	{ "trailing_ws", 't', "Bari  \r\n" },
+	{ "bad_type", 'x', "Roma" },
+};
+#define NCLASSES ((int)(sizeof(classes) / sizeof(classes[0])))
+
+static unsigned char raw[NCLASSES][REQUEST_SIZE];
+static char extracted[NCLASSES][65];
+static char lowered_type[NCLASSES];
+
+static void prepare_inputs(void) {
+	for (int c = 0; c < NCLASSES; ++c) {
+		memset(raw[c], 0, REQUEST_SIZE);
+		raw[c][0] = (unsigned char)classes[c].type;
+		size_t n = strlen(classes[c].city);
+		memcpy(&raw[c][1], classes[c].city, n < 64 ? n : 64);
+		extractcity(raw[c], REQUEST_SIZE, extracted[c]);
+		char t = (char)(classes[c].type | 0x20);
+		lowered_type[c] = (t == 't' || t == 'h' || t == 'w' || t == 'p') ? t : '\0';
+	}
+}
+
+/*
+ * Casi di benchmark: fn esegue iters operazioni sull'input arg
+ */
+typedef void (*bench_fn)(int arg, long iters);
+
+static void b_typecheck(int arg, long iters) {
+	static const char types[] = "thwp";
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		acc += (unsigned)typecheck(types[arg]);
+	}
+	sink = acc;
+}
+
+static void b_citycheck(int arg, long iters) {
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		acc += (unsigned)citycheck(extracted[arg]);
+	}
+	sink = acc;
+}
+
+static void b_generator(int arg, long iters) {
+	float (*gens[])(void) = { get_temperature, get_humidity, get_wind, get_pressure };
+	float acc = 0.0f;
+	for (long i = 0; i < iters; ++i) {
+		acc += gens[arg]();
+	}
+	sink = (unsigned)acc;
+}
+
+static void b_extractcity(int arg, long iters) {
+	char city[65];
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		extractcity(raw[arg], REQUEST_SIZE, city);
+		acc += (unsigned char)city[0];
+	}
+	sink = acc;
+}
+
+static void b_validate(int arg, long iters) {
+	const unsigned char *req = raw[arg];
+	int len = REQUEST_SIZE;
+	validated_req_t v;
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		int idx;
+		validate_batch(&req, &len, 1, &v);
+		acc += validated_status(&v, &idx);
+	}
+	sink = acc;
+}
+
+static void b_build_response(int arg, long iters) {
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		weather_response_t r = build_weather_response(lowered_type[arg], extracted[arg]);
+		acc += r.status;
+	}
+	sink = acc;
+}
+
+static void b_serialize(int arg, long iters) {
+	weather_response_t r = { STATUS_SUCCESS, 't', 21.5f };
+	unsigned char resp[RESPONSE_SIZE];
+	unsigned acc = 0;
+	(void)arg;
+	for (long i = 0; i < iters; ++i) {
+		r.value += 0.25f;
+		acc += (unsigned)serialize_weather_response(&r, resp) + resp[8];
+	}
+	sink = acc;
+}
+
+static void b_pipeline(int arg, long iters) {
+	unsigned char resp[BUFFER_SIZE];
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		acc += (unsigned)process_request(raw[arg], REQUEST_SIZE, resp, sizeof(resp)) + resp[3];
+	}
+	sink = acc;
+}
+
+/*
+ * Richieste compatte: compact/convert misura la sola lettura dalle tabelle
+ * con arrotondamento, compact/1 e compact/4 la pipeline con una misura
+ * (°F) e con tutte e quattro in unità non base, da confrontare con
+ * pipeline/realistic (una misura per datagram da 9 byte).
+ */
+static void b_compact_convert(int arg, long iters) {
+	static const unsigned char fmts[] = {
+		COMPACT_FMT(UNIT_FAHRENHEIT, 1), COMPACT_FMT(UNIT_MS, 2),
+		COMPACT_FMT(UNIT_INHG, 3), COMPACT_FMT(UNIT_HPA, 0),
+	};
+	unsigned acc = 0;
+	(void)arg;
+	for (long i = 0; i < iters; ++i) {
+		acc += (unsigned)units_convert((int)(i & 511), fmts[i & 3]);
+	}
+	sink = acc;
+}
+
+static void b_compact(int arg, long iters) {
+	static const unsigned char items[] = {
+		't', COMPACT_FMT(UNIT_FAHRENHEIT, 1), 'h', COMPACT_FMT(UNIT_DEFAULT, 1),
+		'w', COMPACT_FMT(UNIT_MS, 2), 'p', COMPACT_FMT(UNIT_INHG, 2),
+	};
+	unsigned char req[COMPACT_REQUEST_SIZE(4)];
+	unsigned char resp[BUFFER_SIZE];
+	memset(req, 0, sizeof(req));
+	req[0] = REQ_COMPACT;
+	memcpy(&req[1], "Roma", 4);
+	req[65] = (unsigned char)arg;
+	memcpy(&req[66], items, (size_t)(2 * arg));
+	unsigned acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		acc += (unsigned)process_request(req, COMPACT_REQUEST_SIZE(arg), resp, sizeof(resp)) + resp[5];
+	}
+	sink = acc;
+}
+
+/*
+ * Autenticazione: richiesta realistica con trailer firmato come dal client.
+ * auth/replay ripete un datagram già accettato, quindi attraversa tutta
+ * la verifica (MAC e finestra) come uno valido; auth/valid firma ogni
+ * volta un contatore nuovo e include quindi anche il costo del client
+ * (auth/sign).
+ */
+#define AUTH_BENCH_KEY 7
+
+static const unsigned char auth_key[SIPHASH_KEY_SIZE] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+static uint64_t auth_counter = 0;
+
+static void put32be(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static void put64be(unsigned char *p, uint64_t v) {
+	put32be(p, (uint32_t)(v >> 32));
+	put32be(p + 4, (uint32_t)v);
+}
+
+// Scrive il trailer dopo i REQUEST_SIZE byte di buf
+static void auth_sign(unsigned char *buf, uint32_t id, uint32_t ts, uint64_t ctr) {
+	unsigned char *t = buf + REQUEST_SIZE;
+	put32be(t, id);
+	put32be(t + 4, ts);
+	put64be(t + 8, ctr);
+	put64be(t + AUTH_MAC_OFFSET, siphash24(auth_key, buf, REQUEST_SIZE + AUTH_MAC_OFFSET));
+}
+
+// arg: 0 firmato, 1 MAC errato, 2 key id sconosciuto, 3 istante scaduto
+static void auth_prepare(unsigned char *buf, int arg) {
+	memcpy(buf, raw[0], REQUEST_SIZE);
+	uint32_t now = (uint32_t)time(NULL);
+	auth_sign(buf, arg == 2 ? AUTH_BENCH_KEY + 1 : AUTH_BENCH_KEY,
+			arg == 3 ? now - 2 * AUTH_MAX_SKEW : now, ++auth_counter);
+	if (arg == 1) {
+		buf[REQUEST_SIZE + AUTH_TRAILER_SIZE - 1] ^= 1;
+	}
+}
+
+static void b_auth_reject(int arg, long iters) {
+	unsigned char buf[REQUEST_SIZE + AUTH_TRAILER_SIZE];
+	auth_prepare(buf, arg);
+	if (arg == 0) {
+		auth_verify(buf, (int)sizeof(buf)); // da qui in poi è un replay
+	}
+	int acc = 0;
+	for (long i = 0; i < iters; ++i) {
+		acc += auth_verify(buf, (int)sizeof(buf));
+	}
+	sink = (unsigned)acc;
+}
+
+static void b_auth_valid(int arg, long iters) {
+	unsigned char buf[REQUEST_SIZE + AUTH_TRAILER_SIZE];
+	auth_prepare(buf, 0);
+	uint32_t now = (uint32_t)time(NULL);
+	int acc = 0;
+	(void)arg;
+	for (long i = 0; i < iters; ++i) {
+		auth_sign(buf, AUTH_BENCH_KEY, now, ++auth_counter);
+		acc += auth_verify(buf, (int)sizeof(buf));
+	}
+	sink = (unsigned)acc;
+}
+
+static void b_auth_sign(int arg, long iters) {
+	unsigned char buf[REQUEST_SIZE + AUTH_TRAILER_SIZE];
+	auth_prepare(buf, 0);
+	uint32_t now = (uint32_t)time(NULL);
+	(void)arg;
+	for (long i = 0; i < iters; ++i) {
+		auth_sign(buf, AUTH_BENCH_KEY, now, ++auth_counter);
+	}
+	sink = buf[REQUEST_SIZE + AUTH_TRAILER_SIZE - 1];
+}
+
+typedef struct {
+	char name[64];
+	double ns;
+	double cycles;
+	double allocs;
+	long iters;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int nresults = 0;
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void run_case(const char *name, bench_fn fn, int arg, double min_ms, const char *filter) {
+	if (filter && strncmp(name, filter, strlen(filter)) != 0) {
+		return;
+	}
+	// Calibrazione: iterazioni sufficienti a durare almeno min_ms
+	long iters = 1000;
+	for (;;) {
+		double t0 = now_ns();
+		fn(arg, iters);
+		double el = now_ns() - t0;
+		if (el >= min_ms * 1e6 || iters > (1L << 40)) {
+			break;
+		}
+		iters = el > 0 ? (long)((double)iters * (min_ms * 1e6 / el) * 1.1) + 1 : iters * 10;
+	}
+
+	double ns[REPEATS], cyc[REPEATS];
+	unsigned long long allocs = 0;
+	for (int r = 0; r < REPEATS; ++r) {
+		unsigned long long a0 = alloc_count;
+		uint64_t c0 = cycles_now();
+		double t0 = now_ns();
+		fn(arg, iters);
+		double t1 = now_ns();
+		uint64_t c1 = cycles_now();
+		allocs += alloc_count - a0;
+		ns[r] = (t1 - t0) / (double)iters;
+		cyc[r] = (double)(c1 - c0) / (double)iters;
+	}
+	qsort(ns, REPEATS, sizeof(double), cmp_double);
+	qsort(cyc, REPEATS, sizeof(double), cmp_double);
+
+	result_t *res = &results[nresults++];
+	snprintf(res->name, sizeof(res->name), "%s", name);
+	res->ns = ns[REPEATS / 2];
+	res->cycles = perf_fd >= 0 || strcmp(cycles_source, "tsc") == 0 ? cyc[REPEATS / 2] : -1.0;
+	res->allocs = ALLOC_TRACKED ? (double)allocs / ((double)iters * REPEATS) : -1.0;
+	res->iters = iters;
+}
+
+// Legge i ns/op del caso name da un output precedente; -1 se assente
+static double baseline_ns(const char *path, const char *name) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		return -1.0;
+	}
+	char line[512], key[80];
+	double found = -1.0;
+	snprintf(key, sizeof(key), "\"bench\":\"%.63s\"", name);
+	while (fgets(line, sizeof(line), f)) {
+		char *p = strstr(line, key);
+		char *q = strstr(line, "\"ns_per_op\":");
+		if (p && q) {
+			found = atof(q + strlen("\"ns_per_op\":"));
+			break;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+int main(int argc, char *argv[]) {
+	const char *filter = NULL, *out_path = NULL, *baseline = NULL;
+	double min_ms = 50.0, tolerance = 10.0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+			min_ms = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		} else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline = argv[++i];
+		} else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "Opzione non riconosciuta: %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	srand(1);
+	cycles_init();
+	prepare_inputs();
+	char name[64];
+	static const char *gen_names[] = { "temperature", "humidity", "wind", "pressure" };
+
+	for (int t = 0; t < 4; ++t) {
+		snprintf(name, sizeof(name), "typecheck/%c", "thwp"[t]);
+		run_case(name, b_typecheck, t, min_ms, filter);
+	}
+	for (int g = 0; g < 4; ++g) {
+		snprintf(name, sizeof(name), "generator/%s", gen_names[g]);
+		run_case(name, b_generator, g, min_ms, filter);
+	}
+	run_case("serialize/response", b_serialize, 0, min_ms, filter);
+	for (int c = 0; c < NCLASSES; ++c) {
+		snprintf(name, sizeof(name), "extractcity/%s", classes[c].name);
+		run_case(name, b_extractcity, c, min_ms, filter);
+		snprintf(name, sizeof(name), "citycheck/%s", classes[c].name);
+		run_case(name, b_citycheck, c, min_ms, filter);
+		snprintf(name, sizeof(name), "validate/%s", classes[c].name);
+		run_case(name, b_validate, c, min_ms, filter);
+		snprintf(name, sizeof(name), "build_weather_response/%s", classes[c].name);
+		run_case(name, b_build_response, c, min_ms, filter);
+		snprintf(name, sizeof(name), "pipeline/%s", classes[c].name);
+		run_case(name, b_pipeline, c, min_ms, filter);
+	}
+
+	run_case("compact/convert", b_compact_convert, 0, min_ms, filter);
+	run_case("compact/1", b_compact, 1, min_ms, filter);
+	run_case("compact/4", b_compact, 4, min_ms, filter);
+
+	auth_add_key(AUTH_BENCH_KEY, auth_key);
+	run_case("auth/sign", b_auth_sign, 0, min_ms, filter);
+	run_case("auth/valid", b_auth_valid, 0, min_ms, filter);
+	run_case("auth/replay", b_auth_reject, 0, min_ms, filter);
+	run_case("auth/bad_mac", b_auth_reject, 1, min_ms, filter);
+	run_case("auth/unknown_key", b_auth_reject, 2, min_ms, filter);
+	run_case("auth/stale", b_auth_reject, 3, min_ms, filter);
+
+	FILE *out = out_path ? fopen(out_path, "w") : NULL;
+	int regressions = 0;
+	for (int i = 0; i < nresults; ++i) {
+		const result_t *r = &results[i];
+		char line[512];
+		snprintf(line, sizeof(line),
+				"{\"bench\":\"%.63s\",\"ns_per_op\":%.3f,\"cycles_per_op\":%.1f,\"cycles_source\":\"%s\","
+				"\"allocs_per_op\":%.3f,\"iterations\":%ld,\"validate_impl\":\"%s\"}",
+				r->name, r->ns, r->cycles, cycles_source, r->allocs, r->iters, validate_impl());
+		printf("%s\n", line);
+		if (out) {
+			fprintf(out, "%s\n", line);
+		}
+		if (baseline) {
+			double base = baseline_ns(baseline, r->name);
+			if (base > 0 && r->ns > base * (1.0 + tolerance / 100.0)) {
+				fprintf(stderr, "Regressione %s: %.3f ns/op contro %.3f (+%.1f%%)\n",
+						r->name, r->ns, base, (r->ns / base - 1.0) * 100.0);
+				regressions++;
+			}
+		}
+	}
+	if (out) {
+		fclose(out);
+	}
+	return regressions > 0 ? 1 : 0;
+}
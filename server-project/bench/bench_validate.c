@@ -0,0 +1,159 @@
+/*
+ * bench_validate.c
+ *
+ * Benchmark della validazione delle richieste: prima confronta ogni
+ * implementazione (scalare, SSE2, AVX2) con il percorso originale
+ * extractcity + build_weather_response su input casuali e avversari
+ * (NUL interni, spazi finali, caratteri vietati, maiuscole, byte alti,
+ * datagram corti), poi misura il costo per richiesta.
+ *
+ * Compilazione (dalla radice del repository):
+ *   cmake --build build --target bench_validate
+ */
+
+#include "../src/protocol.h"
+#include "../src/validate.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CASES 200000
+#define POOL 4096
+#define ITERATIONS 20000000
+#define BUF 128
+
+typedef void (*impl_fn)(const unsigned char *, int, validated_req_t *);
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Impedisce al compilatore di eliminare i risultati calcolati
+static volatile unsigned sink;
+
+static const char *cities[CITY_COUNT] = CITY_NAMES;
+
+// Byte scelti per colpire i casi limite del kernel
+static unsigned char random_byte(void) {
+	static const char edge[] = " \r\n\t@$%#AZaz[`@{\0";
+	switch (rand() % 4) {
+		case 0: return (unsigned char)edge[rand() % (int)sizeof(edge)];
+		case 1: return (unsigned char)(rand() % 256);
+		default: return (unsigned char)('a' + rand() % 26);
+	}
+}
+
+// Genera un datagram in buf[BUF] e ne restituisce la lunghezza
+static int random_request(unsigned char *buf) {
+	static const char types[] = "tThHwWpPxX\0";
+	for (int i = 0; i < BUF; ++i) {
+		buf[i] = random_byte();
+	}
+	buf[0] = (unsigned char)types[rand() % (int)sizeof(types)];
+	int kind = rand() % 4;
+	if (kind <= 1) {
+		// Città nota con maiuscole casuali, spazi finali e talvolta un
+		// carattere vietato o un NUL interno
+		const char *c = cities[rand() % CITY_COUNT];
+		int n = (int)strlen(c);
+		for (int i = 0; i < n; ++i) {
+			buf[1 + i] = (unsigned char)((rand() % 2) ? toupper((unsigned char)c[i]) : c[i]);
+		}
+		int pad = rand() % 4;
+		for (int i = 0; i < pad; ++i) {
+			buf[1 + n + i] = (unsigned char)" \r\n\t"[rand() % 4];
+		}
+		buf[1 + n + pad] = '\0';
+		if (kind == 1) {
+			buf[1 + rand() % (n + pad + 1)] = (unsigned char)"@$%#\0"[rand() % 5];
+		}
+		return (rand() % 3) ? REQUEST_SIZE : 1 + n + pad + (rand() % 2);
+	}
+	// Lunghezze arbitrarie, anche oltre REQUEST_SIZE e sotto 2 byte
+	return rand() % (BUF - 1);
+}
+
+static int check(const char *name, impl_fn fn, const unsigned char *buf, int len) {
+	char city[65];
+	extractcity(buf, len, city);
+	char type = len > 0 ? (char)tolower(buf[0]) : '\0';
+	if (!(type == 't' || type == 'h' || type == 'w' || type == 'p')) {
+		type = '\0';
+	}
+	weather_response_t r = build_weather_response(type, city);
+
+	char key[65];
+	size_t klen = strlen(city);
+	for (size_t i = 0; i <= klen; ++i) {
+		key[i] = (char)tolower((unsigned char)city[i]);
+	}
+
+	validated_req_t v;
+	fn(buf, len, &v);
+	int idx;
+	unsigned status = validated_status(&v, &idx);
+	int expect_idx = r.status == STATUS_SUCCESS ? cityindex(city) : -1;
+	if (status != r.status || idx != expect_idx || v.type != type || v.len != klen
+			|| memcmp(v.key, key, klen + 1) != 0 || v.forbidden != (strpbrk(city, "@$%#") != NULL)) {
+		printf("%s: divergenza (len %d): atteso status %u len %zu, ottenuto status %u len %u\n",
+				name, len, r.status, klen, status, v.len);
+		return 1;
+	}
+	return 0;
+}
+
+static double time_impl(impl_fn fn, unsigned char (*pool)[BUF], const int *lens) {
+	validated_req_t v;
+	int idx;
+	unsigned acc = 0;
+	double t0 = now_ns();
+	for (int i = 0; i < ITERATIONS; ++i) {
+		int k = i & (POOL - 1);
+		fn(pool[k], lens[k], &v);
+		acc += validated_status(&v, &idx);
+	}
+	sink = acc;
+	return (now_ns() - t0) / ITERATIONS;
+}
+
+int main(void) {
+	struct { const char *name; impl_fn fn; } impls[] = {
+		{ "scalare", validate_scalar },
+		{ "sse2", validate_sse2 },
+		{ "avx2", validate_avx2 },
+	};
+	int nimpl = (int)(sizeof(impls) / sizeof(impls[0]));
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if (!__builtin_cpu_supports("avx2")) {
+		nimpl--; // CPU senza AVX2: la variante non è eseguibile
+	}
+#endif
+
+	srand(1);
+	unsigned char buf[BUF];
+	for (int c = 0; c < CASES; ++c) {
+		int len = random_request(buf);
+		for (int i = 0; i < nimpl; ++i) {
+			if (check(impls[i].name, impls[i].fn, buf, len)) {
+				return 1;
+			}
+		}
+	}
+	printf("Confronto differenziale: %d casi concordi per %d implementazioni\n", CASES, nimpl);
+
+	static unsigned char pool[POOL][BUF];
+	static int lens[POOL];
+	for (int k = 0; k < POOL; ++k) {
+		lens[k] = random_request(pool[k]);
+	}
+	printf("Implementazione scelta a runtime: %s\n", validate_impl());
+	for (int i = 0; i < nimpl; ++i) {
+		printf("%-8s %6.2f ns/richiesta\n", impls[i].name, time_impl(impls[i].fn, pool, lens));
+	}
+	return 0;
+}
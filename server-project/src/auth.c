@@ -0,0 +1,334 @@
+/*
+ * auth.c
+ *
+ * Verifica delle richieste autenticate: controlli economici prima (lunghezza,
+ * key id, istante), poi il MAC SipHash-2-4 e infine la finestra anti-replay
+ * della chiave, una bitmap scorrevole di AUTH_WINDOW contatori come in
+ * IPsec/WireGuard. Solo quest'ultima richiede un lock (uno per chiave, di
+ * pochi nanosecondi): i mittenti su chiavi diverse non si contendono nulla.
+ */
+
+#include "auth.h"
+
+int auth_enabled = 0;
+
+#if !defined(_WIN32)
+
+#include "protocol.h"
+#include "siphash.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define AUTH_WORDS (AUTH_WINDOW / 64)
+
+typedef struct {
+	unsigned char key[SIPHASH_KEY_SIZE];
+	int present;
+	uint32_t since;              // istanti fino a questo scartati
+	atomic_flag lock;
+	uint64_t top;                // contatore più alto accettato
+	uint64_t bitmap[AUTH_WORDS]; // contatori visti in (top - AUTH_WINDOW, top]
+} auth_key_t;
+
+static auth_key_t *keys = NULL;
+static uint32_t start_time; // secondo di auth_load
+static atomic_int held;     // verifiche sospese fino ad auth_resume
+
+// Conteggi per il riepilogo (solo gli scarti sono sul percorso di attacco)
+static atomic_ullong drop_format, drop_time, drop_mac, drop_replay;
+
+static uint32_t get32be(const unsigned char *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t get64be(const unsigned char *p) {
+	return (uint64_t)get32be(p) << 32 | get32be(p + 4);
+}
+
+static int hexval(int c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+static void free_keys(void) {
+	auth_enabled = 0;
+	free(keys);
+	keys = NULL;
+}
+
+int auth_add_key(unsigned id, const unsigned char key[SIPHASH_KEY_SIZE]) {
+	if (keys == NULL) {
+		keys = (auth_key_t *)calloc(AUTH_MAX_KEYS, sizeof(auth_key_t));
+		if (keys == NULL) {
+			return -1;
+		}
+	}
+	if (id >= AUTH_MAX_KEYS || keys[id].present) {
+		return -1;
+	}
+	memcpy(keys[id].key, key, SIPHASH_KEY_SIZE);
+	keys[id].present = 1;
+	keys[id].since = start_time;
+	atomic_flag_clear(&keys[id].lock);
+	auth_enabled = 1;
+	return 0;
+}
+
+int auth_load(const char *path) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		return -1;
+	}
+	start_time = (uint32_t)time(NULL);
+	char line[256];
+	int n = 0, lineno = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		const char *p = line;
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			p++;
+		}
+		if (*p == '\0' || *p == '#') {
+			continue; // commento o riga vuota
+		}
+		// Ogni altra riga deve avere esattamente key id e chiave
+		char hex[64], extra[2];
+		unsigned long id;
+		unsigned char key[SIPHASH_KEY_SIZE];
+		int ok = sscanf(p, "%lu %63s %1s", &id, hex, extra) == 2 && strlen(hex) == 2 * SIPHASH_KEY_SIZE;
+		for (int i = 0; ok && i < SIPHASH_KEY_SIZE; ++i) {
+			int hi = hexval(hex[2 * i]), lo = hexval(hex[2 * i + 1]);
+			ok = hi >= 0 && lo >= 0;
+			key[i] = (unsigned char)(hi << 4 | lo);
+		}
+		if (!ok || auth_add_key((unsigned)id, key) < 0) {
+			printf("Chiave non valida alla riga %d di %s\n", lineno, path);
+			fclose(f);
+			free_keys();
+			return -1;
+		}
+		n++;
+	}
+	fclose(f);
+	if (n == 0) {
+		free_keys();
+		return -1;
+	}
+	return n;
+}
+
+void auth_wait_start(void) {
+	while ((uint32_t)time(NULL) <= start_time) {
+		struct timespec ts = { 0, 10 * 1000 * 1000 };
+		nanosleep(&ts, NULL);
+	}
+}
+
+void auth_hold(void) {
+	atomic_store(&held, 1);
+}
+
+// Impronta della chiave: le finestre passano solo tra chiavi identiche
+static uint64_t key_print(const auth_key_t *k) {
+	return siphash24(k->key, NULL, 0);
+}
+
+static unsigned char *put_bytes(unsigned char *p, const void *v, size_t n) {
+	memcpy(p, v, n);
+	return p + n;
+}
+
+int auth_export(unsigned char *out) {
+	uint32_t magic = AUTH_STATE_MAGIC;
+	uint32_t count = 0;
+	unsigned char *p = out + 8;
+	for (uint32_t id = 0; keys != NULL && id < AUTH_MAX_KEYS; ++id) {
+		auth_key_t *k = &keys[id];
+		if (!k->present) {
+			continue;
+		}
+		uint64_t print = key_print(k);
+		p = put_bytes(p, &id, 4);
+		p = put_bytes(p, &print, 8);
+		while (atomic_flag_test_and_set_explicit(&k->lock, memory_order_acquire)) {
+		}
+		p = put_bytes(p, &k->since, 4);
+		p = put_bytes(p, &k->top, 8);
+		p = put_bytes(p, k->bitmap, sizeof(k->bitmap));
+		atomic_flag_clear_explicit(&k->lock, memory_order_release);
+		count++;
+	}
+	memcpy(out, &magic, 4);
+	memcpy(out + 4, &count, 4);
+	return (int)(p - out);
+}
+
+int auth_resume(const unsigned char *in, int len) {
+	const int rec = 4 + 8 + 4 + 8 + (int)sizeof(keys[0].bitmap);
+	uint32_t magic = 0, count = 0;
+	if (len >= 8) {
+		memcpy(&magic, in, 4);
+		memcpy(&count, in + 4, 4);
+	}
+	int imported = -1;
+	if (magic == AUTH_STATE_MAGIC && count <= AUTH_MAX_KEYS && len == 8 + (int)count * rec) {
+		imported = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			const unsigned char *r = in + 8 + i * rec;
+			uint32_t id;
+			uint64_t print;
+			memcpy(&id, r, 4);
+			memcpy(&print, r + 4, 8);
+			if (id >= AUTH_MAX_KEYS || !keys[id].present || key_print(&keys[id]) != print) {
+				continue; // chiave nuova o cambiata: vale il controllo sull'avvio
+			}
+			auth_key_t *k = &keys[id];
+			memcpy(&k->since, r + 12, 4);
+			memcpy(&k->top, r + 16, 8);
+			memcpy(k->bitmap, r + 24, sizeof(k->bitmap));
+			imported++;
+		}
+	} else {
+		// Senza finestre la generazione precedente può aver accettato
+		// qualunque istante fino a ora
+		start_time = (uint32_t)time(NULL);
+		for (int id = 0; id < AUTH_MAX_KEYS; ++id) {
+			keys[id].since = start_time;
+		}
+		auth_wait_start();
+	}
+	atomic_store(&held, 0);
+	return imported;
+}
+
+// Aggiorna la finestra della chiave; 0 se il contatore è già stato visto
+// o è più vecchio della finestra
+static int window_accept(auth_key_t *k, uint64_t ctr) {
+	uint64_t word = ctr / 64;
+	int ok = 1;
+	while (atomic_flag_test_and_set_explicit(&k->lock, memory_order_acquire)) {
+	}
+	if (ctr > k->top) {
+		// La finestra avanza: si azzerano le parole che escono di scena
+		uint64_t cur = k->top / 64;
+		uint64_t advance = word - cur < AUTH_WORDS ? word - cur : AUTH_WORDS;
+		for (uint64_t i = 1; i <= advance; ++i) {
+			k->bitmap[(cur + i) % AUTH_WORDS] = 0;
+		}
+		k->top = ctr;
+	} else if (k->top - ctr >= AUTH_WINDOW - 64) {
+		ok = 0;
+	}
+	uint64_t bit = 1ull << (ctr % 64);
+	uint64_t *w = &k->bitmap[word % AUTH_WORDS];
+	if (ok && (*w & bit)) {
+		ok = 0;
+	}
+	*w |= ok ? bit : 0;
+	atomic_flag_clear_explicit(&k->lock, memory_order_release);
+	return ok;
+}
+
+int auth_verify(const unsigned char *req, int len) {
+	int reqlen = len - AUTH_TRAILER_SIZE;
+	if (reqlen < 0) {
+		atomic_fetch_add_explicit(&drop_format, 1, memory_order_relaxed);
+		return -1;
+	}
+	const unsigned char *t = req + reqlen;
+	uint32_t id = get32be(t);
+	if (id >= AUTH_MAX_KEYS || !keys[id].present) {
+		atomic_fetch_add_explicit(&drop_format, 1, memory_order_relaxed);
+		return -1;
+	}
+	// Nel riavvio a caldo si attendono le finestre della generazione
+	// precedente; i datagram intanto restano in coda
+	while (atomic_load_explicit(&held, memory_order_acquire)) {
+		struct timespec pause = { 0, 1000 * 1000 };
+		nanosleep(&pause, NULL);
+	}
+	// Gli istanti fino all'avvio possono essere già passati per la finestra
+	// di un'altra generazione, che qui non c'è
+	auth_key_t *k = &keys[id];
+	uint32_t ts = get32be(t + 4);
+	int64_t skew = (int64_t)ts - (int64_t)(uint32_t)time(NULL);
+	if (skew > AUTH_MAX_SKEW || skew < -AUTH_MAX_SKEW || ts <= k->since) {
+		atomic_fetch_add_explicit(&drop_time, 1, memory_order_relaxed);
+		return -1;
+	}
+	// Confronto su interi: tempo costante rispetto al contenuto del MAC
+	uint64_t mac = siphash24(k->key, req, (size_t)reqlen + AUTH_MAC_OFFSET);
+	if ((mac ^ get64be(t + AUTH_MAC_OFFSET)) != 0) {
+		atomic_fetch_add_explicit(&drop_mac, 1, memory_order_relaxed);
+		return -1;
+	}
+	if (!window_accept(k, get64be(t + 8))) {
+		atomic_fetch_add_explicit(&drop_replay, 1, memory_order_relaxed);
+		return -1;
+	}
+	return reqlen;
+}
+
+void auth_stop(void) {
+	if (keys == NULL) {
+		return;
+	}
+	printf("Autenticazione: scartati %llu per formato o chiave, %llu per istante, "
+			"%llu per MAC, %llu per replay\n",
+			(unsigned long long)atomic_load(&drop_format), (unsigned long long)atomic_load(&drop_time),
+			(unsigned long long)atomic_load(&drop_mac), (unsigned long long)atomic_load(&drop_replay));
+	free_keys();
+}
+
+#else
+
+int auth_add_key(unsigned id, const unsigned char key[16]) {
+	(void)id;
+	(void)key;
+	return -1;
+}
+
+int auth_load(const char *path) {
+	(void)path;
+	return -1;
+}
+
+void auth_wait_start(void) {
+}
+
+void auth_hold(void) {
+}
+
+int auth_export(unsigned char *out) {
+	(void)out;
+	return 0;
+}
+
+int auth_resume(const unsigned char *in, int len) {
+	(void)in;
+	(void)len;
+	return -1;
+}
+
+int auth_verify(const unsigned char *req, int len) {
+	(void)req;
+	return len;
+}
+
+void auth_stop(void) {
+}
+
+#endif
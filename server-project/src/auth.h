@@ -0,0 +1,76 @@
+/*
+ * auth.h
+ *
+ * Modalità autenticata (-K file): il trailer delle richieste (formato in
+ * protocol.h) viene verificato prima di qualunque altra elaborazione, così
+ * un flood di datagram falsificati costa al server un MAC per pacchetto e
+ * nessuna risoluzione del nome, log o generazione di valori.
+ *
+ * Il file delle chiavi ha una riga per chiave: key id decimale e chiave di
+ * 128 bit in esadecimale (32 cifre); le righe vuote o che iniziano con '#'
+ * sono ignorate, ogni altra riga malformata fa fallire il caricamento.
+ * Ogni mittente concorrente deve usare un proprio key id: la finestra
+ * anti-replay segue un solo contatore crescente per chiave.
+ *
+ * La finestra vive solo in memoria. A ogni avvio a freddo riparte vuota
+ * e, per non riaccettare datagram già visti da un'esecuzione precedente,
+ * si scartano quelli con istante non successivo al secondo di auth_load:
+ * un client deve quindi firmare con un istante posteriore all'avvio del
+ * server (a meno dello scarto ammesso). Nel riavvio a caldo le finestre
+ * passano invece dalla generazione precedente, dopo che questa ha smesso
+ * di verificare, e la nuova sospende le verifiche fino al loro arrivo.
+ */
+
+#ifndef AUTH_H_
+#define AUTH_H_
+
+#define AUTH_MAX_KEYS 1024 // key id ammessi: 0 .. AUTH_MAX_KEYS - 1
+#define AUTH_WINDOW   2048 // contatori nella finestra anti-replay (multiplo di 64)
+
+// Stato delle finestre trasferito nel riavvio a caldo
+#define AUTH_STATE_MAGIC 0x57484155u // "WHAU"
+#define AUTH_STATE_MAX   (8 + AUTH_MAX_KEYS * (24 + AUTH_WINDOW / 8))
+
+// Registra la chiave di 16 byte per key id e abilita la verifica.
+// Restituisce 0, -1 se il key id non è valido o è già in uso.
+int auth_add_key(unsigned id, const unsigned char key[16]);
+
+// Carica le chiavi del file, ne registra l'istante e abilita la verifica.
+// Restituisce il numero di chiavi caricate, -1 in caso di errore (o se la
+// piattaforma non lo supporta).
+int auth_load(const char *path);
+
+// Avvio a freddo: attende che l'orologio superi il secondo di auth_load
+// (al più un secondo), così dal primo datagram servito i client validi non
+// vengono scartati dal controllo sull'avvio.
+void auth_wait_start(void);
+
+// Riavvio a caldo, lato nuova generazione: sospende le verifiche (i
+// trasporti già avviati attendono) fino ad auth_resume.
+void auth_hold(void);
+
+// Riavvio a caldo, lato vecchia generazione a trasporti fermi: serializza
+// le finestre delle chiavi in out (almeno AUTH_STATE_MAX byte).
+// Restituisce i byte scritti.
+int auth_export(unsigned char *out);
+
+// Riprende le verifiche con le finestre serializzate da auth_export per le
+// chiavi identiche nelle due generazioni; senza stato valido (in NULL o
+// len 0 compresi) riparte con il controllo sull'avvio spostato a ora,
+// attendendo il secondo successivo. Restituisce le finestre importate, -1
+// se lo stato mancava o non era valido.
+int auth_resume(const unsigned char *in, int len);
+
+// Verifica il trailer della richiesta di len byte. Restituisce la
+// lunghezza della richiesta senza trailer, -1 se il datagram va scartato.
+// Sicura da più thread.
+int auth_verify(const unsigned char *req, int len);
+
+// Stampa i datagram scartati per motivo e libera le chiavi; da chiamare
+// dopo l'arresto dei trasporti.
+void auth_stop(void);
+
+// Diverso da zero dopo auth_load: i trasporti chiamano auth_verify.
+extern int auth_enabled;
+
+#endif /* AUTH_H_ */
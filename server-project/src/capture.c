@@ -0,0 +1,172 @@
+/*
+ * capture.c
+ *
+ * Scrittura in background della cattura: i produttori (loop principale e
+ * thread dei trasporti) copiano i record nel buffer attivo sotto un lock
+ * di breve durata; quando è pieno i buffer si scambiano e il thread di
+ * scrittura salva su file quello completo, senza rallentare il servizio.
+ */
+
+#include "capture.h"
+
+atomic_int capture_active = 0;
+
+#if !defined(_WIN32)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned char bufs[2][CAPTURE_BUFFER_SIZE];
+static size_t fill[2];
+static int active = 0;   // buffer in cui scrivono i produttori
+static int pending = -1; // buffer pieno in attesa del thread di scrittura
+static int running = 0;
+static FILE *capture_file = NULL;
+static pthread_t writer_thread;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+static struct timespec capture_t0;
+static unsigned long long records = 0, dropped = 0, written = 0;
+
+static void put16le(unsigned char *dst, uint16_t v) {
+	dst[0] = (unsigned char)v;
+	dst[1] = (unsigned char)(v >> 8);
+}
+
+static void put32le(unsigned char *dst, uint32_t v) {
+	put16le(dst, (uint16_t)v);
+	put16le(dst + 2, (uint16_t)(v >> 16));
+}
+
+static void put64le(unsigned char *dst, uint64_t v) {
+	put32le(dst, (uint32_t)v);
+	put32le(dst + 4, (uint32_t)(v >> 32));
+}
+
+static void *capture_writer(void *arg) {
+	(void)arg;
+	pthread_mutex_lock(&capture_mutex);
+	for (;;) {
+		while (pending < 0 && running) {
+			pthread_cond_wait(&capture_cond, &capture_mutex);
+		}
+		if (pending < 0) {
+			break; // fermata senza buffer pieni: il resto lo scrive capture_stop
+		}
+		int idx = pending;
+		pthread_mutex_unlock(&capture_mutex);
+		written += fwrite(bufs[idx], 1, fill[idx], capture_file);
+		pthread_mutex_lock(&capture_mutex);
+		fill[idx] = 0;
+		pending = -1;
+	}
+	pthread_mutex_unlock(&capture_mutex);
+	return NULL;
+}
+
+int capture_start(const char *path) {
+	capture_file = fopen(path, "wb");
+	if (capture_file == NULL) {
+		return -1;
+	}
+	struct timespec wall;
+	clock_gettime(CLOCK_REALTIME, &wall);
+	clock_gettime(CLOCK_MONOTONIC, &capture_t0);
+	unsigned char hdr[CAPTURE_HEADER_SIZE];
+	put32le(hdr, CAPTURE_MAGIC);
+	put16le(hdr + 4, CAPTURE_VERSION);
+	put16le(hdr + 6, 0);
+	put64le(hdr + 8, (uint64_t)wall.tv_sec * 1000000000ull + (uint64_t)wall.tv_nsec);
+	if (fwrite(hdr, 1, sizeof(hdr), capture_file) != sizeof(hdr)) {
+		fclose(capture_file);
+		capture_file = NULL;
+		return -1;
+	}
+	written = sizeof(hdr);
+	running = 1;
+	if (pthread_create(&writer_thread, NULL, capture_writer, NULL) != 0) {
+		running = 0;
+		fclose(capture_file);
+		capture_file = NULL;
+		return -1;
+	}
+	atomic_store(&capture_active, 1);
+	return 0;
+}
+
+void capture_record(const unsigned char *req, int reqlen, const unsigned char *resp, int resplen) {
+	if (reqlen < 0) {
+		reqlen = 0;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t ts = (uint64_t)(now.tv_sec - capture_t0.tv_sec) * 1000000000ull
+			+ (uint64_t)now.tv_nsec - (uint64_t)capture_t0.tv_nsec;
+	size_t need = CAPTURE_RECORD_SIZE + (size_t)reqlen + (size_t)resplen;
+
+	pthread_mutex_lock(&capture_mutex);
+	if (!atomic_load(&capture_active) || need > CAPTURE_BUFFER_SIZE) {
+		pthread_mutex_unlock(&capture_mutex);
+		return;
+	}
+	if (fill[active] + need > CAPTURE_BUFFER_SIZE) {
+		if (pending >= 0) {
+			// Scrittura su disco più lenta del traffico: si scarta
+			dropped++;
+			pthread_mutex_unlock(&capture_mutex);
+			return;
+		}
+		pending = active;
+		active ^= 1;
+		pthread_cond_signal(&capture_cond);
+	}
+	unsigned char *dst = &bufs[active][fill[active]];
+	put64le(dst, ts);
+	put16le(dst + 8, (uint16_t)reqlen);
+	put16le(dst + 10, (uint16_t)resplen);
+	memcpy(dst + CAPTURE_RECORD_SIZE, req, (size_t)reqlen);
+	memcpy(dst + CAPTURE_RECORD_SIZE + reqlen, resp, (size_t)resplen);
+	fill[active] += need;
+	records++;
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+void capture_stop(void) {
+	if (capture_file == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&capture_mutex);
+	atomic_store(&capture_active, 0);
+	running = 0;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_mutex);
+	pthread_join(writer_thread, NULL);
+
+	// Il thread è terminato: resta al più il buffer attivo
+	written += fwrite(bufs[active], 1, fill[active], capture_file);
+	fill[active] = 0;
+	fclose(capture_file);
+	capture_file = NULL;
+	printf("Cattura: %llu record, %llu scartati, %llu byte scritti\n", records, dropped, written);
+}
+
+#else
+
+int capture_start(const char *path) {
+	(void)path;
+	return -1;
+}
+
+void capture_record(const unsigned char *req, int reqlen, const unsigned char *resp, int resplen) {
+	(void)req;
+	(void)reqlen;
+	(void)resp;
+	(void)resplen;
+}
+
+void capture_stop(void) {
+}
+
+#endif
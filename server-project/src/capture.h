@@ -0,0 +1,51 @@
+/*
+ * capture.h
+ *
+ * Cattura del traffico di richiesta (-C file): ogni datagram elaborato da
+ * process_batch, e ogni iscrizione o cancellazione gestita dai trasporti,
+ * viene registrato con la sua risposta e l'istante di arrivo, in un file
+ * binario compatto scritto da un thread dedicato. Il file si riproduce
+ * con tools/replay.c; i cookie di verifica delle iscrizioni sono legati
+ * al mittente originale, quindi in riproduzione le iscrizioni non si
+ * attivano (e il server non invia push a replay).
+ *
+ * In modalità autenticata (-K) process_batch riceve le richieste già
+ * private del trailer, e così vengono registrate: la cattura non contiene
+ * chiavi, MAC né contatori, che in una riproduzione verbatim verrebbero
+ * comunque rifiutati dalla finestra anti-replay. Per riprodurla contro un
+ * server -K, replay firma di nuovo ogni record con la chiave passata a -k.
+ *
+ * Formato (interi little-endian):
+ *   intestazione: magic u32, versione u16, riservato u16, inizio u64
+ *                 (ns dall'epoca Unix)
+ *   record:       istante u64 (ns dall'inizio), lunghezza richiesta u16,
+ *                 lunghezza risposta u16, richiesta, risposta
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define CAPTURE_MAGIC        0x50414357u // "WCAP"
+#define CAPTURE_VERSION      1
+#define CAPTURE_HEADER_SIZE  16
+#define CAPTURE_RECORD_SIZE  12          // intestazione di ogni record
+#define CAPTURE_BUFFER_SIZE  (1 << 20)   // byte per ciascuno dei due buffer
+
+// Apre il file e avvia il thread di scrittura. Restituisce 0 in caso di
+// successo, -1 in caso di errore (o se la piattaforma non lo supporta).
+int capture_start(const char *path);
+
+// Accoda un record; non blocca mai: con entrambi i buffer pieni il record
+// viene scartato e conteggiato.
+void capture_record(const unsigned char *req, int reqlen, const unsigned char *resp, int resplen);
+
+// Scrive i dati rimasti, chiude il file e stampa il riepilogo.
+void capture_stop(void);
+
+// Diverso da zero se la cattura è attiva (controllo senza lock).
+extern atomic_int capture_active;
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,401 @@
+/*
+ * diag.c
+ *
+ * Rilevatore di stalli e profiler a campionamento (vedi diag.h). I gestori
+ * di segnale si limitano a backtrace() in memoria preallocata; la
+ * risoluzione dei simboli, le stampe e la scrittura del file avvengono
+ * fuori dai gestori (thread watchdog e loop principale).
+ */
+
+#define _GNU_SOURCE // backtrace, SIGRTMIN
+#include "diag.h"
+
+atomic_int diag_watchdog_active = 0;
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define DIAG_STALL_SIGNAL (SIGRTMIN + 3)
+
+typedef struct {
+	pthread_t thread;
+	char name[16];
+	_Atomic uint64_t busy_since; // ns (CLOCK_MONOTONIC) di inizio richiesta, 0 = inattivo
+	uint64_t reported;           // busy_since dell'ultimo stallo segnalato
+	atomic_int captured;         // stack scritto dal gestore
+	int depth;
+	void *frames[DIAG_DEPTH];
+} diag_thread_t;
+
+static diag_thread_t threads[DIAG_MAX_THREADS];
+static atomic_int nthreads = 0;
+static __thread diag_thread_t *self = NULL;
+static int stall_threshold_ms = 0;
+static pthread_t watchdog_thread;
+static atomic_int watchdog_running = 0;
+static unsigned long long stalls = 0;
+
+typedef struct {
+	int depth;
+	void *frames[DIAG_DEPTH];
+} diag_sample_t;
+
+static diag_sample_t *samples = NULL;
+static char *prof_path = NULL;
+static int prof_hz = DIAG_PROF_HZ;
+static atomic_int prof_on = 0;        // campionamento attivo
+static atomic_int prof_flush = 0;     // finestra chiusa da scrivere
+static atomic_int prof_in_handler = 0;
+static atomic_uint prof_count = 0;
+static atomic_ullong prof_dropped = 0;
+static unsigned long long prof_written = 0;
+
+static uint64_t mono_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Nome di un frame da una riga di backtrace_symbols, "modulo(funzione+0x1a)
+ * [0x...]" oppure "modulo(+0x4a2f) [0x...]": la funzione se nota,
+ * altrimenti modulo+offset (risolvibile con addr2line).
+ */
+static void frame_name(const char *sym, char *out, size_t cap) {
+	const char *open = strchr(sym, '(');
+	const char *plus = open ? strchr(open, '+') : NULL;
+	const char *close = open ? strchr(open, ')') : NULL;
+	if (open && plus && plus > open + 1 && (!close || plus < close)) {
+		snprintf(out, cap, "%.*s", (int)(plus - open - 1), open + 1);
+	} else if (open && plus && close) {
+		const char *base = open;
+		while (base > sym && base[-1] != '/') {
+			base--;
+		}
+		snprintf(out, cap, "%.*s%.*s", (int)(open - base), base, (int)(close - plus), plus);
+	} else {
+		snprintf(out, cap, "%s", sym);
+	}
+	// ';' e spazi separano frame e conteggio nel formato folded
+	for (char *p = out; *p; ++p) {
+		if (*p == ';' || *p == ' ') {
+			*p = '_';
+		}
+	}
+}
+
+static void on_stall_signal(int sig) {
+	(void)sig;
+	int saved = errno;
+	diag_thread_t *t = self;
+	if (t != NULL) {
+		t->depth = backtrace(t->frames, DIAG_DEPTH);
+		atomic_store_explicit(&t->captured, 1, memory_order_release);
+	}
+	errno = saved;
+}
+
+static void report_stall(diag_thread_t *t, uint64_t since, uint64_t now) {
+	atomic_store(&t->captured, 0);
+	pthread_kill(t->thread, DIAG_STALL_SIGNAL);
+	for (int i = 0; i < 50 && !atomic_load_explicit(&t->captured, memory_order_acquire); ++i) {
+		struct timespec ts = { 0, 1000000 };
+		nanosleep(&ts, NULL);
+	}
+	stalls++;
+	fprintf(stderr, "Stallo: thread %s occupato da %.1f ms (soglia %d ms)%s\n",
+			t->name, (double)(now - since) / 1e6, stall_threshold_ms,
+			atomic_load(&t->busy_since) == since ? "" : ", terminato durante la cattura");
+	if (!atomic_load(&t->captured)) {
+		fprintf(stderr, "  (stack non disponibile)\n");
+		return;
+	}
+	// I primi due frame sono il gestore e il trampolino del segnale
+	char **syms = backtrace_symbols(t->frames, t->depth);
+	for (int i = 2; syms != NULL && i < t->depth; ++i) {
+		char name[256];
+		frame_name(syms[i], name, sizeof(name));
+		fprintf(stderr, "  #%-2d %s\n", i - 2, name);
+	}
+	free(syms);
+}
+
+static void *watchdog(void *arg) {
+	(void)arg;
+	// Controllo a un quarto della soglia (tra 1 e 100 ms)
+	long period_ms = stall_threshold_ms / 4 < 1 ? 1 : stall_threshold_ms / 4 > 100 ? 100 : stall_threshold_ms / 4;
+	uint64_t threshold = (uint64_t)stall_threshold_ms * 1000000ull;
+	while (atomic_load(&watchdog_running)) {
+		struct timespec ts = { period_ms / 1000, (period_ms % 1000) * 1000000L };
+		nanosleep(&ts, NULL);
+		uint64_t now = mono_ns();
+		int n = atomic_load(&nthreads);
+		for (int i = 0; i < n; ++i) {
+			diag_thread_t *t = &threads[i];
+			uint64_t since = atomic_load_explicit(&t->busy_since, memory_order_relaxed);
+			if (since != 0 && since != t->reported && now > since && now - since > threshold) {
+				t->reported = since; // una segnalazione per richiesta
+				report_stall(t, since, now);
+			}
+		}
+	}
+	return NULL;
+}
+
+int diag_watchdog_start(int threshold_ms) {
+	if (threshold_ms <= 0 || atomic_load(&watchdog_running)) {
+		return -1;
+	}
+	// Prima chiamata fuori dai gestori: carica libgcc e rende backtrace
+	// utilizzabile nei gestori di segnale
+	void *warm[2];
+	backtrace(warm, 2);
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_stall_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(DIAG_STALL_SIGNAL, &sa, NULL) < 0) {
+		return -1;
+	}
+	stall_threshold_ms = threshold_ms;
+	atomic_store(&watchdog_running, 1);
+	if (pthread_create(&watchdog_thread, NULL, watchdog, NULL) != 0) {
+		atomic_store(&watchdog_running, 0);
+		return -1;
+	}
+	atomic_store(&diag_watchdog_active, 1);
+	return 0;
+}
+
+void diag_register(const char *name) {
+	if (!atomic_load(&diag_watchdog_active) || self != NULL) {
+		return;
+	}
+	int i = atomic_fetch_add(&nthreads, 1);
+	if (i >= DIAG_MAX_THREADS) {
+		atomic_store(&nthreads, DIAG_MAX_THREADS);
+		return;
+	}
+	diag_thread_t *t = &threads[i];
+	t->thread = pthread_self();
+	snprintf(t->name, sizeof(t->name), "%s", name);
+	self = t;
+}
+
+void diag_mark(int busy) {
+	if (self != NULL) {
+		atomic_store_explicit(&self->busy_since, busy ? mono_ns() : 0, memory_order_relaxed);
+	}
+}
+
+static void on_sigprof(int sig) {
+	(void)sig;
+	int saved = errno;
+	atomic_fetch_add(&prof_in_handler, 1);
+	if (atomic_load_explicit(&prof_on, memory_order_relaxed)) {
+		unsigned i = atomic_fetch_add_explicit(&prof_count, 1, memory_order_relaxed);
+		if (i < DIAG_PROF_SAMPLES) {
+			samples[i].depth = backtrace(samples[i].frames, DIAG_DEPTH);
+		} else {
+			atomic_fetch_add_explicit(&prof_dropped, 1, memory_order_relaxed);
+		}
+	}
+	atomic_fetch_sub(&prof_in_handler, 1);
+	errno = saved;
+}
+
+static void set_timer(int hz) {
+	struct itimerval it;
+	memset(&it, 0, sizeof(it));
+	if (hz > 0) {
+		it.it_interval.tv_sec = hz == 1 ? 1 : 0;
+		it.it_interval.tv_usec = hz == 1 ? 0 : 1000000 / hz;
+		it.it_value = it.it_interval;
+	}
+	setitimer(ITIMER_PROF, &it, NULL);
+}
+
+// SIGUSR1: attiva o chiude la finestra di campionamento (setitimer è
+// sicuro nei gestori; la scrittura la fa diag_poll)
+static void on_toggle(int sig) {
+	(void)sig;
+	int saved = errno;
+	if (atomic_load(&prof_flush)) {
+		errno = saved;
+		return; // finestra precedente non ancora scritta
+	}
+	if (atomic_load(&prof_on)) {
+		set_timer(0);
+		atomic_store(&prof_on, 0);
+		atomic_store(&prof_flush, 1);
+	} else {
+		atomic_store(&prof_count, 0);
+		atomic_store(&prof_on, 1);
+		set_timer(prof_hz);
+	}
+	errno = saved;
+}
+
+int diag_profiler_init(const char *path, int hz) {
+	if (path == NULL || hz <= 0 || hz > 1000 || samples != NULL) {
+		return -1;
+	}
+	FILE *f = fopen(path, "a");
+	if (f == NULL) {
+		return -1;
+	}
+	fclose(f);
+	samples = (diag_sample_t *)calloc(DIAG_PROF_SAMPLES, sizeof(diag_sample_t));
+	prof_path = strdup(path);
+	if (samples == NULL || prof_path == NULL) {
+		free(samples);
+		free(prof_path);
+		samples = NULL;
+		prof_path = NULL;
+		return -1;
+	}
+	prof_hz = hz;
+	void *warm[2];
+	backtrace(warm, 2);
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = on_sigprof;
+	if (sigaction(SIGPROF, &sa, NULL) < 0) {
+		return -1;
+	}
+	// Il cambio di stato non deve interrompersi con un campione a metà
+	sa.sa_handler = on_toggle;
+	sigaddset(&sa.sa_mask, SIGPROF);
+	return sigaction(SIGUSR1, &sa, NULL);
+}
+
+static int cmp_str(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Aggrega i campioni della finestra chiusa e li aggiunge al file
+static void write_folded(void) {
+	while (atomic_load(&prof_in_handler) > 0) {
+		sched_yield();
+	}
+	unsigned n = atomic_load(&prof_count);
+	if (n > DIAG_PROF_SAMPLES) {
+		n = DIAG_PROF_SAMPLES;
+	}
+	char **lines = (char **)calloc(n > 0 ? n : 1, sizeof(char *));
+	FILE *f = fopen(prof_path, "a");
+	if (lines == NULL || f == NULL) {
+		free(lines);
+		if (f) {
+			fclose(f);
+		}
+		atomic_store(&prof_flush, 0);
+		return;
+	}
+	unsigned nl = 0;
+	for (unsigned s = 0; s < n; ++s) {
+		diag_sample_t *smp = &samples[s];
+		char **syms = backtrace_symbols(smp->frames, smp->depth);
+		if (syms == NULL) {
+			continue;
+		}
+		// Dalla radice alla foglia, saltando gestore e trampolino
+		char line[DIAG_DEPTH * 64];
+		size_t len = 0;
+		line[0] = '\0';
+		for (int i = smp->depth - 1; i >= 2 && len < sizeof(line) - 1; --i) {
+			char name[128];
+			frame_name(syms[i], name, sizeof(name));
+			len += (size_t)snprintf(line + len, sizeof(line) - len, "%s%s", len ? ";" : "", name);
+		}
+		free(syms);
+		if (len > 0 && (lines[nl] = strdup(line)) != NULL) {
+			nl++;
+		}
+	}
+	qsort(lines, nl, sizeof(char *), cmp_str);
+	for (unsigned i = 0; i < nl;) {
+		unsigned j = i + 1;
+		while (j < nl && strcmp(lines[i], lines[j]) == 0) {
+			j++;
+		}
+		fprintf(f, "%s %u\n", lines[i], j - i);
+		i = j;
+	}
+	for (unsigned i = 0; i < nl; ++i) {
+		free(lines[i]);
+	}
+	free(lines);
+	fclose(f);
+	prof_written += n;
+	printf("Profilo: %u campioni aggiunti a %s (%llu scartati a buffer pieno)\n",
+			n, prof_path, (unsigned long long)atomic_exchange(&prof_dropped, 0));
+	atomic_store(&prof_flush, 0);
+}
+
+void diag_poll(void) {
+	if (atomic_load(&prof_flush)) {
+		write_folded();
+	}
+}
+
+void diag_stop(void) {
+	if (samples != NULL) {
+		if (atomic_load(&prof_on)) {
+			set_timer(0);
+			atomic_store(&prof_on, 0);
+			atomic_store(&prof_flush, 1);
+		}
+		diag_poll();
+		signal(SIGUSR1, SIG_IGN);
+		printf("Profilo: %llu campioni in totale\n", prof_written);
+	}
+	if (atomic_exchange(&watchdog_running, 0)) {
+		pthread_join(watchdog_thread, NULL);
+		atomic_store(&diag_watchdog_active, 0);
+		printf("Watchdog: %llu stalli oltre %d ms\n", stalls, stall_threshold_ms);
+	}
+}
+
+#else
+
+int diag_watchdog_start(int threshold_ms) {
+	(void)threshold_ms;
+	return -1;
+}
+
+void diag_register(const char *name) {
+	(void)name;
+}
+
+int diag_profiler_init(const char *path, int hz) {
+	(void)path;
+	(void)hz;
+	return -1;
+}
+
+void diag_poll(void) {
+}
+
+void diag_stop(void) {
+}
+
+void diag_mark(int busy) {
+	(void)busy;
+}
+
+#endif
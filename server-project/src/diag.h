@@ -0,0 +1,71 @@
+/*
+ * diag.h
+ *
+ * Diagnostica del percorso caldo (solo Linux).
+ *
+ * Rilevatore di stalli (-W ms): i thread che servono richieste segnano
+ * inizio e fine di ogni richiesta (o lotto) con diag_enter/diag_leave; un
+ * thread watchdog controlla da quanto ciascuno è occupato e, oltre la
+ * soglia, gli invia DIAG_STALL_SIGNAL: il thread cattura il proprio stack
+ * nel gestore e il watchdog lo stampa su stderr. Le chiamate bloccanti
+ * nascoste nel percorso caldo (risoluzione dei nomi, stdout lento) si
+ * vedono così mentre accadono, non dopo.
+ *
+ * Profiler a campionamento (-O file[:hz]): ITIMER_PROF genera SIGPROF a
+ * hz campioni per secondo di CPU del processo e il gestore salva lo stack
+ * del thread interrotto in un buffer preallocato. SIGUSR1 attiva e
+ * disattiva il campionamento senza riavvio; a ogni disattivazione (e
+ * all'uscita) i campioni sono aggregati e aggiunti al file in formato
+ * "folded" (frame dalla radice alla foglia separati da ';', poi il numero
+ * di campioni), pronto per flamegraph.pl o speedscope. Le funzioni static
+ * compaiono come modulo+offset: scripts/symbolize_folded.sh le risolve.
+ */
+
+#ifndef DIAG_H_
+#define DIAG_H_
+
+#include <stdatomic.h>
+
+#define DIAG_MAX_THREADS  64    // thread sorvegliati dal watchdog
+#define DIAG_DEPTH        32    // frame catturati per stack
+#define DIAG_PROF_HZ      99    // frequenza di campionamento predefinita
+#define DIAG_PROF_SAMPLES 8192  // campioni per finestra di profilazione
+
+// Avvia il watchdog con soglia threshold_ms. Restituisce 0 in caso di
+// successo, -1 in caso di errore (o se la piattaforma non lo supporta).
+int diag_watchdog_start(int threshold_ms);
+
+// Associa il thread corrente al watchdog con il nome indicato; senza
+// watchdog attivo non fa nulla. Da chiamare all'avvio di ogni thread che
+// serve richieste.
+void diag_register(const char *name);
+
+// Prepara il profiler che scrive su path (campionamento spento fino al
+// primo SIGUSR1). Restituisce 0 in caso di successo, -1 in caso di errore.
+int diag_profiler_init(const char *path, int hz);
+
+// Dal loop principale: scrive i campioni di una finestra appena chiusa.
+void diag_poll(void);
+
+// Ferma watchdog e profiler (scrivendo gli ultimi campioni) e stampa il
+// riepilogo; da chiamare dopo l'arresto dei trasporti.
+void diag_stop(void);
+
+// Segnatura di inizio/fine richiesta per il watchdog (inline: senza -W
+// costa un confronto).
+void diag_mark(int busy);
+extern atomic_int diag_watchdog_active;
+
+static inline void diag_enter(void) {
+	if (atomic_load(&diag_watchdog_active)) {
+		diag_mark(1);
+	}
+}
+
+static inline void diag_leave(void) {
+	if (atomic_load(&diag_watchdog_active)) {
+		diag_mark(0);
+	}
+}
+
+#endif /* DIAG_H_ */
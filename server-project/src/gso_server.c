@@ -0,0 +1,222 @@
+/*
+ * gso_server.c
+ *
+ * Percorso UDP a lotti del loop principale: ogni datagram ricevuto può
+ * contenere più richieste accorpate da GRO (dimensione del segmento nel
+ * messaggio di controllo UDP_GRO); le risposte si accumulano e quelle
+ * consecutive verso lo stesso indirizzo e di pari lunghezza partono con
+ * una sola sendmsg con UDP_SEGMENT.
+ */
+
+#include "gso_server.h"
+
+#if defined(__linux__)
+
+#include "protocol.h"
+#include "auth.h"
+#include "capture.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#define GSO_SERVE_MAX (GSO_MAX_SEGS * 4) // richieste per chiamata di gso_serve
+
+typedef struct {
+	struct sockaddr_in addr;
+	int len;
+	unsigned char resp[BUFFER_SIZE];
+} gso_pending_t;
+
+static gso_pending_t pending[GSO_MAX_SEGS];
+static int npending = 0;
+static int gso_disabled = 0; // UDP_SEGMENT rifiutato dal kernel: invii singoli
+static unsigned long long gso_requests = 0, gso_recv_calls = 0, gso_send_calls = 0;
+
+int gso_enable(int sock) {
+	int on = 1;
+	return setsockopt(sock, SOL_UDP, UDP_GRO, &on, sizeof(on));
+}
+
+void gso_disable(int sock) {
+	int off = 0;
+	setsockopt(sock, SOL_UDP, UDP_GRO, &off, sizeof(off));
+}
+
+static int same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+// Invia pending[first..first+n) (stesso indirizzo, stessa lunghezza)
+static void send_group(int sock, int first, int n) {
+	if (n > 1 && !gso_disabled) {
+		static unsigned char buf[GSO_MAX_SEGS * BUFFER_SIZE];
+		int seg = pending[first].len;
+		for (int i = 0; i < n; ++i) {
+			memcpy(&buf[i * seg], pending[first + i].resp, (size_t)seg);
+		}
+		struct iovec iov = { buf, (size_t)(n * seg) };
+		char control[CMSG_SPACE(sizeof(uint16_t))];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		memset(control, 0, sizeof(control));
+		msg.msg_name = &pending[first].addr;
+		msg.msg_namelen = sizeof(pending[first].addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		uint16_t gso_size = (uint16_t)seg;
+		memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+		gso_send_calls++;
+		if (sendmsg(sock, &msg, 0) >= 0) {
+			return;
+		}
+		if (errno != EINVAL && errno != EIO && errno != ENOPROTOOPT) {
+			return; // destinazione non raggiungibile: come per sendto, si scarta
+		}
+		printf("UDP_SEGMENT non supportato, invio delle risposte una per volta\n");
+		gso_disabled = 1;
+	}
+	for (int i = 0; i < n; ++i) {
+		gso_send_calls++;
+		sendto(sock, pending[first + i].resp, (size_t)pending[first + i].len, 0,
+				(const struct sockaddr *)&pending[first + i].addr, sizeof(pending[first + i].addr));
+	}
+}
+
+static void flush_pending(int sock) {
+	int first = 0;
+	while (first < npending) {
+		int n = 1;
+		while (first + n < npending && same_addr(&pending[first + n].addr, &pending[first].addr)
+				&& pending[first + n].len == pending[first].len) {
+			n++;
+		}
+		send_group(sock, first, n);
+		first += n;
+	}
+	npending = 0;
+}
+
+// Elabora un segmento di richiesta e ne accoda la risposta
+static void serve_segment(int sock, const unsigned char *req, int len, const struct sockaddr_in *from) {
+	if (auth_enabled && (len = auth_verify(req, len)) < 0) {
+		return; // non autenticato: nessuna risposta
+	}
+	gso_pending_t *p = &pending[npending++];
+	p->addr = *from;
+	unsigned char op = len > 0 ? req[0] : 0;
+	if (op == REQ_SUBSCRIBE || op == REQ_UNSUBSCRIBE) {
+		p->len = build_subscribe_response(req, len, from, p->resp);
+		if (atomic_load(&capture_active)) {
+			capture_record(req, len, p->resp, p->len);
+		}
+	} else {
+		p->len = process_request(req, len, p->resp, sizeof(p->resp));
+	}
+	gso_requests++;
+	if (npending == GSO_MAX_SEGS) {
+		flush_pending(sock);
+	}
+}
+
+int gso_serve(int sock) {
+	// Margine in coda: il parser legge sempre l'intero campo città
+	static unsigned char buf[GSO_RECV_SIZE + BUFFER_SIZE];
+	int served = 0;
+	while (served < GSO_SERVE_MAX) {
+		struct sockaddr_in from;
+		struct iovec iov = { buf, GSO_RECV_SIZE };
+		char control[CMSG_SPACE(sizeof(int))];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &from;
+		msg.msg_namelen = sizeof(from);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		int rcvd = (int)recvmsg(sock, &msg, MSG_DONTWAIT);
+		if (rcvd < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				break;
+			}
+			flush_pending(sock);
+			return -1;
+		}
+		gso_recv_calls++;
+
+		// Senza messaggio UDP_GRO il datagram è un'unica richiesta
+		int seg = rcvd;
+		for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+				int gso_size;
+				memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+				if (gso_size > 0) {
+					seg = gso_size;
+				}
+			}
+		}
+		if (rcvd == 0) {
+			serve_segment(sock, buf, 0, &from);
+			served++;
+			continue;
+		}
+		for (int off = 0; off < rcvd; off += seg) {
+			int len = rcvd - off < seg ? rcvd - off : seg;
+			// Come recvfrom su BUFFER_SIZE: i segmenti più lunghi sono troncati
+			serve_segment(sock, &buf[off], len < BUFFER_SIZE ? len : BUFFER_SIZE, &from);
+			served++;
+		}
+	}
+	flush_pending(sock);
+	return served;
+}
+
+void gso_report(void) {
+	if (gso_requests > 0) {
+		printf("GSO/GRO: %llu richieste, %llu ricezioni, %llu invii\n",
+				gso_requests, gso_recv_calls, gso_send_calls);
+	}
+}
+
+#else
+
+int gso_enable(int sock) {
+	(void)sock;
+	return -1;
+}
+
+void gso_disable(int sock) {
+	(void)sock;
+}
+
+int gso_serve(int sock) {
+	(void)sock;
+	return -1;
+}
+
+void gso_report(void) {
+}
+
+#endif
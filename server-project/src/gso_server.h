@@ -0,0 +1,31 @@
+/*
+ * gso_server.h
+ *
+ * Ricezione e invio a lotti sul socket UDP con offload di segmentazione
+ * (solo Linux): UDP_GRO in ricezione, con suddivisione dei datagram
+ * accorpati nei singoli segmenti di richiesta, e UDP_SEGMENT (GSO) in
+ * invio, con un'unica chiamata per le risposte consecutive verso lo
+ * stesso client.
+ */
+
+#ifndef GSO_SERVER_H_
+#define GSO_SERVER_H_
+
+#define GSO_MAX_SEGS   64    // segmenti per invio GSO (limite del kernel)
+#define GSO_RECV_SIZE  65536 // buffer di ricezione di un datagram accorpato
+
+// Abilita UDP_GRO sul socket. Restituisce 0 in caso di successo, -1 se
+// l'offload non è disponibile.
+int gso_enable(int sock);
+
+// Disattiva UDP_GRO (es. su un socket ricevuto da un'altra generazione).
+void gso_disable(int sock);
+
+// Serve tutte le richieste già in coda sul socket (senza bloccare).
+// Restituisce il numero di richieste servite, -1 in caso di errore grave.
+int gso_serve(int sock);
+
+// Stampa il riepilogo di richieste, chiamate di ricezione e di invio.
+void gso_report(void);
+
+#endif /* GSO_SERVER_H_ */
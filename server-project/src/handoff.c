@@ -0,0 +1,351 @@
+/*
+ * handoff.c
+ *
+ * Trasferimento dei socket tra generazioni del server: un messaggio con
+ * intestazione (magic, numero e tipi dei descrittori, lunghezza dello
+ * stato) e i descrittori in un messaggio di controllo SCM_RIGHTS, poi lo
+ * stato sul flusso e infine un byte di via dalla nuova generazione.
+ */
+
+#include "handoff.h"
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	int32_t kinds[HANDOFF_MAX_FDS];
+	uint32_t state_len;
+} handoff_header_t;
+
+// Una generazione che sparisce a metà passaggio non deve abbattere l'altra
+#if defined(MSG_NOSIGNAL)
+#define HANDOFF_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define HANDOFF_SEND_FLAGS 0
+#endif
+
+// Trasferisce esattamente len byte sul flusso; 0 o -1
+static int write_full(int fd, const unsigned char *p, int len) {
+	while (len > 0) {
+		ssize_t w = send(fd, p, (size_t)len, HANDOFF_SEND_FLAGS);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return -1;
+		}
+		p += w;
+		len -= (int)w;
+	}
+	return 0;
+}
+
+static int read_full(int fd, unsigned char *p, int len) {
+	while (len > 0) {
+		ssize_t r = read(fd, p, (size_t)len);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return -1;
+		}
+		p += r;
+		len -= (int)r;
+	}
+	return 0;
+}
+
+static long long mono_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Come read_full, ma rinuncia se i dati non arrivano entro deadline
+// (millisecondi monotoni); i segnali non accorciano l'attesa
+static int read_until(int fd, unsigned char *p, int len, long long deadline) {
+	while (len > 0) {
+		long long left = deadline - mono_ms();
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		int ready = left > 0 ? poll(&pfd, 1, (int)left) : 0;
+		if (ready < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ready <= 0) {
+			return -1;
+		}
+		ssize_t r = read(fd, p, (size_t)len);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return -1;
+		}
+		p += r;
+		len -= (int)r;
+	}
+	return 0;
+}
+
+static int control_addr(const char *path, struct sockaddr_un *addr) {
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+int handoff_listen(const char *path) {
+	struct sockaddr_un addr;
+	if (control_addr(path, &addr) < 0) {
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	unlink(path); // socket residuo o lasciato dalla generazione precedente
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int handoff_offer(int ctl, const int *fds, const int *kinds, int n, const void *state, int len) {
+	int conn = accept(ctl, NULL, NULL);
+	if (conn < 0) {
+		return -1;
+	}
+	if (n > HANDOFF_MAX_FDS) {
+		n = HANDOFF_MAX_FDS;
+	}
+
+	handoff_header_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = HANDOFF_MAGIC;
+	hdr.count = (uint32_t)n;
+	hdr.state_len = (uint32_t)len;
+	for (int i = 0; i < n; ++i) {
+		hdr.kinds[i] = kinds[i];
+	}
+	struct iovec iov = { &hdr, sizeof(hdr) };
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)n);
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)n);
+	memcpy(CMSG_DATA(cm), fds, sizeof(int) * (size_t)n);
+	if (sendmsg(conn, &msg, HANDOFF_SEND_FLAGS) != (ssize_t)sizeof(hdr)
+			|| write_full(conn, (const unsigned char *)state, len) < 0) {
+		close(conn);
+		return -1;
+	}
+
+	return conn;
+}
+
+int handoff_go(int conn) {
+	char go = 0;
+	ssize_t r;
+	do {
+		r = read(conn, &go, 1);
+	} while (r < 0 && errno == EINTR);
+	if (r != 1 || go != HANDOFF_GO) {
+		close(conn); // preparazione fallita: si continua a servire
+		return -1;
+	}
+	return 0;
+}
+
+int handoff_takeover(const char *path, int *fds, int *kinds, int max, int *conn,
+		unsigned char **state, int *len) {
+	*state = NULL;
+	*len = 0;
+	struct sockaddr_un addr;
+	if (control_addr(path, &addr) < 0) {
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	handoff_header_t hdr;
+	struct iovec iov = { &hdr, sizeof(hdr) };
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	ssize_t r;
+	do {
+#if defined(MSG_CMSG_CLOEXEC)
+		r = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+#else
+		r = recvmsg(fd, &msg, 0); // FD_CLOEXEC impostato dopo (macOS)
+#endif
+	} while (r < 0 && errno == EINTR);
+
+	struct cmsghdr *cm = r == (ssize_t)sizeof(hdr) ? CMSG_FIRSTHDR(&msg) : NULL;
+	if (cm == NULL || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS
+			|| hdr.magic != HANDOFF_MAGIC || hdr.count > HANDOFF_MAX_FDS
+			|| cm->cmsg_len != CMSG_LEN(sizeof(int) * hdr.count)) {
+		close(fd);
+		return -1;
+	}
+	int received[HANDOFF_MAX_FDS];
+	memcpy(received, CMSG_DATA(cm), sizeof(int) * hdr.count);
+#if !defined(MSG_CMSG_CLOEXEC)
+	for (uint32_t i = 0; i < hdr.count; ++i) {
+		fcntl(received[i], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+	unsigned char *buf = NULL;
+	if (hdr.state_len > 0) {
+		buf = hdr.state_len <= HANDOFF_STATE_MAX ? (unsigned char *)malloc(hdr.state_len) : NULL;
+		if (buf == NULL || read_full(fd, buf, (int)hdr.state_len) < 0) {
+			free(buf);
+			for (uint32_t i = 0; i < hdr.count; ++i) {
+				close(received[i]);
+			}
+			close(fd);
+			return -1;
+		}
+	}
+	*state = buf;
+	*len = (int)hdr.state_len;
+	int n = 0;
+	for (uint32_t i = 0; i < hdr.count; ++i) {
+		if (n < max) {
+			fds[n] = received[i];
+			kinds[n++] = hdr.kinds[i];
+		} else {
+			close(received[i]);
+		}
+	}
+	*conn = fd;
+	return n;
+}
+
+int handoff_release(int conn) {
+	char go = HANDOFF_GO;
+	return send(conn, &go, 1, HANDOFF_SEND_FLAGS) == 1 ? 0 : -1;
+}
+
+int handoff_send_final(int conn, const void *state, int len) {
+	uint32_t n = (uint32_t)len;
+	if (write_full(conn, (const unsigned char *)&n, 4) < 0) {
+		return -1;
+	}
+	return write_full(conn, (const unsigned char *)state, len);
+}
+
+int handoff_recv_final(int conn, unsigned char **state, int *len) {
+	*state = NULL;
+	*len = 0;
+	long long deadline = mono_ms() + HANDOFF_TIMEOUT_MS;
+	uint32_t n;
+	if (read_until(conn, (unsigned char *)&n, 4, deadline) < 0 || n > HANDOFF_STATE_MAX) {
+		return -1;
+	}
+	unsigned char *buf = (unsigned char *)malloc(n > 0 ? n : 1);
+	if (buf == NULL || read_until(conn, buf, (int)n, deadline) < 0) {
+		free(buf);
+		return -1;
+	}
+	*state = buf;
+	*len = (int)n;
+	return 0;
+}
+
+#else
+
+#include <stddef.h>
+
+int handoff_listen(const char *path) {
+	(void)path;
+	return -1;
+}
+
+int handoff_offer(int ctl, const int *fds, const int *kinds, int n, const void *state, int len) {
+	(void)ctl;
+	(void)fds;
+	(void)kinds;
+	(void)n;
+	(void)state;
+	(void)len;
+	return -1;
+}
+
+int handoff_takeover(const char *path, int *fds, int *kinds, int max, int *conn,
+		unsigned char **state, int *len) {
+	(void)path;
+	*state = NULL;
+	*len = 0;
+	(void)fds;
+	(void)kinds;
+	(void)max;
+	(void)conn;
+	return -1;
+}
+
+int handoff_go(int conn) {
+	(void)conn;
+	return -1;
+}
+
+int handoff_release(int conn) {
+	(void)conn;
+	return -1;
+}
+
+int handoff_send_final(int conn, const void *state, int len) {
+	(void)conn;
+	(void)state;
+	(void)len;
+	return -1;
+}
+
+int handoff_recv_final(int conn, unsigned char **state, int *len) {
+	(void)conn;
+	*state = NULL;
+	*len = 0;
+	return -1;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * handoff.h
+ *
+ * Riavvio senza interruzioni tra generazioni del server (solo POSIX).
+ * La generazione in servizio ascolta su un socket Unix di controllo (-R);
+ * la nuova (-T) vi si collega e riceve con SCM_RIGHTS i socket già
+ * collegati insieme allo stato da conservare (lo storico dei campioni),
+ * prepara le proprie strutture e invia HANDOFF_GO: la vecchia smette di
+ * leggere, completa le richieste in corso, invia lo stato finale (le
+ * finestre anti-replay) e termina. I datagram in coda restano nel socket
+ * condiviso e li serve la nuova generazione. Lo storico è una fotografia
+ * presa all'invio dei socket: i campioni che la vecchia generazione
+ * registra fino al via non passano alla nuova.
+ */
+
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+#define HANDOFF_MAGIC      0x57484f46u // "WHOF"
+#define HANDOFF_MAX_FDS    4
+#define HANDOFF_GO         'G'
+#define HANDOFF_TIMEOUT_MS 10000 // attesa massima del via dalla nuova generazione
+#define HANDOFF_STATE_MAX  (1 << 20) // byte di stato accettati dalla nuova generazione
+
+// Tipi dei descrittori trasferiti
+#define HANDOFF_FD_UDP  1
+#define HANDOFF_FD_UNIX 2
+
+// Crea il socket di controllo in ascolto su path (rimuovendo un residuo).
+// Restituisce il descrittore, -1 in caso di errore.
+int handoff_listen(const char *path);
+
+// Lato vecchia generazione: accetta la connessione pendente su ctl e
+// invia i descrittori fds[i] di tipo kinds[i] seguiti dai len byte di
+// state, senza attendere. Restituisce la connessione, da sorvegliare nel
+// loop di servizio fino al via (al più HANDOFF_TIMEOUT_MS), -1 in caso di
+// errore.
+int handoff_offer(int ctl, const int *fds, const int *kinds, int n, const void *state, int len);
+
+// Lato vecchia generazione, con la connessione leggibile: 0 se è arrivato
+// HANDOFF_GO (la connessione va tenuta aperta fino all'uscita: la sua
+// chiusura dice alla nuova generazione che la vecchia ha finito), -1 se
+// la nuova generazione ha rinunciato; in tal caso la connessione è chiusa
+// e si continua a servire.
+int handoff_go(int conn);
+
+// Lato nuova generazione: si collega a path e riceve fino a max
+// descrittori con i rispettivi tipi e lo stato, in un buffer allocato da
+// liberare con free (*state NULL e *len 0 se assente). Restituisce il
+// numero di descrittori ricevuti e la connessione in *conn, -1 in caso di
+// errore.
+int handoff_takeover(const char *path, int *fds, int *kinds, int max, int *conn,
+		unsigned char **state, int *len);
+
+// Lato nuova generazione: strutture pronte, la vecchia può drenare.
+int handoff_release(int conn);
+
+// Lato vecchia generazione, dopo il via e a trasporti fermi: invia sulla
+// connessione i len byte dello stato finale (le finestre anti-replay).
+// Restituisce 0, -1 in caso di errore.
+int handoff_send_final(int conn, const void *state, int len);
+
+// Lato nuova generazione, dopo handoff_release: riceve lo stato finale
+// entro HANDOFF_TIMEOUT_MS in un buffer da liberare con free. Restituisce
+// 0, -1 (con *state NULL) se la vecchia generazione ha chiuso senza
+// inviarlo o il tempo è scaduto.
+int handoff_recv_final(int conn, unsigned char **state, int *len);
+
+#endif /* HANDOFF_H_ */
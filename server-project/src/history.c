@@ -0,0 +1,306 @@
+/*
+ * history.c
+ *
+ * Ring buffer a dimensione fissa con gli ultimi HISTORY_LEN campioni per
+ * ogni città e misura, più le query per intervallo temporale e le
+ * aggregazioni min/max/media.
+ */
+
+#include "history.h"
+
+#include <string.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+// Lo storico è condiviso tra il loop principale e i thread dei trasporti
+// locali: ogni accesso avviene sotto questo mutex.
+static pthread_mutex_t history_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define HISTORY_LOCK()   pthread_mutex_lock(&history_mutex)
+#define HISTORY_UNLOCK() pthread_mutex_unlock(&history_mutex)
+#else
+#define HISTORY_LOCK()
+#define HISTORY_UNLOCK()
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HISTORY_SSE2 1
+#endif
+
+// Struct-of-arrays: valori e timestamp in array separati e contigui per
+// (città, misura); head indica la prossima posizione di scrittura.
+static struct {
+	float    value[HISTORY_CITIES][HISTORY_TYPES][HISTORY_LEN];
+	uint32_t ts[HISTORY_CITIES][HISTORY_TYPES][HISTORY_LEN];
+	uint16_t head[HISTORY_CITIES][HISTORY_TYPES];
+	uint16_t count[HISTORY_CITIES][HISTORY_TYPES];
+} history;
+
+int history_type_index(char type) {
+	switch (type) {
+		case 't': return 0;
+		case 'h': return 1;
+		case 'w': return 2;
+		case 'p': return 3;
+		default:  return -1;
+	}
+}
+
+// Da chiamare sotto il lock
+static void history_store(int city, int t, float value, uint32_t ts) {
+	uint16_t h = history.head[city][t];
+	history.value[city][t][h] = value;
+	history.ts[city][t][h] = ts;
+	history.head[city][t] = (uint16_t)((h + 1) % HISTORY_LEN);
+	if (history.count[city][t] < HISTORY_LEN) {
+		history.count[city][t]++;
+	}
+}
+
+void history_record(int city, char type, float value, uint32_t ts) {
+	int t = history_type_index(type);
+	if (city < 0 || city >= HISTORY_CITIES || t < 0) {
+		return;
+	}
+	HISTORY_LOCK();
+	history_store(city, t, value, ts);
+	HISTORY_UNLOCK();
+}
+
+void history_record_now(int city, char type, float value) {
+	int t = history_type_index(type);
+	if (city < 0 || city >= HISTORY_CITIES || t < 0) {
+		return;
+	}
+	// Istante letto dentro la sezione critica: due thread che registrano
+	// nello stesso secondo di confine non possono invertire l'ordine
+	HISTORY_LOCK();
+	history_store(city, t, value, (uint32_t)time(NULL));
+	HISTORY_UNLOCK();
+}
+
+int history_latest(int city, char type, float *value, uint32_t *ts) {
+	int t = history_type_index(type);
+	if (city < 0 || city >= HISTORY_CITIES || t < 0) {
+		return 0;
+	}
+	HISTORY_LOCK();
+	int found = history.count[city][t] > 0;
+	if (found) {
+		int last = (history.head[city][t] + HISTORY_LEN - 1) % HISTORY_LEN;
+		*value = history.value[city][t][last];
+		*ts = history.ts[city][t][last];
+	}
+	HISTORY_UNLOCK();
+	return found;
+}
+
+// Individua la finestra logica [*first, *first + n) dei campioni con
+// from <= ts <= to. I timestamp sono non decrescenti in ordine logico,
+// quindi la finestra è sempre contigua (al più due segmenti fisici).
+static int history_window(int city, int t, uint32_t from, uint32_t to, int *first) {
+	int count = history.count[city][t];
+	int oldest = (history.head[city][t] + HISTORY_LEN - count) % HISTORY_LEN;
+	const uint32_t *ts = history.ts[city][t];
+	int lo = 0;
+	while (lo < count && from != 0 && ts[(oldest + lo) % HISTORY_LEN] < from) {
+		lo++;
+	}
+	int hi = count;
+	while (hi > lo && to != 0 && ts[(oldest + hi - 1) % HISTORY_LEN] > to) {
+		hi--;
+	}
+	*first = (oldest + lo) % HISTORY_LEN;
+	return hi - lo;
+}
+
+int history_range(int city, char type, uint32_t from, uint32_t to,
+		uint32_t *ts_out, float *value_out, int max) {
+	int t = history_type_index(type);
+	if (city < 0 || city >= HISTORY_CITIES || t < 0) {
+		return 0;
+	}
+	HISTORY_LOCK();
+	int first;
+	int n = history_window(city, t, from, to, &first);
+	// Se i campioni eccedono max si restituiscono i più recenti
+	if (n > max) {
+		first = (first + n - max) % HISTORY_LEN;
+		n = max;
+	}
+	for (int i = 0; i < n; ++i) {
+		int k = (first + i) % HISTORY_LEN;
+		ts_out[i] = history.ts[city][t][k];
+		value_out[i] = history.value[city][t][k];
+	}
+	HISTORY_UNLOCK();
+	return n;
+}
+
+int history_aggregate(int city, char type, uint32_t from, uint32_t to,
+		history_aggr_t *out) {
+	memset(out, 0, sizeof(*out));
+	int t = history_type_index(type);
+	if (city < 0 || city >= HISTORY_CITIES || t < 0) {
+		return 0;
+	}
+	HISTORY_LOCK();
+	int first;
+	int n = history_window(city, t, from, to, &first);
+	if (n == 0) {
+		HISTORY_UNLOCK();
+		return 0;
+	}
+	const float *v = history.value[city][t];
+	// Primo segmento fino alla fine dell'array, secondo dall'inizio
+	int seg1 = (first + n <= HISTORY_LEN) ? n : HISTORY_LEN - first;
+	float mn, mx, sum;
+	history_reduce(&v[first], seg1, &mn, &mx, &sum);
+	if (seg1 < n) {
+		float mn2, mx2, sum2;
+		history_reduce(v, n - seg1, &mn2, &mx2, &sum2);
+		mn = mn2 < mn ? mn2 : mn;
+		mx = mx2 > mx ? mx2 : mx;
+		sum += sum2;
+	}
+	HISTORY_UNLOCK();
+	out->count = (uint16_t)n;
+	out->min = mn;
+	out->max = mx;
+	out->avg = sum / (float)n;
+	return n;
+}
+
+// Interi in ordine nativo: lo stato passa solo tra processi sulla stessa macchina
+static unsigned char *put_bytes(unsigned char *p, const void *v, size_t n) {
+	memcpy(p, v, n);
+	return p + n;
+}
+
+int history_export(unsigned char *out) {
+	uint32_t magic = HISTORY_STATE_MAGIC;
+	uint16_t dims[4] = { HISTORY_CITIES, HISTORY_TYPES, HISTORY_LEN, 0 };
+	unsigned char *p = put_bytes(out, &magic, 4);
+	p = put_bytes(p, dims, sizeof(dims));
+	HISTORY_LOCK();
+	for (int c = 0; c < HISTORY_CITIES; ++c) {
+		for (int t = 0; t < HISTORY_TYPES; ++t) {
+			uint16_t count = history.count[c][t];
+			int oldest = (history.head[c][t] + HISTORY_LEN - count) % HISTORY_LEN;
+			p = put_bytes(p, &count, 2);
+			for (int i = 0; i < count; ++i) {
+				int k = (oldest + i) % HISTORY_LEN;
+				p = put_bytes(p, &history.ts[c][t][k], 4);
+				p = put_bytes(p, &history.value[c][t][k], 4);
+			}
+		}
+	}
+	HISTORY_UNLOCK();
+	return (int)(p - out);
+}
+
+int history_import(const unsigned char *in, int len) {
+	uint32_t magic;
+	uint16_t dims[4];
+	if (len < 12) {
+		return -1;
+	}
+	memcpy(&magic, in, 4);
+	memcpy(dims, in + 4, sizeof(dims));
+	if (magic != HISTORY_STATE_MAGIC || dims[0] != HISTORY_CITIES || dims[1] != HISTORY_TYPES
+			|| dims[2] != HISTORY_LEN) {
+		return -1;
+	}
+	// Prima una verifica completa delle lunghezze, poi la copia
+	int off = 12;
+	for (int i = 0; i < HISTORY_CITIES * HISTORY_TYPES; ++i) {
+		uint16_t count;
+		if (off + 2 > len) {
+			return -1;
+		}
+		memcpy(&count, in + off, 2);
+		off += 2 + count * 8;
+		if (count > HISTORY_LEN || off > len) {
+			return -1;
+		}
+	}
+	int total = 0;
+	off = 12;
+	HISTORY_LOCK();
+	for (int c = 0; c < HISTORY_CITIES; ++c) {
+		for (int t = 0; t < HISTORY_TYPES; ++t) {
+			uint16_t count;
+			memcpy(&count, in + off, 2);
+			off += 2;
+			for (int i = 0; i < count; ++i, off += 8) {
+				memcpy(&history.ts[c][t][i], in + off, 4);
+				memcpy(&history.value[c][t][i], in + off + 4, 4);
+			}
+			history.count[c][t] = count;
+			history.head[c][t] = (uint16_t)(count % HISTORY_LEN);
+			total += count;
+		}
+	}
+	HISTORY_UNLOCK();
+	return total;
+}
+
+void history_reduce_scalar(const float *v, int n, float *min, float *max, float *sum) {
+	float mn = n > 0 ? v[0] : 0.0f;
+	float mx = mn;
+	float s = 0.0f;
+	for (int i = 0; i < n; ++i) {
+		mn = v[i] < mn ? v[i] : mn;
+		mx = v[i] > mx ? v[i] : mx;
+		s += v[i];
+	}
+	*min = mn;
+	*max = mx;
+	*sum = s;
+}
+
+void history_reduce(const float *v, int n, float *min, float *max, float *sum) {
+#if defined(HISTORY_SSE2)
+	if (n < 8) {
+		history_reduce_scalar(v, n, min, max, sum);
+		return;
+	}
+	// Due accumulatori indipendenti per nascondere la latenza di addps
+	__m128 mn0 = _mm_loadu_ps(v), mn1 = _mm_loadu_ps(v + 4);
+	__m128 mx0 = mn0, mx1 = mn1;
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128 a = _mm_loadu_ps(v + i);
+		__m128 b = _mm_loadu_ps(v + i + 4);
+		mn0 = _mm_min_ps(mn0, a);
+		mn1 = _mm_min_ps(mn1, b);
+		mx0 = _mm_max_ps(mx0, a);
+		mx1 = _mm_max_ps(mx1, b);
+		s0 = _mm_add_ps(s0, a);
+		s1 = _mm_add_ps(s1, b);
+	}
+	float lmn[4], lmx[4], ls[4];
+	_mm_storeu_ps(lmn, _mm_min_ps(mn0, mn1));
+	_mm_storeu_ps(lmx, _mm_max_ps(mx0, mx1));
+	_mm_storeu_ps(ls, _mm_add_ps(s0, s1));
+	float mn = lmn[0], mx = lmx[0], s = ls[0];
+	for (int k = 1; k < 4; ++k) {
+		mn = lmn[k] < mn ? lmn[k] : mn;
+		mx = lmx[k] > mx ? lmx[k] : mx;
+		s += ls[k];
+	}
+	// Coda non multipla di 8
+	for (; i < n; ++i) {
+		mn = v[i] < mn ? v[i] : mn;
+		mx = v[i] > mx ? v[i] : mx;
+		s += v[i];
+	}
+	*min = mn;
+	*max = mx;
+	*sum = s;
+#else
+	history_reduce_scalar(v, n, min, max, sum);
+#endif
+}
@@ -0,0 +1,71 @@
+/*
+ * history.h
+ *
+ * Storico circolare dei campioni meteo per città e misura.
+ * Layout struct-of-arrays: per ogni coppia (città, misura) i valori sono
+ * contigui in memoria, così le aggregazioni min/max/media lavorano su
+ * blocchi di float vettorizzabili.
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+
+#define HISTORY_LEN    60   // Campioni conservati per città e misura
+#define HISTORY_CITIES 10   // Città gestite dal server (vedi citycheck)
+#define HISTORY_TYPES  4    // 't','h','w','p'
+
+// Stato serializzato per il riavvio a caldo: intestazione (magic e
+// dimensioni) e per ogni città e misura il numero di campioni seguito
+// dai campioni (istante u32, valore float) dal più vecchio
+#define HISTORY_STATE_MAGIC 0x57485354u // "WHST"
+#define HISTORY_STATE_MAX   (12 + HISTORY_CITIES * HISTORY_TYPES * (2 + HISTORY_LEN * 8))
+
+typedef struct {
+	uint16_t count; // campioni aggregati
+	float min;
+	float max;
+	float avg;
+} history_aggr_t;
+
+// Indice della misura nello storico (-1 se il tipo non è valido)
+int history_type_index(char type);
+
+// Registra un nuovo campione, sovrascrivendo il più vecchio a buffer pieno.
+// Gli istanti devono essere non decrescenti: le query lo presuppongono.
+void history_record(int city, char type, float value, uint32_t ts);
+
+// Come history_record con l'istante attuale, letto sotto il lock dello
+// storico: è la variante per i campioni del servizio, registrati in
+// parallelo dal loop principale e dai thread dei trasporti.
+void history_record_now(int city, char type, float value);
+
+// Ultimo campione registrato; restituisce 0 se lo storico è vuoto
+int history_latest(int city, char type, float *value, uint32_t *ts);
+
+// Copia in ordine cronologico i campioni con from <= ts <= to
+// (0 = estremo aperto). Restituisce il numero di campioni copiati.
+int history_range(int city, char type, uint32_t from, uint32_t to,
+		uint32_t *ts_out, float *value_out, int max);
+
+// Calcola min/max/media dei campioni nell'intervallo (stessa semantica
+// di history_range). Restituisce il numero di campioni aggregati.
+int history_aggregate(int city, char type, uint32_t from, uint32_t to,
+		history_aggr_t *out);
+
+// Serializza lo storico in out (almeno HISTORY_STATE_MAX byte).
+// Restituisce i byte scritti.
+int history_export(unsigned char *out);
+
+// Sostituisce lo storico con quello serializzato da history_export.
+// Restituisce i campioni importati, -1 se i dati non sono validi o le
+// dimensioni non coincidono (lo storico resta invariato).
+int history_import(const unsigned char *in, int len);
+
+// Riduzione min/max/somma su un vettore contiguo: versione SIMD e
+// versione scalare di riferimento (esposta per benchmark e confronto).
+void history_reduce(const float *v, int n, float *min, float *max, float *sum);
+void history_reduce_scalar(const float *v, int n, float *min, float *max, float *sum);
+
+#endif /* HISTORY_H_ */
@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netdb.h>
@@ -22,12 +23,25 @@
 #endif
 
 #include "protocol.h"
+#include "history.h"
+#include "subscription.h"
+#include "multicast.h"
+#include "shm_server.h"
+#include "pipeline.h"
+#include "xdp_server.h"
+#include "gso_server.h"
+#include "handoff.h"
+#include "capture.h"
+#include "auth.h"
+#include "diag.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 
 // Wrapper compatibile per inet_pton: su Windows usa inet_addr/gethostbyname,
 // su Linux/macOS chiama direttamente inet_pton.
@@ -62,38 +76,136 @@ void errorhandler(char *errorMessage) {
 	printf ("%s", errorMessage);
 }
 
-float get_temperature(void) {
-	return ((float)(rand() % 501) / 10.0f) - 10.0f; // -10.0 to 40.0 °C
-}
-
-float get_humidity(void) {
-	return ((float)(rand() % 801) / 10.0f) + 20.0f; // 20.0 to 100.0 %
-}
+// Richiesta di arresto (SIGINT/SIGTERM): il loop termina e la pulizia
+// finale svuota la cattura, ferma i thread e rimuove i socket locali
+static volatile sig_atomic_t stop_requested = 0;
 
-float get_wind(void) {
-	return ((float)(rand() % 1001) / 10.0f); // 0.0 to 100.0 km/h
+static void on_stop_signal(int sig) {
+	(void)sig;
+	stop_requested = 1;
 }
 
-float get_pressure(void) {
-	return ((float)(rand() % 1011) / 10.0f) + 950.0f; // 950.0 to 1050.0 hPa
+// Orologio monotono in millisecondi per la temporizzazione del loop
+long long now_ms(void) {
+#if defined(_WIN32)
+	return (long long)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
 }
 
 
 int main(int argc, char *argv[]) {
 
 	srand(time(NULL));
+	sub_init();
 	int port = SERVER_PORT;          // valore di default
 	const char *bind_ip = SERVER_IP; // valore di default
-
-	// Parsing opzionale di -s (IP) e -p (porta)
+	int tick_ms = TICK_MS;           // periodo di aggiornamento valori/push
+	const char *mcast_group = NULL;  // -m: abilita lo snapshot multicast
+	int mcast_port = MCAST_PORT;
+	int mcast_ms = TICK_MS;          // -M: periodo di pubblicazione
+	int mcast_payload = MCAST_PAYLOAD; // -F: dimensione massima frammento
+	const char *unix_path = NULL;    // -u: socket Unix datagram per client locali
+	const char *shm_name = NULL;     // -S: trasporto su memoria condivisa
+	int pipeline_lanes = 0;          // -P: server a pipeline con N corsie
+	const char *xdp_ifname = NULL;   // -X: percorso veloce AF_XDP sull'interfaccia
+	int xdp_queue = 0;
+	int use_gso = 0;                 // -G: ricezione GRO e invio GSO a lotti
+	const char *restart_path = NULL; // -R: socket di controllo per il riavvio a caldo
+	const char *takeover_path = NULL; // -T: subentra alla generazione in ascolto su path
+	const char *capture_path = NULL; // -C: cattura delle richieste su file
+	const char *keys_path = NULL;    // -K: richieste autenticate con le chiavi del file
+	int stall_ms = 0;                // -W: soglia del rilevatore di stalli
+	const char *prof_path = NULL;    // -O: profilo a campionamento su file
+	int prof_hz = DIAG_PROF_HZ;
+
+	// Parsing opzionale di -s (IP), -p (porta) e -i (periodo di aggiornamento in ms)
+	// -m gruppo[:porta] -M periodo_ms -F byte: snapshot multicast
+	// -u percorso: socket Unix datagram, -S nome: memoria condivisa
+	// -P corsie: server a pipeline (ricezione/elaborazione/invio su thread distinti)
+	// -X interfaccia[:coda]: percorso veloce AF_XDP (solo Linux)
+	// -G: offload di segmentazione UDP (GRO in ricezione, GSO in invio)
+	// -R percorso: accetta il riavvio a caldo da una nuova generazione
+	// -T percorso: riceve i socket dalla generazione in servizio e la sostituisce
+	// -C file: cattura richieste e risposte (riproducibili con tools/replay)
+	// -K file: accetta solo richieste autenticate con le chiavi del file
+	// -W ms: segnala con lo stack i thread occupati da una richiesta oltre ms
+	// -O file[:hz]: profilo a campionamento, attivato e fermato con SIGUSR1
 	for (int i = 1; i < argc; i++) {
 		if (strcmp(argv[i], "-s") == 0 && (i + 1) < argc) {
 			bind_ip = argv[++i];
 		} else if (strcmp(argv[i], "-p") == 0 && (i + 1) < argc) {
 			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-i") == 0 && (i + 1) < argc) {
+			tick_ms = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-m") == 0 && (i + 1) < argc) {
+			// gruppo con porta opzionale: "239.255.0.1:56701"
+			static char group[64];
+			strncpy(group, argv[++i], sizeof(group) - 1);
+			char *colon = strchr(group, ':');
+			if (colon) {
+				*colon = '\0';
+				mcast_port = atoi(colon + 1);
+			}
+			mcast_group = group;
+		} else if (strcmp(argv[i], "-M") == 0 && (i + 1) < argc) {
+			mcast_ms = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-F") == 0 && (i + 1) < argc) {
+			mcast_payload = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-u") == 0 && (i + 1) < argc) {
+			unix_path = argv[++i];
+		} else if (strcmp(argv[i], "-S") == 0 && (i + 1) < argc) {
+			shm_name = argv[++i];
+		} else if (strcmp(argv[i], "-P") == 0 && (i + 1) < argc) {
+			pipeline_lanes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-X") == 0 && (i + 1) < argc) {
+			// interfaccia con coda opzionale: "eth0:2"
+			static char ifname[64];
+			strncpy(ifname, argv[++i], sizeof(ifname) - 1);
+			char *colon = strchr(ifname, ':');
+			if (colon) {
+				*colon = '\0';
+				xdp_queue = atoi(colon + 1);
+			}
+			xdp_ifname = ifname;
+		} else if (strcmp(argv[i], "-G") == 0) {
+			use_gso = 1;
+		} else if (strcmp(argv[i], "-R") == 0 && (i + 1) < argc) {
+			restart_path = argv[++i];
+		} else if (strcmp(argv[i], "-T") == 0 && (i + 1) < argc) {
+			takeover_path = argv[++i];
+		} else if (strcmp(argv[i], "-C") == 0 && (i + 1) < argc) {
+			capture_path = argv[++i];
+		} else if (strcmp(argv[i], "-K") == 0 && (i + 1) < argc) {
+			keys_path = argv[++i];
+		} else if (strcmp(argv[i], "-W") == 0 && (i + 1) < argc) {
+			stall_ms = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-O") == 0 && (i + 1) < argc) {
+			// file con frequenza opzionale: "profilo.folded:499"
+			static char path[256];
+			strncpy(path, argv[++i], sizeof(path) - 1);
+			char *colon = strrchr(path, ':');
+			if (colon) {
+				*colon = '\0';
+				prof_hz = atoi(colon + 1);
+			}
+			prof_path = path;
 		}
 	}
 
+	if (tick_ms <= 0 || mcast_ms <= 0) {
+		printf("Periodo di aggiornamento non valido: %d\n", tick_ms <= 0 ? tick_ms : mcast_ms);
+		return 0;
+	}
+	if (mcast_group && (mcast_port <= 0 || mcast_port > 65535
+			|| mcast_payload < SNAPSHOT_HEADER_SIZE + PUSH_ENTRY_SIZE)) {
+		printf("Parametri multicast non validi\n");
+		return 0;
+	}
+
 	if (port <= 0 || port > 65535) {
 		printf("Porta non valida: %d\n", port);
 		return 0;
@@ -108,8 +220,63 @@ int main(int argc, char *argv[]) {
 		return 0;
 	}
 #endif
-	// creazione della socket UDP
-	int my_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	// Le chiavi servono prima di qualunque socket: nessuna richiesta non
+	// autenticata deve essere elaborata, e nessuna deve restare in coda
+	// con un istante che auth_verify scarterebbe
+	if (keys_path) {
+		int nkeys = auth_load(keys_path);
+		if (nkeys < 0) {
+			errorhandler("errore nel caricamento delle chiavi.\n");
+			clearwinsock();
+			return -1;
+		}
+		printf("Modalità autenticata: %d chiavi caricate da %s\n", nkeys, keys_path);
+		// Nel subentro le finestre arrivano dalla generazione precedente
+		if (takeover_path) {
+			auth_hold();
+		} else {
+			auth_wait_start();
+		}
+	}
+
+	// Riavvio a caldo: i socket già collegati arrivano dalla generazione
+	// precedente, che continua a servire finché questa non è pronta
+	int my_socket = -1;
+	int unix_socket = -1;
+	int handoff_conn = -1;
+	if (takeover_path) {
+		int fds[HANDOFF_MAX_FDS], kinds[HANDOFF_MAX_FDS];
+		unsigned char *state;
+		int state_len;
+		int n = handoff_takeover(takeover_path, fds, kinds, HANDOFF_MAX_FDS, &handoff_conn, &state, &state_len);
+		// Storico della generazione precedente; se incompatibile si riparte vuoti
+		if (n >= 0 && state_len > 0) {
+			int samples = history_import(state, state_len);
+			if (samples < 0) {
+				printf("Storico della generazione precedente non compatibile: si riparte vuoti\n");
+			} else {
+				printf("Storico ricevuto dalla generazione precedente: %d campioni\n", samples);
+			}
+		}
+		free(state);
+		for (int i = 0; i < n; ++i) {
+			if (kinds[i] == HANDOFF_FD_UDP && my_socket < 0) {
+				my_socket = fds[i];
+			} else if (kinds[i] == HANDOFF_FD_UNIX && unix_socket < 0) {
+				unix_socket = fds[i];
+			} else {
+				closesocket(fds[i]);
+			}
+		}
+		if (my_socket < 0) {
+			errorhandler("errore nel subentro alla generazione precedente.\n");
+			return -1;
+		}
+		printf("Socket ricevuti dalla generazione precedente tramite %s\n", takeover_path);
+	} else {
+		// creazione della socket UDP
+		my_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	}
 
 	if (my_socket < 0) {
 		errorhandler("errore nella creazione del socket.\n");
@@ -133,8 +300,8 @@ int main(int argc, char *argv[]) {
 		server_addr.sin_addr = *(struct in_addr*)he->h_addr_list[0];
 	}
 
-	// socket binding
-	if (bind(my_socket, (struct sockaddr*) &server_addr, sizeof(server_addr)) < 0) {
+	// socket binding (il socket ricevuto con -T è già collegato)
+	if (handoff_conn < 0 && bind(my_socket, (struct sockaddr*) &server_addr, sizeof(server_addr)) < 0) {
 		errorhandler("errore nella bind.\n");
 		closesocket(my_socket);
 		return -1;
@@ -142,9 +309,271 @@ int main(int argc, char *argv[]) {
 	// server UDP in ascolto (nessuna listen/accept per UDP)
 	printf("Server UDP in ascolto sulla porta %d...\n", port);
 
-	while (1) {
-		// Ogni iterazione gestisce un singolo datagram di richiesta
-		if (handleclientconnection(my_socket, NULL) < 0) {
+	// Socket di pubblicazione dello snapshot multicast (opzionale)
+	int mcast_socket = -1;
+	struct sockaddr_in mcast_addr;
+	if (mcast_group) {
+		mcast_socket = mcast_open(mcast_group, mcast_port, inet_ntoa(server_addr.sin_addr), &mcast_addr);
+		if (mcast_socket < 0) {
+			errorhandler("errore nella configurazione del multicast.\n");
+			closesocket(my_socket);
+			clearwinsock();
+			return -1;
+		}
+		printf("Snapshot multicast su %s:%d ogni %d ms\n", mcast_group, mcast_port, mcast_ms);
+	}
+
+
+	// La cattura parte prima di qualunque trasporto: nessuna richiesta persa
+	if (capture_path) {
+		if (capture_start(capture_path) < 0) {
+			errorhandler("errore nell'apertura del file di cattura.\n");
+			closesocket(my_socket);
+			return -1;
+		}
+		printf("Cattura delle richieste su %s\n", capture_path);
+	}
+
+	// Diagnostica attiva prima dei thread dei trasporti, che si registrano
+	// al proprio avvio
+	if (stall_ms > 0) {
+		if (diag_watchdog_start(stall_ms) < 0) {
+			errorhandler("errore nell'avvio del rilevatore di stalli.\n");
+			closesocket(my_socket);
+			return -1;
+		}
+		diag_register("main");
+		printf("Rilevatore di stalli attivo con soglia %d ms\n", stall_ms);
+	}
+	if (prof_path) {
+		if (diag_profiler_init(prof_path, prof_hz) < 0) {
+			errorhandler("errore nella preparazione del profiler.\n");
+			closesocket(my_socket);
+			return -1;
+		}
+		printf("Profiler su %s a %d Hz: SIGUSR1 avvia e ferma il campionamento\n", prof_path, prof_hz);
+	}
+
+	// Trasporti locali per i client sullo stesso host (opzionali)
+#if !defined(_WIN32)
+	if (unix_path && unix_socket < 0) {
+		struct sockaddr_un unix_addr;
+		memset(&unix_addr, 0, sizeof(unix_addr));
+		unix_addr.sun_family = AF_UNIX;
+		strncpy(unix_addr.sun_path, unix_path, sizeof(unix_addr.sun_path) - 1);
+		unlink(unix_path); // socket residuo di un'esecuzione precedente
+		unix_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (unix_socket < 0 || bind(unix_socket, (struct sockaddr *)&unix_addr, sizeof(unix_addr)) < 0) {
+			errorhandler("errore nella creazione del socket Unix.\n");
+			closesocket(my_socket);
+			return -1;
+		}
+		printf("Socket Unix in ascolto su %s\n", unix_path);
+	}
+#endif
+	if (shm_name) {
+		if (shm_server_start(shm_name) < 0) {
+			errorhandler("errore nella creazione della memoria condivisa.\n");
+			closesocket(my_socket);
+			return -1;
+		}
+		printf("Memoria condivisa disponibile come /%s\n", shm_name);
+	}
+
+	// In modalità pipeline il socket UDP è servito dai thread delle corsie;
+	// il loop principale gestisce solo aggiornamenti periodici e socket Unix
+	if (pipeline_lanes > 0) {
+		if (pipeline_start(my_socket, pipeline_lanes) < 0) {
+			errorhandler("errore nell'avvio della pipeline.\n");
+			closesocket(my_socket);
+			return -1;
+		}
+		printf("Pipeline attiva con %d corsie\n", pipeline_lanes);
+	}
+
+	// Con AF_XDP i datagram per la porta del servizio non arrivano più al
+	// socket UDP, che resta aperto per il traffico non intercettato
+	if (xdp_ifname) {
+		if (xdp_server_start(xdp_ifname, xdp_queue, port) < 0) {
+			errorhandler("errore nell'avvio del percorso AF_XDP.\n");
+			pipeline_stop();
+			shm_server_stop(0);
+			closesocket(my_socket);
+			return -1;
+		}
+		printf("AF_XDP attivo su %s coda %d (modalità generica)\n", xdp_ifname, xdp_queue);
+	}
+	if (!use_gso || pipeline_lanes > 0) {
+		// Il socket ricevuto può avere GRO attivo dalla generazione precedente
+		gso_disable(my_socket);
+	} else {
+		if (gso_enable(my_socket) < 0) {
+			printf("UDP_GRO non disponibile, si prosegue senza offload\n");
+			use_gso = 0;
+		} else {
+			printf("Offload GRO/GSO attivo sul socket UDP\n");
+		}
+	}
+
+	// Strutture del percorso caldo pronte prima del primo datagram; solo
+	// allora la generazione precedente smette di leggere e termina
+	weather_warmup();
+	int ctl_socket = -1;
+	int handed_off = -1;
+	int offer_conn = -1;          // socket offerti, in attesa del via
+	long long offer_deadline = 0;
+	if (handoff_conn >= 0) {
+		if (handoff_release(handoff_conn) < 0) {
+			errorhandler("errore nel segnale di subentro.\n");
+		}
+		if (auth_enabled) {
+			unsigned char *state;
+			int state_len;
+			handoff_recv_final(handoff_conn, &state, &state_len);
+			int windows = auth_resume(state, state_len);
+			free(state);
+			if (windows < 0) {
+				printf("Finestre anti-replay non ricevute: si riparte dall'istante attuale\n");
+			} else {
+				printf("Finestre anti-replay ricevute dalla generazione precedente: %d chiavi\n", windows);
+			}
+		}
+	} else if (restart_path) {
+		ctl_socket = handoff_listen(restart_path);
+		if (ctl_socket < 0) {
+			errorhandler("errore nella creazione del socket di controllo.\n");
+		} else {
+			printf("Riavvio a caldo disponibile su %s\n", restart_path);
+		}
+	}
+
+	signal(SIGINT, on_stop_signal);
+	signal(SIGTERM, on_stop_signal);
+
+	long long next_tick = now_ms();
+	long long next_mcast = next_tick;
+	while (!stop_requested) {
+		// Finestra di profilazione chiusa da SIGUSR1 (che interrompe la select)
+		diag_poll();
+
+		// Aggiornamento periodico dei valori e push verso gli iscritti
+		long long now = now_ms();
+		if (now >= next_tick) {
+			weather_tick(my_socket);
+			next_tick = now + tick_ms;
+		}
+		if (mcast_socket >= 0 && now >= next_mcast) {
+			if (mcast_publish(mcast_socket, &mcast_addr, mcast_payload) < 0) {
+				errorhandler("Errore nell'invio dello snapshot multicast.\n");
+			}
+			next_mcast = now + mcast_ms;
+		}
+
+		// Attesa di un datagram al più fino al prossimo aggiornamento
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		if (pipeline_lanes <= 0) {
+			FD_SET(my_socket, &rfds);
+		}
+		if (unix_socket >= 0) {
+			FD_SET(unix_socket, &rfds);
+		}
+		if (ctl_socket >= 0 && offer_conn < 0) {
+			FD_SET(ctl_socket, &rfds);
+		}
+		if (offer_conn >= 0) {
+			FD_SET(offer_conn, &rfds);
+		}
+		if (handoff_conn >= 0) {
+			FD_SET(handoff_conn, &rfds);
+		}
+		struct timeval tv;
+		long long deadline = (mcast_socket >= 0 && next_mcast < next_tick) ? next_mcast : next_tick;
+		if (offer_conn >= 0 && offer_deadline < deadline) {
+			deadline = offer_deadline;
+		}
+		long long wait = deadline > now ? deadline - now : 0;
+		tv.tv_sec = (long)(wait / 1000);
+		tv.tv_usec = (long)((wait % 1000) * 1000);
+		int maxfd = unix_socket > my_socket ? unix_socket : my_socket;
+		maxfd = ctl_socket > maxfd ? ctl_socket : maxfd;
+		maxfd = handoff_conn > maxfd ? handoff_conn : maxfd;
+		maxfd = offer_conn > maxfd ? offer_conn : maxfd;
+		int ready = select(maxfd + 1, &rfds, NULL, NULL, &tv);
+		if (ready < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			errorhandler("Errore nella select.\n");
+			break;
+		}
+
+		// Nuova generazione in preparazione: si continua a servire finché non
+		// arriva il via, poi si smette di leggere; i datagram in coda li serve
+		// la nuova. Senza via entro il limite il passaggio si annulla.
+		if (offer_conn >= 0) {
+			int failed = 0;
+			if (ready > 0 && FD_ISSET(offer_conn, &rfds)) {
+				if (handoff_go(offer_conn) == 0) {
+					handed_off = offer_conn;
+					printf("Socket passati alla nuova generazione: drenaggio e uscita\n");
+					break;
+				}
+				failed = 1;
+			} else if (now_ms() >= offer_deadline) {
+				closesocket(offer_conn);
+				failed = 1;
+			}
+			if (failed) {
+				offer_conn = -1;
+				printf("Subentro non riuscito: si continua a servire\n");
+			}
+		}
+		if (ready == 0) {
+			continue;
+		}
+
+		// Nuova generazione in arrivo: le si offrono i socket e lo storico
+		if (ctl_socket >= 0 && offer_conn < 0 && FD_ISSET(ctl_socket, &rfds)) {
+			int fds[2] = { my_socket, unix_socket };
+			int kinds[2] = { HANDOFF_FD_UDP, HANDOFF_FD_UNIX };
+			unsigned char *state = (unsigned char *)malloc(HISTORY_STATE_MAX);
+			int state_len = state != NULL ? history_export(state) : 0;
+			offer_conn = handoff_offer(ctl_socket, fds, kinds, unix_socket >= 0 ? 2 : 1, state, state_len);
+			free(state);
+			offer_deadline = now_ms() + HANDOFF_TIMEOUT_MS;
+		}
+		// Generazione precedente terminata: il socket di controllo è libero
+		if (handoff_conn >= 0 && FD_ISSET(handoff_conn, &rfds)) {
+			closesocket(handoff_conn);
+			handoff_conn = -1;
+			printf("Generazione precedente terminata\n");
+			if (restart_path) {
+				ctl_socket = handoff_listen(restart_path);
+				if (ctl_socket >= 0) {
+					printf("Riavvio a caldo disponibile su %s\n", restart_path);
+				}
+			}
+		}
+
+		// Ogni iterazione gestisce un singolo datagram di richiesta per socket pronto
+		diag_enter();
+		if (unix_socket >= 0 && FD_ISSET(unix_socket, &rfds)) {
+			handleclientconnection(unix_socket, NULL);
+		}
+		// Con -G si servono insieme tutte le richieste in coda, senza log
+		// per richiesta, e le risposte allo stesso client partono accorpate
+		int served = 0;
+		if (FD_ISSET(my_socket, &rfds) && use_gso) {
+			served = gso_serve(my_socket);
+			if (served < 0) {
+				errorhandler("Errore nella ricezione della richiesta.\n");
+			}
+		} else if (FD_ISSET(my_socket, &rfds)) {
+			served = handleclientconnection(my_socket, NULL);
+		}
+		diag_leave();
+		if (served < 0) {
 			// In caso di errore di rete grave, si interrompe il server
 			break;
 		}
@@ -152,7 +581,48 @@ int main(int argc, char *argv[]) {
 
 	printf("Server terminato.\n");
 
+	if (mcast_socket >= 0) {
+		closesocket(mcast_socket);
+	}
+	gso_report();
+	xdp_server_stop();
+	pipeline_stop();
+	// Dopo il passaggio la regione con lo stesso nome è della nuova generazione
+	shm_server_stop(handed_off >= 0);
+	// Trasporti fermi: le finestre anti-replay non cambiano più e passano
+	// alla nuova generazione, che intanto ha sospeso le verifiche
+	if (handed_off >= 0 && auth_enabled) {
+		unsigned char *state = (unsigned char *)malloc(AUTH_STATE_MAX);
+		int state_len = state != NULL ? auth_export(state) : 0;
+		handoff_send_final(handed_off, state, state_len);
+		free(state);
+	}
+	capture_stop();
+	auth_stop();
+	diag_stop();
+#if !defined(_WIN32)
+	// Dopo il passaggio i percorsi appartengono alla nuova generazione
+	if (unix_socket >= 0) {
+		closesocket(unix_socket);
+		if (unix_path && handed_off < 0) {
+			unlink(unix_path);
+		}
+	}
+	if (ctl_socket >= 0) {
+		closesocket(ctl_socket);
+		if (handed_off < 0) {
+			unlink(restart_path);
+		}
+	}
+#endif
 	closesocket(my_socket);
+	if (offer_conn >= 0 && handed_off < 0) {
+		closesocket(offer_conn); // arresto durante la preparazione della nuova
+	}
+	if (handed_off >= 0) {
+		// Ultimo atto: la chiusura segnala alla nuova generazione la fine del drenaggio
+		closesocket(handed_off);
+	}
 	clearwinsock();
 	return 0;
 } // main end
@@ -162,13 +632,15 @@ int handleclientconnection(int client_socket, const char *client_ip_unused) {
 	(void)client_ip_unused; // parametro inutilizzato (mantiene compatibilità con il prototipo)
 	// Server UDP: riceve una richiesta in un singolo datagram
 	// Protocollo binario: richiesta fissa 65 byte (1 tipo + 64 città)
-	unsigned char reqbuf[65];
-	struct sockaddr_in client_addr;
+	// Lo stesso gestore serve il socket Unix datagram locale (-u).
+	unsigned char reqbuf[BUFFER_SIZE];
+	struct sockaddr_storage client_addr;
 #if defined(_WIN32)
 	int client_len = (int)sizeof(client_addr);
 #else
 	socklen_t client_len = (socklen_t)sizeof(client_addr);
 #endif
+	memset(&client_addr, 0, sizeof(client_addr));
 	int rcvd = recvfrom(client_socket,
 					 (char *)reqbuf,
 					 (int)sizeof(reqbuf),
@@ -179,170 +651,177 @@ int handleclientconnection(int client_socket, const char *client_ip_unused) {
 		errorhandler("Errore nella ricezione della richiesta.\n");
 		return -1;
 	}
+	// Modalità autenticata: i datagram non validi si scartano in silenzio,
+	// prima di risoluzione del nome, log ed elaborazione
+	if (auth_enabled && (rcvd = auth_verify(reqbuf, rcvd)) < 0) {
+		return 0;
+	}
+	int is_inet = (client_addr.ss_family == AF_INET);
+	const struct sockaddr_in *client_in = (const struct sockaddr_in *)&client_addr;
+
+	// Richieste estese (storico, iscrizioni): opcode non alfabetico
+	unsigned char op = rcvd > 0 ? reqbuf[0] : 0;
+	int is_extended = (op == REQ_HISTORY || op == REQ_SUBSCRIBE || op == REQ_UNSUBSCRIBE
+			|| op == REQ_COMPACT);
 
 	// Se la dimensione non è quella attesa, richiesta non necessariamente valida
-	if (rcvd != (int)sizeof(reqbuf)) {
-		printf("Datagram di dimensione inattesa (%d), attesi %zu byte.\n", rcvd, sizeof(reqbuf));
+	if (!is_extended && rcvd != REQUEST_SIZE) {
+		printf("Datagram di dimensione inattesa (%d), attesi %d byte.\n", rcvd, REQUEST_SIZE);
 	}
 
 	char req_type = (char)reqbuf[0];
 	char city[65];
-	memset(city, 0, sizeof(city));
-	memcpy(city, &reqbuf[1], (rcvd > 1 && (rcvd - 1) < (int)sizeof(city)) ? (size_t)(rcvd - 1) : (size_t)64);
-	city[64] = '\0'; // Garantisce terminazione
-	// Normalizza city rimuovendo trailing null/spazi
-	int clen = (int)strlen(city);
-	while (clen > 0 && (city[clen-1] == ' ' || city[clen-1] == '\r' || city[clen-1] == '\n' || city[clen-1] == '\t')) {
-		city[clen-1] = '\0';
-		clen--;
-	}
+	extractcity(reqbuf, rcvd, city);
 
 	// Calcola IP del client a partire dall'indirizzo del datagram
-	char *client_ip = inet_ntoa(client_addr.sin_addr);
+	// (i client locali sul socket Unix non hanno un indirizzo IP)
+	char *client_ip = is_inet ? inet_ntoa(client_in->sin_addr) : "locale";
 	// Risolve l'hostname del client (es. 127.0.0.1 -> localhost)
 	char host[256];
-	struct hostent *he = gethostbyaddr((const char *)&client_addr.sin_addr,
-							 sizeof(client_addr.sin_addr),
-							 AF_INET);
+	struct hostent *he = is_inet ? gethostbyaddr((const char *)&client_in->sin_addr,
+							 sizeof(client_in->sin_addr),
+							 AF_INET) : NULL;
 	if (he != NULL && he->h_name != NULL) {
 		strncpy(host, he->h_name, sizeof(host) - 1);
 		host[sizeof(host) - 1] = '\0';
 	} else {
-		strncpy(host, "sconosciuto", sizeof(host) - 1);
+		strncpy(host, is_inet ? "sconosciuto" : "unix", sizeof(host) - 1);
 		host[sizeof(host) - 1] = '\0';
 	}
 
-	printf("Richiesta ricevuta da %s (ip %s): type='%c', city='%s'\n",
-			host,
-			client_ip ? client_ip : "(sconosciuto)",
-			req_type ? req_type : '-',
-			city[0] ? city : "(vuota)");
-
-	// Validazione e costruzione risposta (unificata)
-	char type_lower = tolower((unsigned char)req_type);
-	if (!(type_lower == 't' || type_lower == 'h' || type_lower == 'w' || type_lower == 'p')) {
-		type_lower = '\0';
+	unsigned char respbuf[BUFFER_SIZE];
+	int rlen;
+	if (op == REQ_SUBSCRIBE || op == REQ_UNSUBSCRIBE) {
+		printf("Richiesta di %s ricevuta da %s (ip %s:%d), city='%s'\n",
+				op == REQ_SUBSCRIBE ? "iscrizione" : "cancellazione",
+				host,
+				client_ip ? client_ip : "(sconosciuto)",
+				is_inet ? ntohs(client_in->sin_port) : 0,
+				op == REQ_SUBSCRIBE && city[0] ? city : "(tutte)");
+		if (is_inet) {
+			rlen = build_subscribe_response(reqbuf, rcvd, client_in, respbuf);
+		} else {
+			// Le iscrizioni push sono disponibili solo via UDP
+			uint32_t net_status = htonl(STATUS_INVALID_REQUEST);
+			memset(respbuf, 0, SUB_ACK_SIZE);
+			memcpy(respbuf, &net_status, 4);
+			respbuf[4] = op;
+			rlen = SUB_ACK_SIZE;
+		}
+		// Le altre richieste si catturano in process_batch
+		if (atomic_load(&capture_active)) {
+			capture_record(reqbuf, rcvd, respbuf, rlen);
+		}
+	} else {
+		if (op == REQ_HISTORY) {
+			printf("Richiesta storico ricevuta da %s (ip %s): type='%c', city='%s'\n",
+					host,
+					client_ip ? client_ip : "(sconosciuto)",
+					rcvd > 65 && reqbuf[65] ? (char)reqbuf[65] : '-',
+					city[0] ? city : "(vuota)");
+		} else if (op == REQ_COMPACT) {
+			printf("Richiesta compatta ricevuta da %s (ip %s): %d misure, city='%s'\n",
+					host,
+					client_ip ? client_ip : "(sconosciuto)",
+					rcvd > 65 ? reqbuf[65] : 0,
+					city[0] ? city : "(vuota)");
+		} else {
+			printf("Richiesta ricevuta da %s (ip %s): type='%c', city='%s'\n",
+					host,
+					client_ip ? client_ip : "(sconosciuto)",
+					req_type ? req_type : '-',
+					city[0] ? city : "(vuota)");
+		}
+		rlen = process_request(reqbuf, rcvd, respbuf, sizeof(respbuf));
 	}
-	weather_response_t r = build_weather_response(type_lower, city);
-
-	// Serializzazione binaria risposta: 4 byte status (network), 1 byte type, 4 byte float (network bit pattern)
-	unsigned char respbuf[9];
-	uint32_t net_status = htonl(r.status);
-	memcpy(respbuf, &net_status, 4);
-	respbuf[4] = (r.status == STATUS_SUCCESS) ? r.type : '\0';
-	uint32_t fbits;
-	memcpy(&fbits, &r.value, sizeof(fbits));
-	fbits = htonl(fbits);
-	memcpy(&respbuf[5], &fbits, 4);
 
-	// Invio della risposta tramite UDP (invio atomico del datagram)
+	// Invio della risposta (invio atomico del datagram)
 	int sent = sendto(client_socket,
 				   (const char *)respbuf,
-				   (int)sizeof(respbuf),
+				   rlen,
 				   0,
 				   (struct sockaddr *)&client_addr,
 				   client_len);
-	if (sent != (int)sizeof(respbuf)) {
+	if (sent != rlen) {
 		errorhandler("Errore nell'invio della risposta.\n");
-		return -1;
+		// Un client locale terminato non deve fermare il server
+		return is_inet ? -1 : 0;
 	}
 
 	return 0;
 }
 
-float typecheck(char type){
-	switch (type){
-		case 't':
-			get_temperature();
-			break;
-		case 'h':
-			get_humidity();
-			break;
-		case 'w':
-			get_wind();
-			break;
-		case 'p':
-			get_pressure();
-			break;
-		default:
-			printf("Richiesta non valida");
-			return 2;
-	}
-	return 0;
-}
-
-char citycheck(const char *city) {
-	static const char *valid_cities[] = {
-		"Bari","Roma","Milano","Napoli","Torino",
-		"Palermo","Genova","Bologna","Firenze","Venezia"
-	};
-	for (size_t i = 0; i < sizeof(valid_cities)/sizeof(valid_cities[0]); ++i) {
-		const char *a = city;
-		const char *b = valid_cities[i];
-		while (*a && *b) {
-			if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
-				break;
-			}
-			a++; b++;
+// Gestisce REQ_SUBSCRIBE / REQ_UNSUBSCRIBE aggiornando la tabella delle
+// iscrizioni per l'indirizzo del mittente. Scrive in resp la conferma
+// (SUB_ACK_SIZE byte) e ne restituisce la lunghezza.
+int build_subscribe_response(const unsigned char *req, int reqlen,
+		const struct sockaddr_in *client_addr, unsigned char *resp) {
+	uint32_t status = STATUS_SUCCESS;
+	int lease = 0;
+	time_t now = time(NULL);
+	memset(resp, 0, SUB_ACK_SIZE);
+
+	if (req[0] == REQ_UNSUBSCRIBE) {
+		// Come per l'iscrizione: un mittente falsificato non cancella
+		// le iscrizioni dell'indirizzo che impersona
+		if (reqlen != SUBSCRIBE_REQUEST_SIZE) {
+			status = STATUS_INVALID_REQUEST;
+		} else if (!sub_cookie_valid(client_addr, &req[68], now)) {
+			status = STATUS_COOKIE_REQUIRED;
+			sub_cookie(client_addr, now, &resp[8]);
+		} else {
+			sub_remove(client_addr);
+		}
+	} else if (reqlen != SUBSCRIBE_REQUEST_SIZE || (req[65] & ~0x0Fu) != 0) {
+		status = STATUS_INVALID_REQUEST;
+	} else {
+		char city[65];
+		extractcity(req, reqlen, city);
+		uint16_t citymask = 0xFFFFu >> (16 - CITY_COUNT);
+		if (city[0] != '\0') {
+			int idx = cityindex(city);
+			citymask = idx >= 0 ? (uint16_t)(1u << idx) : 0;
 		}
-		if (*a == '\0' && *b == '\0') {
-			return 0; // valida (case insensitive)
+		uint8_t typemask = req[65] ? req[65] : 0x0F;
+		uint16_t net_lease;
+		memcpy(&net_lease, &req[66], 2);
+		if (citymask == 0) {
+			status = STATUS_CITY_NOT_AVAILABLE;
+		} else if (!sub_cookie_valid(client_addr, &req[68], now)) {
+			// Mittente non ancora verificato: nessuno stato, solo il cookie
+			status = STATUS_COOKIE_REQUIRED;
+		} else if ((lease = sub_add(client_addr, citymask, typemask, ntohs(net_lease), now)) < 0) {
+			// Tabella piena: il client riproverà al prossimo rinnovo
+			status = STATUS_INVALID_REQUEST;
+			lease = 0;
 		}
+		sub_cookie(client_addr, now, &resp[8]);
 	}
-	return 2; // non valida
+
+	uint32_t net_status = htonl(status);
+	memcpy(resp, &net_status, 4);
+	resp[4] = req[0];
+	uint16_t net_granted = htons((uint16_t)lease);
+	memcpy(&resp[6], &net_granted, 2);
+	return SUB_ACK_SIZE;
 }
 
-// Funzione che combina validazione e generazione valore secondo specifica.
-weather_response_t build_weather_response(char type, const char *city) {
-	weather_response_t r;
-	r.status = STATUS_SUCCESS;
-	r.type = '\0';
-	r.value = 0.0f;
-
-	// Validazione type
-	if (type == '\0' || typecheck(type) != 0) {
-		// Richiesta non valida (tipo errato)
-		r.status = STATUS_INVALID_REQUEST;
-		return r;
-	}
-
-	// Validazione city
-	if (city == NULL || *city == '\0') {
-		// Città mancante: trattiamo come "non disponibile"
-		r.status = STATUS_CITY_NOT_AVAILABLE;
-		return r;
-	}
-	// Se la città contiene caratteri speciali vietati, la richiesta è
-	// considerata non valida (non "città non disponibile").
-	for (const char *p = city; *p != '\0'; ++p) {
-		if (*p == '@' || *p == '$' || *p == '%' || *p == '#') {
-			// Richiesta non valida per formato scorretto del campo città
-			r.status = STATUS_INVALID_REQUEST;
-			return r;
-		}
-	}
-	if (citycheck(city) != 0) {
-		// Città ben formata ma non disponibile nel database
-		r.status = STATUS_CITY_NOT_AVAILABLE;
-		return r;
-	}
-
-	// Generazione valore meteo
-	float value = 0.0f;
-	switch (type) {
-		case 't': value = get_temperature(); break;
-		case 'h': value = get_humidity(); break;
-		case 'w': value = get_wind(); break;
-		case 'p': value = get_pressure(); break;
-		default:
-			// fallback
-			r.status = STATUS_INVALID_REQUEST;
-			return r;
-	}
-
-	// Popolamento struttura in caso di successo
-	r.status = STATUS_SUCCESS;
-	r.type = type;
-	r.value = value;
-	return r;
+// Aggiornamento periodico: genera un nuovo valore per ogni città e misura
+// (registrato nello storico), elimina gli iscritti scaduti e invia loro i
+// valori cambiati.
+void weather_tick(int sock) {
+	static const char types[] = { 't', 'h', 'w', 'p' };
+	uint32_t now = (uint32_t)time(NULL);
+	for (int c = 0; c < CITY_COUNT; ++c) {
+		for (size_t t = 0; t < sizeof(types); ++t) {
+			history_record_now(c, types[t], generate_value(types[t]));
+		}
+	}
+	int expired = sub_expire((time_t)now);
+	if (expired > 0) {
+		printf("%d iscrizioni scadute rimosse.\n", expired);
+	}
+	if (sub_count() > 0) {
+		sub_push(sock);
+	}
 }
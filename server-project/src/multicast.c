@@ -0,0 +1,119 @@
+/*
+ * multicast.c
+ *
+ * Snapshot multicast: raccoglie l'ultimo valore di ogni città e misura e
+ * lo invia al gruppo in frammenti numerati (sequenza snapshot + indice
+ * frammento), così i ricevitori possono ricostruire la tabella e
+ * accorgersi di frammenti o snapshot persi.
+ */
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#define closesocket close
+#endif
+
+#include "multicast.h"
+#include "protocol.h"
+#include "history.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static uint32_t snapshot_seq = 0;
+
+int mcast_open(const char *group, int port, const char *ifaddr, struct sockaddr_in *dest) {
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		return -1;
+	}
+
+	memset(dest, 0, sizeof(*dest));
+	dest->sin_family = AF_INET;
+	dest->sin_port = htons((uint16_t)port);
+	dest->sin_addr.s_addr = inet_addr(group);
+	if (!IN_MULTICAST(ntohl(dest->sin_addr.s_addr))) {
+		closesocket(sock);
+		return -1;
+	}
+
+	// Interfaccia di uscita, loopback dei pacchetti verso i ricevitori
+	// locali e TTL 1 (lo snapshot non esce dalla rete locale)
+	struct in_addr iface;
+	iface.s_addr = inet_addr(ifaddr);
+	unsigned char loop = 1;
+	unsigned char ttl = 1;
+	if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, (const char *)&iface, sizeof(iface)) < 0
+			|| setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, (const char *)&loop, sizeof(loop)) < 0
+			|| setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char *)&ttl, sizeof(ttl)) < 0) {
+		closesocket(sock);
+		return -1;
+	}
+	return sock;
+}
+
+static void put16(unsigned char *dst, uint16_t v) {
+	v = htons(v);
+	memcpy(dst, &v, 2);
+}
+
+int mcast_publish(int sock, const struct sockaddr_in *dest, int max_payload) {
+	static const char types[HISTORY_TYPES] = { 't', 'h', 'w', 'p' };
+	unsigned char entries[CITY_COUNT * HISTORY_TYPES * PUSH_ENTRY_SIZE];
+	int total = 0;
+
+	for (int c = 0; c < CITY_COUNT; ++c) {
+		for (int t = 0; t < HISTORY_TYPES; ++t) {
+			float value;
+			uint32_t ts;
+			if (!history_latest(c, types[t], &value, &ts)) {
+				continue;
+			}
+			unsigned char *e = &entries[total * PUSH_ENTRY_SIZE];
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			bits = htonl(bits);
+			e[0] = (unsigned char)c;
+			e[1] = (unsigned char)types[t];
+			memcpy(&e[2], &bits, 4);
+			total++;
+		}
+	}
+
+	if (max_payload > BUFFER_SIZE * 4) {
+		max_payload = BUFFER_SIZE * 4;
+	}
+	int per_frag = (max_payload - SNAPSHOT_HEADER_SIZE) / PUSH_ENTRY_SIZE;
+	if (per_frag < 1) {
+		return -1;
+	}
+	int frags = total > 0 ? (total + per_frag - 1) / per_frag : 1;
+	uint32_t seq = snapshot_seq++;
+	unsigned char buf[BUFFER_SIZE * 4];
+
+	for (int f = 0; f < frags; ++f) {
+		int first = f * per_frag;
+		int n = total - first < per_frag ? total - first : per_frag;
+		uint32_t net_seq = htonl(seq);
+		buf[0] = SNAPSHOT_FRAGMENT;
+		buf[1] = 0;
+		memcpy(&buf[2], &net_seq, 4);
+		put16(&buf[6], (uint16_t)f);
+		put16(&buf[8], (uint16_t)frags);
+		put16(&buf[10], (uint16_t)first);
+		put16(&buf[12], (uint16_t)n);
+		put16(&buf[14], (uint16_t)total);
+		memcpy(&buf[SNAPSHOT_HEADER_SIZE], &entries[first * PUSH_ENTRY_SIZE], (size_t)n * PUSH_ENTRY_SIZE);
+		int len = SNAPSHOT_HEADER_SIZE + n * PUSH_ENTRY_SIZE;
+		if (sendto(sock, (const char *)buf, len, 0, (const struct sockaddr *)dest, (int)sizeof(*dest)) != len) {
+			return -1;
+		}
+	}
+	return frags;
+}
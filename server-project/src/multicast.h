@@ -0,0 +1,28 @@
+/*
+ * multicast.h
+ *
+ * Pubblicazione periodica dello snapshot completo (città x misure) su un
+ * gruppo multicast IPv4. Lo snapshot viene diviso in frammenti numerati
+ * quando supera la dimensione massima di un datagram.
+ */
+
+#ifndef MULTICAST_H_
+#define MULTICAST_H_
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#endif
+
+// Crea il socket di invio verso group:port, usando ifaddr come interfaccia
+// di uscita (es. "127.0.0.1" per il loopback). Restituisce il socket,
+// -1 in caso di errore.
+int mcast_open(const char *group, int port, const char *ifaddr, struct sockaddr_in *dest);
+
+// Pubblica uno snapshot dei valori correnti (dallo storico) in frammenti
+// da al più max_payload byte. Restituisce il numero di frammenti inviati,
+// -1 in caso di errore.
+int mcast_publish(int sock, const struct sockaddr_in *dest, int max_payload);
+
+#endif /* MULTICAST_H_ */
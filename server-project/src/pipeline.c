@@ -0,0 +1,277 @@
+/*
+ * pipeline.c
+ *
+ * Server a stadi: ricezione a lotti (recvmmsg) in slot presi dal pool,
+ * elaborazione con process_request sui lotti, invio a lotti (sendmmsg) e
+ * restituzione degli slot al pool. Ogni corsia ha tre thread e tre code
+ * SPSC: libera (invio -> ricezione), lavoro (ricezione -> elaborazione)
+ * e invio (elaborazione -> invio).
+ */
+
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#include "pipeline.h"
+
+#if defined(__linux__)
+
+#include "spsc_queue.h"
+#include "protocol.h"
+#include "auth.h"
+#include "capture.h"
+#include "diag.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+typedef struct {
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int reqlen;
+	int resplen;
+	unsigned char req[BUFFER_SIZE];
+	unsigned char resp[BUFFER_SIZE];
+} pipe_slot_t;
+
+typedef struct {
+	int sock;
+	pipe_slot_t slots[PIPE_POOL];
+	spsc_queue_t free_q, work_q, send_q;
+	void *free_items[PIPE_POOL], *work_items[PIPE_POOL], *send_items[PIPE_POOL];
+	pthread_t rx, worker, tx;
+	atomic_int rx_done, worker_done;
+	unsigned long long received, sent, batches;
+} pipe_lane_t;
+
+static pipe_lane_t *lanes_arr = NULL;
+static int lanes_count = 0;
+static atomic_int pipe_running = 0;
+
+static void *pipe_receiver(void *arg) {
+	pipe_lane_t *l = (pipe_lane_t *)arg;
+	pipe_slot_t *held[PIPE_BATCH];
+	int nheld = 0;
+	struct mmsghdr msgs[PIPE_BATCH];
+	struct iovec iov[PIPE_BATCH];
+
+	while (atomic_load_explicit(&pipe_running, memory_order_relaxed)) {
+		// Slot liberi dal pool; se esaurito si attende (backpressure)
+		nheld += spsc_pop_batch(&l->free_q, (void **)&held[nheld], PIPE_BATCH - nheld);
+		if (nheld == 0) {
+			spsc_wait(&l->free_q, 100);
+			continue;
+		}
+		memset(msgs, 0, sizeof(msgs[0]) * (size_t)nheld);
+		for (int i = 0; i < nheld; ++i) {
+			iov[i].iov_base = held[i]->req;
+			iov[i].iov_len = sizeof(held[i]->req);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &held[i]->addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(held[i]->addr);
+		}
+		int n = recvmmsg(l->sock, msgs, (unsigned)nheld, MSG_WAITFORONE, NULL);
+		if (n <= 0) {
+			continue; // timeout (SO_RCVTIMEO) o interruzione: si ricontrolla lo stato
+		}
+		// I datagram scartati dall'autenticazione non entrano nella
+		// pipeline: il loro slot resta alla ricezione
+		int kept = 0;
+		for (int i = 0; i < n; ++i) {
+			held[i]->reqlen = (int)msgs[i].msg_len;
+			held[i]->addrlen = msgs[i].msg_hdr.msg_namelen;
+			if (auth_enabled && (held[i]->reqlen = auth_verify(held[i]->req, held[i]->reqlen)) < 0) {
+				held[kept++] = held[i];
+				continue;
+			}
+			spsc_push(&l->work_q, held[i]); // mai piena: capacità = pool
+		}
+		l->received += (unsigned long long)n;
+		l->batches++;
+		memmove(&held[kept], &held[n], sizeof(held[0]) * (size_t)(nheld - n));
+		nheld -= n - kept;
+	}
+	// Gli slot trattenuti non servono più: il pool viene liberato allo stop
+	atomic_store(&l->rx_done, 1);
+	return NULL;
+}
+
+static void *pipe_worker(void *arg) {
+	pipe_lane_t *l = (pipe_lane_t *)arg;
+	pipe_slot_t *batch[PIPE_BATCH];
+
+	diag_register("pipeline");
+	for (;;) {
+		int n = spsc_pop_batch(&l->work_q, (void **)batch, PIPE_BATCH);
+		if (n == 0) {
+			if (atomic_load(&l->rx_done)) {
+				break; // ricezione terminata e coda svuotata
+			}
+			spsc_wait(&l->work_q, 100);
+			continue;
+		}
+		// Le richieste del lotto passano insieme dalla validazione vettoriale
+		const unsigned char *reqs[PIPE_BATCH];
+		unsigned char *resps[PIPE_BATCH];
+		int lens[PIPE_BATCH], resplens[PIPE_BATCH], pos[PIPE_BATCH];
+		int m = 0;
+		for (int i = 0; i < n; ++i) {
+			pipe_slot_t *s = batch[i];
+			unsigned char op = s->reqlen > 0 ? s->req[0] : 0;
+			if (op == REQ_SUBSCRIBE || op == REQ_UNSUBSCRIBE) {
+				// La tabella delle iscrizioni appartiene al loop principale:
+				// in modalità pipeline le iscrizioni non sono disponibili
+				uint32_t net_status = htonl(STATUS_INVALID_REQUEST);
+				memset(s->resp, 0, SUB_ACK_SIZE);
+				memcpy(s->resp, &net_status, 4);
+				s->resp[4] = op;
+				s->resplen = SUB_ACK_SIZE;
+				if (atomic_load(&capture_active)) {
+					capture_record(s->req, s->reqlen, s->resp, s->resplen);
+				}
+			} else {
+				reqs[m] = s->req;
+				lens[m] = s->reqlen;
+				resps[m] = s->resp;
+				pos[m++] = i;
+			}
+		}
+		diag_enter();
+		process_batch(reqs, lens, m, resps, sizeof(batch[0]->resp), resplens);
+		diag_leave();
+		for (int k = 0; k < m; ++k) {
+			batch[pos[k]]->resplen = resplens[k];
+		}
+		for (int i = 0; i < n; ++i) {
+			spsc_push(&l->send_q, batch[i]);
+		}
+	}
+	atomic_store(&l->worker_done, 1);
+	return NULL;
+}
+
+static void *pipe_sender(void *arg) {
+	pipe_lane_t *l = (pipe_lane_t *)arg;
+	pipe_slot_t *batch[PIPE_BATCH];
+	struct mmsghdr msgs[PIPE_BATCH];
+	struct iovec iov[PIPE_BATCH];
+
+	for (;;) {
+		int n = spsc_pop_batch(&l->send_q, (void **)batch, PIPE_BATCH);
+		if (n == 0) {
+			if (atomic_load(&l->worker_done)) {
+				break;
+			}
+			spsc_wait(&l->send_q, 100);
+			continue;
+		}
+		memset(msgs, 0, sizeof(msgs[0]) * (size_t)n);
+		for (int i = 0; i < n; ++i) {
+			iov[i].iov_base = batch[i]->resp;
+			iov[i].iov_len = (size_t)batch[i]->resplen;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &batch[i]->addr;
+			msgs[i].msg_hdr.msg_namelen = batch[i]->addrlen;
+		}
+		int done = 0;
+		while (done < n) {
+			int r = sendmmsg(l->sock, &msgs[done], (unsigned)(n - done), 0);
+			// Errore sul primo messaggio (es. destinazione non raggiungibile):
+			// lo si salta senza bloccare il resto del lotto
+			done += r > 0 ? r : 1;
+			l->sent += r > 0 ? (unsigned long long)r : 0;
+		}
+		for (int i = 0; i < n; ++i) {
+			spsc_push(&l->free_q, batch[i]);
+		}
+	}
+	return NULL;
+}
+
+int pipeline_start(int sock, int lanes) {
+	if (lanes <= 0 || lanes_arr != NULL) {
+		return -1;
+	}
+	// Timeout di ricezione: i receiver ricontrollano periodicamente lo stop
+	struct timeval tv = { 0, 200000 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	lanes_arr = (pipe_lane_t *)calloc((size_t)lanes, sizeof(pipe_lane_t));
+	if (lanes_arr == NULL) {
+		return -1;
+	}
+	lanes_count = lanes;
+	atomic_store(&pipe_running, 1);
+	for (int i = 0; i < lanes; ++i) {
+		pipe_lane_t *l = &lanes_arr[i];
+		l->sock = sock;
+		spsc_init(&l->free_q, l->free_items, PIPE_POOL);
+		spsc_init(&l->work_q, l->work_items, PIPE_POOL);
+		spsc_init(&l->send_q, l->send_items, PIPE_POOL);
+		for (int k = 0; k < PIPE_POOL; ++k) {
+			spsc_push(&l->free_q, &l->slots[k]);
+		}
+		int created = 0;
+		if (pthread_create(&l->rx, NULL, pipe_receiver, l) == 0) {
+			created++;
+			if (pthread_create(&l->worker, NULL, pipe_worker, l) == 0) {
+				created++;
+				if (pthread_create(&l->tx, NULL, pipe_sender, l) == 0) {
+					created++;
+				}
+			}
+		}
+		if (created < 3) {
+			// Avvio parziale: si fermano la corsia corrente e quelle già create
+			atomic_store(&pipe_running, 0);
+			atomic_store(&l->rx_done, 1);
+			atomic_store(&l->worker_done, 1);
+			if (created > 0) {
+				pthread_join(l->rx, NULL);
+			}
+			if (created > 1) {
+				pthread_join(l->worker, NULL);
+			}
+			lanes_count = i;
+			pipeline_stop();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void pipeline_stop(void) {
+	if (lanes_arr == NULL) {
+		return;
+	}
+	atomic_store(&pipe_running, 0);
+	for (int i = 0; i < lanes_count; ++i) {
+		pipe_lane_t *l = &lanes_arr[i];
+		pthread_join(l->rx, NULL);
+		pthread_join(l->worker, NULL);
+		pthread_join(l->tx, NULL);
+		printf("Corsia %d: %llu richieste ricevute in %llu lotti, %llu risposte inviate\n",
+				i, l->received, l->batches, l->sent);
+	}
+	free(lanes_arr);
+	lanes_arr = NULL;
+	lanes_count = 0;
+}
+
+#else
+
+int pipeline_start(int sock, int lanes) {
+	(void)sock;
+	(void)lanes;
+	return -1;
+}
+
+void pipeline_stop(void) {
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * pipeline.h
+ *
+ * Modalità server a pipeline (alternativa al loop run-to-completion di
+ * handleclientconnection): per ogni corsia un thread di ricezione, uno di
+ * elaborazione e uno di invio, collegati da code SPSC limitate. Gli slot
+ * di richiesta sono preallocati in un pool per corsia: quando il pool è
+ * esaurito la ricezione si ferma (backpressure verso il kernel).
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#define PIPE_POOL  256 // slot per corsia (potenza di 2)
+#define PIPE_BATCH 32  // datagram per recvmmsg/sendmmsg
+
+// Avvia lanes corsie sul socket UDP già in bind. Restituisce 0 in caso di
+// successo, -1 in caso di errore o piattaforma non supportata.
+int pipeline_start(int sock, int lanes);
+
+// Ferma i thread (dopo aver svuotato le code) e stampa le statistiche.
+void pipeline_stop(void);
+
+#endif /* PIPELINE_H_ */
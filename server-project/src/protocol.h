@@ -8,18 +8,135 @@
 #ifndef PROTOCOL_H_
 #define PROTOCOL_H_
 
+#include <stddef.h> // size_t nei prototipi
+
 // Shared application parameters (unified client/server constants)
 #define SERVER_PORT  56700         // Default server port
 #define SERVER_IP   "127.0.0.1"    // Default server IP (override in runtime if needed)
 #define BUFFER_SIZE 512            // Generic buffer size
 #define QUEUE_SIZE  5              // Pending connections queue size (server only)
 #define QLEN 6
+#define TICK_MS     1000           // Periodo di aggiornamento valori e push (server only)
 
 // Status codes (shared)
 #define STATUS_SUCCESS            0u
 #define STATUS_CITY_NOT_AVAILABLE 1u
 #define STATUS_INVALID_REQUEST    2u
 
+// Dimensione della richiesta standard (1 byte tipo + 64 byte città)
+#define REQUEST_SIZE 65
+// Dimensione della risposta standard (4 byte status + 1 tipo + 4 float)
+#define RESPONSE_SIZE 9
+
+// Richieste estese: il primo byte è un opcode non alfabetico, quindi non
+// collide con i tipi 't','h','w','p' (né con le loro maiuscole)
+#define REQ_HISTORY     0x01       // storico campioni per città e misura
+#define REQ_SUBSCRIBE   0x02       // iscrizione agli aggiornamenti push
+#define REQ_UNSUBSCRIBE 0x03       // cancellazione di tutte le iscrizioni del mittente
+#define REQ_COMPACT     0x04       // misure in virgola fissa, unità e precisione negoziate
+#define PUSH_UPDATE     0x82       // datagram push server -> client
+#define SNAPSHOT_FRAGMENT 0x83     // frammento di snapshot multicast
+
+// Elenco condiviso delle città: le posizioni sono gli indici usati nei
+// datagram push (client e server devono usare lo stesso ordine).
+#define CITY_COUNT 10
+#define CITY_NAMES { "Bari","Roma","Milano","Napoli","Torino", \
+		"Palermo","Genova","Bologna","Firenze","Venezia" }
+
+// Richiesta storico (75 byte):
+//   [0] REQ_HISTORY, [1..64] città, [65] tipo misura, [66] modalità,
+//   [67..70] from (uint32 unix time, network order, 0 = nessun limite),
+//   [71..74] to   (uint32 unix time, network order, 0 = fino ad ora)
+// Risposta:
+//   [0..3] status, [4] tipo, [5] modalità, [6..7] numero campioni (uint16)
+//   HIST_MODE_RANGE: per ogni campione 4 byte ts + 4 byte float
+//   HIST_MODE_AGGR:  4 byte min + 4 byte max + 4 byte media (float)
+#define HISTORY_REQUEST_SIZE 75
+#define HISTORY_MAX_SAMPLES  60     // campioni conservati (entra in BUFFER_SIZE)
+#define HIST_MODE_RANGE 0u
+#define HIST_MODE_AGGR  1u
+
+// Iscrizione (76 byte):
+//   [0] REQ_SUBSCRIBE, [1..64] città (vuota = tutte), [65] maschera tipi
+//   (SUB_TYPE_*, 0 = tutti), [66..67] lease richiesto in secondi (uint16),
+//   [68..75] cookie dell'ultima conferma (zeri al primo invio)
+// Cancellazione (76 byte): [0] REQ_UNSUBSCRIBE, [1..67] ignorati,
+//   [68..75] cookie dell'ultima conferma
+// Conferma (16 byte): [0..3] status, [4] opcode, [5] riservato,
+//   [6..7] lease concesso in secondi (uint16), [8..15] cookie
+// Verifica del mittente: un'iscrizione si attiva o si rinnova, e una
+//   cancellazione ha effetto, solo se porta il cookie che il server ha
+//   inviato al suo indirizzo; altrimenti
+//   la conferma ha STATUS_COOKIE_REQUIRED, lease 0 e il cookie da
+//   rimandare. Un mittente falsificato non riceve il cookie e non può
+//   attivare push verso terzi, e la conferma è più corta della richiesta.
+//   Il cookie vale da SUB_COOKIE_PERIOD a 2 * SUB_COOKIE_PERIOD secondi e
+//   ogni conferma positiva ne porta uno nuovo.
+// Push: [0] PUSH_UPDATE, [1] numero voci, [2..5] sequenza (uint32), poi per
+//   ogni voce [0] indice città, [1] tipo, [2..5] float (network order)
+#define SUBSCRIBE_REQUEST_SIZE 76
+#define SUB_ACK_SIZE           16
+#define SUB_COOKIE_SIZE        8
+#define SUB_COOKIE_PERIOD      120    // secondi
+#define STATUS_COOKIE_REQUIRED 3u     // solo nelle conferme di iscrizione e cancellazione
+#define PUSH_HEADER_SIZE       6
+#define PUSH_ENTRY_SIZE        6
+#define SUB_TYPE_T 0x01u
+#define SUB_TYPE_H 0x02u
+#define SUB_TYPE_W 0x04u
+#define SUB_TYPE_P 0x08u
+#define SUB_LEASE_DEFAULT 30       // secondi
+#define SUB_LEASE_MAX     300
+
+// Richiesta compatta (66 + 2n byte):
+//   [0] REQ_COMPACT, [1..64] città, [65] numero misure n (1..COMPACT_MAX_ITEMS),
+//   poi per ogni misura [0] tipo, [1] formato richiesto
+// Formato: unità (UNIT_*) nei 4 bit bassi, cifre decimali nei 4 alti;
+//   UNIT_DEFAULT è l'unità base della misura (°C, %, km/h, hPa). Il server
+//   concede al più le cifre che entrano in un int16 per l'intervallo della
+//   misura (2 per °C, °F, %, km/h; 1 per hPa; 3 per m/s e inHg).
+// Risposta (2 + 4n byte): [0] status, [1] n, poi per ogni misura [0] tipo,
+//   [1] formato concesso (unità esplicita), [2..3] valore × 10^decimali
+//   (int16, network order). Misure dello stesso tipo condividono il
+//   campione. In caso di errore n = 0.
+#define COMPACT_MAX_ITEMS 8
+#define COMPACT_REQUEST_SIZE(n)  (66 + 2 * (n))
+#define COMPACT_RESPONSE_SIZE(n) (2 + 4 * (n))
+#define COMPACT_FMT(unit, dec) (unsigned char)(((dec) << 4) | (unit))
+#define COMPACT_UNIT(fmt) ((fmt) & 0x0Fu)
+#define COMPACT_DEC(fmt)  (((fmt) >> 4) & 0x0Fu)
+#define UNIT_DEFAULT    0u
+#define UNIT_CELSIUS    1u
+#define UNIT_FAHRENHEIT 2u
+#define UNIT_PERCENT    3u
+#define UNIT_KMH        4u
+#define UNIT_MS         5u
+#define UNIT_HPA        6u
+#define UNIT_INHG       7u
+#define UNIT_COUNT      8
+
+// Snapshot multicast di tutte le città e misure, diviso in frammenti:
+//   [0] SNAPSHOT_FRAGMENT, [1] riservato, [2..5] sequenza snapshot (uint32),
+//   [6..7] indice frammento, [8..9] numero frammenti, [10..11] indice della
+//   prima voce, [12..13] voci nel frammento, [14..15] voci totali (uint16),
+//   poi voci da PUSH_ENTRY_SIZE byte come nei datagram push.
+#define SNAPSHOT_HEADER_SIZE 16
+#define MCAST_GROUP   "239.255.0.1" // gruppo di default (administratively scoped)
+#define MCAST_PORT    56701
+#define MCAST_PAYLOAD 1400          // dimensione massima di un frammento (sotto MTU)
+
+// Modalità autenticata (server avviato con -K, client con -k): ogni
+// datagram di richiesta è seguito da un trailer di 24 byte
+//   [0..3] key id (uint32), [4..7] istante di invio (uint32 unix time),
+//   [8..15] contatore (uint64, crescente per chiave), [16..23] MAC
+//   SipHash-2-4 (siphash.h) della richiesta e dei primi 16 byte del trailer
+// (interi in network order). Il server scarta in silenzio, prima di ogni
+// altra elaborazione, i datagram con MAC errato, istante fuori tolleranza
+// o contatore già visto; le risposte restano invariate.
+#define AUTH_TRAILER_SIZE 24
+#define AUTH_MAC_OFFSET   16       // byte del trailer coperti dal MAC
+#define AUTH_MAX_SKEW     30       // secondi di scarto ammessi sull'istante
+
 // Client request structure (binary protocol: 1 byte type + 64 bytes city when sent)
 typedef struct {
     char type;       // 't','h','w','p'
@@ -38,6 +155,20 @@ int handleclientconnection(int client_socket, const char *client_ip);
 float typecheck(char type);
 char citycheck(const char *city);
 weather_response_t build_weather_response(char type, const char *city);
+int serialize_weather_response(const weather_response_t *r, unsigned char *resp);
+int cityindex(const char *city);
+void extractcity(const unsigned char *reqbuf, int rcvd, char city[65]);
+float generate_value(char type);
+int process_request(const unsigned char *req, int reqlen, unsigned char *resp, size_t respcap);
+void process_batch(const unsigned char *const *req, const int *lens, int n,
+		unsigned char *const *resp, size_t respcap, int *resplens);
+int build_history_response(const unsigned char *req, int reqlen, unsigned char *resp, size_t respcap);
+struct sockaddr_in;
+int build_subscribe_response(const unsigned char *req, int reqlen,
+		const struct sockaddr_in *client_addr, unsigned char *resp);
+void weather_tick(int sock);
+void weather_warmup(void);
+long long now_ms(void);
 
 // Data generation (shared)
 float get_temperature(void);    // Range: -10.0 .. 40.0 °C
@@ -45,6 +176,4 @@ float get_humidity(void);       // Range: 20.0 .. 100.0 %
 float get_wind(void);           // Range: 0.0 .. 100.0 km/h
 float get_pressure(void);       // Range: 950.0 .. 1050.0 hPa
 
-static int my_inet_pton(int af, const char *src, void *dst);
-
 #endif /* PROTOCOL_H_ */
@@ -0,0 +1,127 @@
+/*
+ * shm_ring.h
+ *
+ * Trasporto locale su memoria condivisa (solo Linux). La regione contiene
+ * SHM_SLOTS slot, uno per client: ogni slot ha due ring SPSC (richieste
+ * client -> server e risposte server -> client) che trasportano gli stessi
+ * datagram del protocollo UDP. Le attese usano i futex sulla memoria
+ * condivisa, con wake solo se il consumatore sta dormendo.
+ *
+ * Il file è identico nel client e nel server (come protocol.h).
+ */
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#if defined(__linux__)
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define SHM_MAGIC    0x57534852u // "WSHR"
+#define SHM_VERSION  1u
+#define SHM_SLOTS    16
+#define SHM_RING_CAP 16          // messaggi per ring (potenza di 2)
+#define SHM_MSG_MAX  512         // = BUFFER_SIZE
+
+// Stati di uno slot
+#define SHM_SLOT_FREE 0u
+#define SHM_SLOT_INIT 1u
+#define SHM_SLOT_BUSY 2u
+
+typedef struct {
+	_Atomic uint32_t head;     // prossima posizione scritta dal produttore
+	_Atomic uint32_t tail;     // prossima posizione letta dal consumatore
+	_Atomic uint32_t sleeping; // 1 se il consumatore è in futex_wait su head
+	struct {
+		uint32_t len;
+		unsigned char data[SHM_MSG_MAX];
+	} msg[SHM_RING_CAP];
+} shm_ring_t;
+
+typedef struct {
+	_Atomic uint32_t state;    // SHM_SLOT_*
+	_Atomic int32_t owner;     // pid del client proprietario
+	shm_ring_t req;            // client -> server
+	shm_ring_t resp;           // server -> client
+} shm_slot_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	_Atomic uint32_t doorbell; // incrementato a ogni richiesta: futex del server
+	_Atomic uint32_t server_sleeping;
+	shm_slot_t slot[SHM_SLOTS];
+} shm_region_t;
+
+static inline long shm_futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *timeout) {
+	return syscall(SYS_futex, (uint32_t *)addr, op, val, timeout, NULL, 0);
+}
+
+// Inserisce un messaggio; restituisce 0, -1 se il ring è pieno o len eccessiva
+static inline int shm_ring_push(shm_ring_t *r, const void *data, uint32_t len) {
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	if (head - tail >= SHM_RING_CAP || len > SHM_MSG_MAX) {
+		return -1;
+	}
+	memcpy(r->msg[head % SHM_RING_CAP].data, data, len);
+	r->msg[head % SHM_RING_CAP].len = len;
+	atomic_store_explicit(&r->head, head + 1, memory_order_seq_cst);
+	if (atomic_load_explicit(&r->sleeping, memory_order_seq_cst)) {
+		shm_futex(&r->head, FUTEX_WAKE, 1, NULL);
+	}
+	return 0;
+}
+
+// Estrae un messaggio; restituisce la lunghezza, -1 se il ring è vuoto
+static inline int shm_ring_pop(shm_ring_t *r, void *data, uint32_t cap) {
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	if (head == tail) {
+		return -1;
+	}
+	uint32_t len = r->msg[tail % SHM_RING_CAP].len;
+	if (len > cap) {
+		len = cap;
+	}
+	memcpy(data, r->msg[tail % SHM_RING_CAP].data, len);
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+	return (int)len;
+}
+
+// Attende che il ring non sia vuoto: breve attesa attiva, poi futex.
+// Restituisce 0 se ci sono messaggi, -1 allo scadere di timeout_ms.
+static inline int shm_ring_wait(shm_ring_t *r, int timeout_ms) {
+	for (int spin = 0; spin < 2000; ++spin) {
+		if (atomic_load_explicit(&r->head, memory_order_acquire) != atomic_load_explicit(&r->tail, memory_order_relaxed)) {
+			return 0;
+		}
+	}
+	struct timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	atomic_store_explicit(&r->sleeping, 1, memory_order_seq_cst);
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_seq_cst);
+	if (head == tail) {
+		shm_futex(&r->head, FUTEX_WAIT, head, &ts);
+	}
+	atomic_store_explicit(&r->sleeping, 0, memory_order_relaxed);
+	return atomic_load_explicit(&r->head, memory_order_acquire) != tail ? 0 : -1;
+}
+
+static inline void shm_ring_reset(shm_ring_t *r) {
+	atomic_store(&r->head, 0);
+	atomic_store(&r->tail, 0);
+	atomic_store(&r->sleeping, 0);
+}
+
+#endif /* __linux__ */
+
+#endif /* SHM_RING_H_ */
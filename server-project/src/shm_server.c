@@ -0,0 +1,131 @@
+/*
+ * shm_server.c
+ *
+ * Thread di servizio del trasporto su memoria condivisa: scandisce i ring
+ * di richiesta degli slot occupati, costruisce le risposte con la stessa
+ * codifica del percorso UDP e dorme sul futex "doorbell" quando non c'è
+ * lavoro.
+ */
+
+#include "shm_server.h"
+
+#if defined(__linux__)
+
+#include "shm_ring.h"
+#include "protocol.h"
+#include "auth.h"
+#include "diag.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static shm_region_t *region = NULL;
+static char region_name[64];
+static pthread_t shm_thread;
+static atomic_int shm_running = 0;
+
+static void *shm_serve(void *arg) {
+	(void)arg;
+	unsigned char req[SHM_MSG_MAX];
+	unsigned char resp[SHM_MSG_MAX];
+
+	diag_register("shm");
+	while (atomic_load(&shm_running)) {
+		uint32_t bell = atomic_load(&region->doorbell);
+		int served = 0;
+		for (int i = 0; i < SHM_SLOTS; ++i) {
+			shm_slot_t *s = &region->slot[i];
+			if (atomic_load_explicit(&s->state, memory_order_acquire) != SHM_SLOT_BUSY) {
+				continue;
+			}
+			int len;
+			while ((len = shm_ring_pop(&s->req, req, sizeof(req))) >= 0) {
+				if (auth_enabled && (len = auth_verify(req, len)) < 0) {
+					continue; // non autenticato: nessuna risposta
+				}
+				diag_enter();
+				int rlen = process_request(req, len, resp, sizeof(resp));
+				diag_leave();
+				// Ring di risposta pieno: il client non sta leggendo, si scarta
+				shm_ring_push(&s->resp, resp, (uint32_t)rlen);
+				served++;
+			}
+		}
+		if (served == 0) {
+			// Nessuna richiesta: dorme finché un client suona il doorbell
+			struct timespec timeout = { 1, 0 };
+			atomic_store(&region->server_sleeping, 1);
+			if (atomic_load(&region->doorbell) == bell) {
+				shm_futex(&region->doorbell, FUTEX_WAIT, bell, &timeout);
+			}
+			atomic_store(&region->server_sleeping, 0);
+		}
+	}
+	return NULL;
+}
+
+int shm_server_start(const char *name) {
+	snprintf(region_name, sizeof(region_name), "/%s", name);
+	shm_unlink(region_name); // regione residua di un'esecuzione precedente
+	int fd = shm_open(region_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(shm_region_t)) < 0) {
+		close(fd);
+		shm_unlink(region_name);
+		return -1;
+	}
+	void *p = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(region_name);
+		return -1;
+	}
+	region = (shm_region_t *)p;
+	region->version = SHM_VERSION;
+	atomic_store(&region->doorbell, 0);
+	// magic scritto per ultimo: i client lo verificano prima di usare la regione
+	atomic_thread_fence(memory_order_release);
+	region->magic = SHM_MAGIC;
+
+	atomic_store(&shm_running, 1);
+	if (pthread_create(&shm_thread, NULL, shm_serve, NULL) != 0) {
+		atomic_store(&shm_running, 0);
+		shm_server_stop(0);
+		return -1;
+	}
+	return 0;
+}
+
+void shm_server_stop(int keep_name) {
+	if (region == NULL) {
+		return;
+	}
+	if (atomic_exchange(&shm_running, 0)) {
+		atomic_fetch_add(&region->doorbell, 1);
+		shm_futex(&region->doorbell, FUTEX_WAKE, 1, NULL);
+		pthread_join(shm_thread, NULL);
+	}
+	munmap(region, sizeof(shm_region_t));
+	region = NULL;
+	if (!keep_name) {
+		shm_unlink(region_name);
+	}
+}
+
+#else
+
+int shm_server_start(const char *name) {
+	(void)name;
+	return -1;
+}
+
+void shm_server_stop(int keep_name) {
+	(void)keep_name;
+}
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * shm_server.h
+ *
+ * Lato server del trasporto su memoria condivisa (vedi shm_ring.h):
+ * un thread dedicato serve le richieste di tutti gli slot occupati.
+ */
+
+#ifndef SHM_SERVER_H_
+#define SHM_SERVER_H_
+
+// Crea la regione condivisa /name e avvia il thread di servizio.
+// Restituisce 0 in caso di successo, -1 in caso di errore (o se la
+// piattaforma non supporta il trasporto).
+int shm_server_start(const char *name);
+
+// Ferma il thread e rimuove la regione condivisa; con keep_name il nome
+// resta (dopo un riavvio a caldo appartiene alla nuova generazione).
+void shm_server_stop(int keep_name);
+
+#endif /* SHM_SERVER_H_ */
@@ -0,0 +1,89 @@
+/*
+ * spsc_queue.h
+ *
+ * Coda limitata lock-free a singolo produttore e singolo consumatore, di
+ * puntatori, usata per collegare gli stadi del server a pipeline. Il
+ * consumatore in attesa dorme su un futex (solo Linux) e il produttore lo
+ * sveglia soltanto se sta effettivamente dormendo.
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#if defined(__linux__)
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+typedef struct {
+	// Indici su linee di cache distinte per evitare false sharing
+	_Atomic uint32_t head;     // scritto dal produttore
+	char pad_head[60];
+	_Atomic uint32_t tail;     // scritto dal consumatore
+	char pad_tail[60];
+	_Atomic uint32_t sleeping; // 1 se il consumatore è in futex_wait
+	uint32_t mask;             // capacità - 1 (capacità potenza di 2)
+	void **items;
+} spsc_queue_t;
+
+static inline void spsc_init(spsc_queue_t *q, void **storage, uint32_t capacity) {
+	atomic_store(&q->head, 0);
+	atomic_store(&q->tail, 0);
+	atomic_store(&q->sleeping, 0);
+	q->mask = capacity - 1;
+	q->items = storage;
+}
+
+// Restituisce 0, -1 se la coda è piena
+static inline int spsc_push(spsc_queue_t *q, void *item) {
+	uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&q->tail, memory_order_acquire) > q->mask) {
+		return -1;
+	}
+	q->items[head & q->mask] = item;
+	atomic_store_explicit(&q->head, head + 1, memory_order_seq_cst);
+	if (atomic_load_explicit(&q->sleeping, memory_order_seq_cst)) {
+		syscall(SYS_futex, (uint32_t *)&q->head, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+	return 0;
+}
+
+// Estrae fino a max elementi; restituisce quanti ne ha estratti
+static inline int spsc_pop_batch(spsc_queue_t *q, void **out, int max) {
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	uint32_t avail = atomic_load_explicit(&q->head, memory_order_acquire) - tail;
+	int n = avail < (uint32_t)max ? (int)avail : max;
+	for (int i = 0; i < n; ++i) {
+		out[i] = q->items[(tail + (uint32_t)i) & q->mask];
+	}
+	atomic_store_explicit(&q->tail, tail + (uint32_t)n, memory_order_release);
+	return n;
+}
+
+// Attende che la coda non sia vuota (breve attesa attiva, poi futex) o lo
+// scadere di timeout_ms; il chiamante ricontrolla con spsc_pop_batch.
+static inline void spsc_wait(spsc_queue_t *q, int timeout_ms) {
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	for (int spin = 0; spin < 1000; ++spin) {
+		if (atomic_load_explicit(&q->head, memory_order_acquire) != tail) {
+			return;
+		}
+	}
+	struct timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+	atomic_store_explicit(&q->sleeping, 1, memory_order_seq_cst);
+	uint32_t head = atomic_load_explicit(&q->head, memory_order_seq_cst);
+	if (head == tail) {
+		syscall(SYS_futex, (uint32_t *)&q->head, FUTEX_WAIT_PRIVATE, head, &ts, NULL, 0);
+	}
+	atomic_store_explicit(&q->sleeping, 0, memory_order_relaxed);
+}
+
+#endif /* __linux__ */
+
+#endif /* SPSC_QUEUE_H_ */
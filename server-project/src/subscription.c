@@ -0,0 +1,208 @@
+/*
+ * subscription.c
+ *
+ * Gestione delle iscrizioni push: tabella a dimensione fissa, scadenza
+ * dei lease e invio a lotti (più città per datagram) dei valori cambiati.
+ * I cookie di verifica sono un MAC SipHash di indirizzo, porta e
+ * intervallo di SUB_COOKIE_PERIOD secondi, con una chiave scelta all'avvio:
+ * il server non conserva stato per i mittenti non verificati.
+ */
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+#include "subscription.h"
+#include "protocol.h"
+#include "history.h"
+#include "siphash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char sub_types[HISTORY_TYPES] = { 't', 'h', 'w', 'p' };
+
+typedef struct {
+	int used;
+	struct sockaddr_in addr;
+	uint16_t citymask;  // bit i = città i di CITY_NAMES
+	uint8_t typemask;   // SUB_TYPE_*
+	time_t expires;
+	uint32_t seq;       // sequenza dei datagram push verso questo client
+	// Ultimo valore inviato per (città, tipo), per rilevare i cambiamenti
+	uint8_t sent[CITY_COUNT][HISTORY_TYPES];
+	float last_value[CITY_COUNT][HISTORY_TYPES];
+	uint32_t last_ts[CITY_COUNT][HISTORY_TYPES];
+} subscription_t;
+
+static subscription_t subs[SUB_MAX];
+static unsigned char cookie_key[SIPHASH_KEY_SIZE];
+
+void sub_init(void) {
+	size_t got = 0;
+#if !defined(_WIN32)
+	FILE *f = fopen("/dev/urandom", "rb");
+	if (f != NULL) {
+		got = fread(cookie_key, 1, sizeof(cookie_key), f);
+		fclose(f);
+	}
+#endif
+	// Senza sorgente di sistema si ripiega su rand(), già inizializzato
+	for (; got < sizeof(cookie_key); ++got) {
+		cookie_key[got] = (unsigned char)rand();
+	}
+}
+
+static uint64_t cookie_mac(const struct sockaddr_in *addr, uint32_t period) {
+	unsigned char msg[10];
+	memcpy(msg, &addr->sin_addr.s_addr, 4);
+	memcpy(&msg[4], &addr->sin_port, 2);
+	memcpy(&msg[6], &period, 4);
+	return siphash24(cookie_key, msg, sizeof(msg));
+}
+
+void sub_cookie(const struct sockaddr_in *addr, time_t now, unsigned char *out) {
+	uint64_t mac = cookie_mac(addr, (uint32_t)(now / SUB_COOKIE_PERIOD));
+	memcpy(out, &mac, SUB_COOKIE_SIZE);
+}
+
+int sub_cookie_valid(const struct sockaddr_in *addr, const unsigned char *cookie, time_t now) {
+	uint32_t period = (uint32_t)(now / SUB_COOKIE_PERIOD);
+	uint64_t c;
+	memcpy(&c, cookie, SUB_COOKIE_SIZE);
+	return c == cookie_mac(addr, period) || c == cookie_mac(addr, period - 1);
+}
+
+static int sameaddr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static subscription_t *sub_find(const struct sockaddr_in *addr) {
+	for (int i = 0; i < SUB_MAX; ++i) {
+		if (subs[i].used && sameaddr(&subs[i].addr, addr)) {
+			return &subs[i];
+		}
+	}
+	return NULL;
+}
+
+int sub_add(const struct sockaddr_in *addr, uint16_t citymask, uint8_t typemask,
+		int lease, time_t now) {
+	if (lease <= 0) {
+		lease = SUB_LEASE_DEFAULT;
+	} else if (lease > SUB_LEASE_MAX) {
+		lease = SUB_LEASE_MAX;
+	}
+	subscription_t *s = sub_find(addr);
+	if (s == NULL) {
+		for (int i = 0; i < SUB_MAX && s == NULL; ++i) {
+			if (!subs[i].used) {
+				s = &subs[i];
+			}
+		}
+		if (s == NULL) {
+			return -1;
+		}
+		memset(s, 0, sizeof(*s));
+		s->used = 1;
+		s->addr = *addr;
+	}
+	s->citymask |= citymask;
+	s->typemask |= typemask;
+	s->expires = now + lease;
+	return lease;
+}
+
+int sub_remove(const struct sockaddr_in *addr) {
+	subscription_t *s = sub_find(addr);
+	if (s == NULL) {
+		return 0;
+	}
+	s->used = 0;
+	return 1;
+}
+
+int sub_expire(time_t now) {
+	int removed = 0;
+	for (int i = 0; i < SUB_MAX; ++i) {
+		if (subs[i].used && subs[i].expires <= now) {
+			subs[i].used = 0;
+			removed++;
+		}
+	}
+	return removed;
+}
+
+int sub_count(void) {
+	int n = 0;
+	for (int i = 0; i < SUB_MAX; ++i) {
+		n += subs[i].used;
+	}
+	return n;
+}
+
+static int sub_flush(int sock, subscription_t *s, unsigned char *buf, int count) {
+	buf[0] = PUSH_UPDATE;
+	buf[1] = (unsigned char)count;
+	uint32_t net_seq = htonl(s->seq++);
+	memcpy(&buf[2], &net_seq, 4);
+	int len = PUSH_HEADER_SIZE + count * PUSH_ENTRY_SIZE;
+	int sent = sendto(sock, (const char *)buf, len, 0,
+			(const struct sockaddr *)&s->addr, (int)sizeof(s->addr));
+	return sent == len ? 1 : 0;
+}
+
+int sub_push(int sock) {
+	unsigned char buf[BUFFER_SIZE];
+	const int max_entries = (BUFFER_SIZE - PUSH_HEADER_SIZE) / PUSH_ENTRY_SIZE;
+	int datagrams = 0;
+
+	for (int i = 0; i < SUB_MAX; ++i) {
+		subscription_t *s = &subs[i];
+		if (!s->used) {
+			continue;
+		}
+		int count = 0;
+		for (int c = 0; c < CITY_COUNT; ++c) {
+			if (!(s->citymask & (1u << c))) {
+				continue;
+			}
+			for (int t = 0; t < HISTORY_TYPES; ++t) {
+				float value;
+				uint32_t ts;
+				if (!(s->typemask & (1u << t)) || !history_latest(c, sub_types[t], &value, &ts)) {
+					continue;
+				}
+				if (s->sent[c][t] && s->last_ts[c][t] == ts && s->last_value[c][t] == value) {
+					continue; // invariato dall'ultimo push
+				}
+				s->sent[c][t] = 1;
+				s->last_value[c][t] = value;
+				s->last_ts[c][t] = ts;
+
+				unsigned char *e = &buf[PUSH_HEADER_SIZE + count * PUSH_ENTRY_SIZE];
+				uint32_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				bits = htonl(bits);
+				e[0] = (unsigned char)c;
+				e[1] = (unsigned char)sub_types[t];
+				memcpy(&e[2], &bits, 4);
+				if (++count == max_entries) {
+					datagrams += sub_flush(sock, s, buf, count);
+					count = 0;
+				}
+			}
+		}
+		if (count > 0) {
+			datagrams += sub_flush(sock, s, buf, count);
+		}
+	}
+	return datagrams;
+}
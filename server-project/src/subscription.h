@@ -0,0 +1,55 @@
+/*
+ * subscription.h
+ *
+ * Tabella delle iscrizioni push, indicizzata per indirizzo del client.
+ * Ogni iscrizione ha un lease: se il client non la rinnova entro la
+ * scadenza viene rimossa automaticamente. Attivazioni e rinnovi
+ * richiedono il cookie di verifica del mittente (vedi protocol.h).
+ */
+
+#ifndef SUBSCRIPTION_H_
+#define SUBSCRIPTION_H_
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#endif
+
+#include <stdint.h>
+#include <time.h>
+
+#define SUB_MAX 64 // iscritti contemporanei
+
+// Sceglie la chiave segreta dei cookie; da chiamare all'avvio.
+void sub_init(void);
+
+// Cookie per addr nell'intervallo corrente (SUB_COOKIE_SIZE byte in out)
+void sub_cookie(const struct sockaddr_in *addr, time_t now, unsigned char *out);
+
+// Diverso da zero se cookie è stato emesso per addr nell'intervallo
+// corrente o nel precedente.
+int sub_cookie_valid(const struct sockaddr_in *addr, const unsigned char *cookie, time_t now);
+
+// Aggiunge (o rinnova) l'iscrizione di addr. Le maschere di città e tipi
+// si sommano a quelle già presenti. Restituisce il lease concesso in
+// secondi, -1 se la tabella è piena.
+int sub_add(const struct sockaddr_in *addr, uint16_t citymask, uint8_t typemask,
+		int lease, time_t now);
+
+// Rimuove l'iscrizione di addr; restituisce 1 se era presente.
+int sub_remove(const struct sockaddr_in *addr);
+
+// Rimuove le iscrizioni con lease scaduto; restituisce quante ne ha rimosse.
+int sub_expire(time_t now);
+
+// Numero di iscrizioni attive
+int sub_count(void);
+
+// Invia a ogni iscritto, in datagram PUSH_UPDATE a più voci, i valori
+// correnti (dallo storico) cambiati dall'ultimo invio.
+// Restituisce il numero di datagram inviati; un invio fallito verso un
+// iscritto non interrompe il push verso gli altri.
+int sub_push(int sock);
+
+#endif /* SUBSCRIPTION_H_ */
@@ -0,0 +1,114 @@
+/*
+ * units.c
+ *
+ * Tabelle di conversione in virgola fissa (vedi units.h). Le voci sono
+ * espressioni costanti espanse dal preprocessore per ogni indice grezzo:
+ * nessun calcolo in virgola mobile né inizializzazione a runtime.
+ */
+
+#include "units.h"
+#include "protocol.h"
+#include "history.h"
+
+#include <stdlib.h>
+
+// Espansione di f(i) per i = 0..1023
+#define UNITS_R4(f, i)    f(i) f((i) + 1) f((i) + 2) f((i) + 3)
+#define UNITS_R16(f, i)   UNITS_R4(f, i) UNITS_R4(f, (i) + 4) UNITS_R4(f, (i) + 8) UNITS_R4(f, (i) + 12)
+#define UNITS_R64(f, i)   UNITS_R16(f, i) UNITS_R16(f, (i) + 16) UNITS_R16(f, (i) + 32) UNITS_R16(f, (i) + 48)
+#define UNITS_R256(f, i)  UNITS_R64(f, i) UNITS_R64(f, (i) + 64) UNITS_R64(f, (i) + 128) UNITS_R64(f, (i) + 192)
+#define UNITS_R1024(f, i) UNITS_R256(f, i) UNITS_R256(f, (i) + 256) UNITS_R256(f, (i) + 512) UNITS_R256(f, (i) + 768)
+#define UNITS_TABLE(f) { UNITS_R1024(f, 0) }
+
+// Dall'indice grezzo (decimi a partire dal minimo del generatore) al
+// valore nell'unità alla precisione massima. Gli indici oltre l'intervallo
+// del generatore non si usano ma restano entro int16.
+#define CELSIUS_C2(i)    (int16_t)(((i) + UNITS_T_MIN) * 10),             // -10.0 .. 40.0 °C
+#define FAHRENHEIT_C2(i) (int16_t)(((i) + UNITS_T_MIN) * 18 + 3200),      // 14.0 .. 104.0 °F
+#define PERCENT_C2(i)    (int16_t)(((i) + UNITS_H_MIN) * 10),             // 20.0 .. 100.0 %
+#define KMH_C2(i)        (int16_t)(((i) + UNITS_W_MIN) * 10),             // 0.0 .. 100.0 km/h
+#define MS_C3(i)         (int16_t)((((i) + UNITS_W_MIN) * 500 + 9) / 18), // 0.000 .. 27.778 m/s
+#define HPA_C1(i)        (int16_t)((i) + UNITS_P_MIN),                    // 950.0 .. 1050.0 hPa
+#define INHG_C3(i)       (int16_t)(((i) + UNITS_P_MIN) * 2.9529983071445 + 0.5), // 28.053 .. 31.006 inHg
+
+static const int16_t celsius[UNITS_RAW_MAX] = UNITS_TABLE(CELSIUS_C2);
+static const int16_t fahrenheit[UNITS_RAW_MAX] = UNITS_TABLE(FAHRENHEIT_C2);
+static const int16_t percent[UNITS_RAW_MAX] = UNITS_TABLE(PERCENT_C2);
+static const int16_t kmh[UNITS_RAW_MAX] = UNITS_TABLE(KMH_C2);
+static const int16_t ms[UNITS_RAW_MAX] = UNITS_TABLE(MS_C3);
+static const int16_t hpa[UNITS_RAW_MAX] = UNITS_TABLE(HPA_C1);
+static const int16_t inhg[UNITS_RAW_MAX] = UNITS_TABLE(INHG_C3);
+
+typedef struct {
+	char type;         // misura a cui appartiene l'unità
+	uint8_t maxdec;    // cifre decimali della tabella
+	const int16_t *table;
+} unit_desc_t;
+
+static const unit_desc_t unit_desc[UNIT_COUNT] = {
+	[UNIT_DEFAULT]    = { '\0', 0, NULL },
+	[UNIT_CELSIUS]    = { 't', 2, celsius },
+	[UNIT_FAHRENHEIT] = { 't', 2, fahrenheit },
+	[UNIT_PERCENT]    = { 'h', 2, percent },
+	[UNIT_KMH]        = { 'w', 2, kmh },
+	[UNIT_MS]         = { 'w', 3, ms },
+	[UNIT_HPA]        = { 'p', 1, hpa },
+	[UNIT_INHG]       = { 'p', 3, inhg },
+};
+
+// Generatori per misura, nell'ordine di history_type_index (gli stessi
+// intervalli di get_temperature, get_humidity, get_wind, get_pressure)
+static const struct {
+	int span;           // valori grezzi possibili
+	int min;            // minimo in decimi dell'unità base
+	unsigned base_unit; // unità di UNIT_DEFAULT
+} measure[HISTORY_TYPES] = {
+	{ UNITS_T_SPAN, UNITS_T_MIN, UNIT_CELSIUS },
+	{ UNITS_H_SPAN, UNITS_H_MIN, UNIT_PERCENT },
+	{ UNITS_W_SPAN, UNITS_W_MIN, UNIT_KMH },
+	{ UNITS_P_SPAN, UNITS_P_MIN, UNIT_HPA },
+};
+
+int units_sample(char type) {
+	int t = history_type_index(type);
+	return t >= 0 ? rand() % measure[t].span : 0;
+}
+
+float units_value(char type, int raw) {
+	int t = history_type_index(type);
+	return t >= 0 ? UNITS_DECODE(raw, measure[t].min) : 0.0f;
+}
+
+int units_negotiate(char type, unsigned char fmt) {
+	int t = history_type_index(type);
+	if (t < 0) {
+		return -1;
+	}
+	unsigned unit = COMPACT_UNIT(fmt);
+	if (unit == UNIT_DEFAULT) {
+		unit = measure[t].base_unit;
+	}
+	if (unit >= UNIT_COUNT || unit_desc[unit].type != type) {
+		return -1;
+	}
+	unsigned dec = COMPACT_DEC(fmt);
+	if (dec > unit_desc[unit].maxdec) {
+		dec = unit_desc[unit].maxdec;
+	}
+	return COMPACT_FMT(unit, dec);
+}
+
+// Divisione arrotondata (metà lontano da zero) per una potenza di 10
+#define ROUND_DIV(v, p) ((v) >= 0 ? ((v) + (p) / 2) / (p) : -((-(v) + (p) / 2) / (p)))
+
+int16_t units_convert(int raw, unsigned char fmt) {
+	const unit_desc_t *u = &unit_desc[COMPACT_UNIT(fmt)];
+	int v = u->table[raw & (UNITS_RAW_MAX - 1)];
+	// Divisori costanti: niente divisioni hardware nel percorso caldo
+	switch (u->maxdec - (int)COMPACT_DEC(fmt)) {
+		case 0:  return (int16_t)v;
+		case 1:  return (int16_t)ROUND_DIV(v, 10);
+		case 2:  return (int16_t)ROUND_DIV(v, 100);
+		default: return (int16_t)ROUND_DIV(v, 1000);
+	}
+}
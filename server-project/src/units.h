@@ -0,0 +1,46 @@
+/*
+ * units.h
+ *
+ * Valori in virgola fissa per le richieste compatte (REQ_COMPACT, formato
+ * in protocol.h). I generatori producono decimi dell'unità base, cioè un
+ * indice grezzo 0..span-1 per misura; per ogni unità una tabella costruita
+ * a tempo di compilazione dà il valore già convertito alla precisione
+ * massima dell'unità, e le precisioni inferiori si ottengono arrotondando
+ * il valore tabulato.
+ */
+
+#ifndef UNITS_H_
+#define UNITS_H_
+
+#include <stdint.h>
+
+#define UNITS_RAW_MAX 1024 // voci per tabella (indici grezzi possibili)
+
+// Intervalli dei generatori, unica definizione per weather.c e per le
+// tabelle: SPAN valori grezzi a partire da MIN, in decimi dell'unità base
+#define UNITS_T_SPAN 501    // -10.0 .. 40.0 °C
+#define UNITS_T_MIN  (-100)
+#define UNITS_H_SPAN 801    // 20.0 .. 100.0 %
+#define UNITS_H_MIN  200
+#define UNITS_W_SPAN 1001   // 0.0 .. 100.0 km/h
+#define UNITS_W_MIN  0
+#define UNITS_P_SPAN 1011   // 950.0 .. 1050.0 hPa
+#define UNITS_P_MIN  9500
+
+// Valore nell'unità base dell'indice grezzo raw di una misura con minimo min
+#define UNITS_DECODE(raw, min) ((float)(raw) / 10.0f + (float)(min) / 10.0f)
+
+// Nuovo campione grezzo per la misura (tipo già validato)
+int units_sample(char type);
+
+// Valore del campione grezzo nell'unità base, come da generate_value
+float units_value(char type, int raw);
+
+// Formato concesso (COMPACT_FMT con unità esplicita) per la misura e il
+// formato richiesto; -1 se il tipo non è valido o l'unità non gli appartiene
+int units_negotiate(char type, unsigned char fmt);
+
+// Valore del campione grezzo nel formato concesso, × 10^decimali
+int16_t units_convert(int raw, unsigned char fmt);
+
+#endif /* UNITS_H_ */
@@ -0,0 +1,250 @@
+/*
+ * validate.c
+ *
+ * Validazione vettoriale del campo città. Le versioni SIMD costruiscono in
+ * una passata le maschere a 64 bit dei byte nulli, degli spazi finali e
+ * dei caratteri vietati, e convertono in minuscolo la chiave; la versione
+ * scalare riproduce passo per passo extractcity/build_weather_response ed
+ * è il riferimento per il confronto differenziale.
+ */
+
+#include "validate.h"
+#include "protocol.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VALIDATE_X86 1
+#endif
+
+// Byte disponibili del campo città, con la stessa regola di extractcity
+static int field_avail(int len) {
+	return (len > 1 && (len - 1) < 65) ? len - 1 : VALIDATE_FIELD;
+}
+
+static char fold_type(const unsigned char *req, int len) {
+	unsigned char t = len > 0 ? req[0] : 0;
+	if (t >= 'A' && t <= 'Z') {
+		t = (unsigned char)(t | 0x20);
+	}
+	return (t == 't' || t == 'h' || t == 'w' || t == 'p') ? (char)t : '\0';
+}
+
+static int is_trailing_space(unsigned char c) {
+	return c == ' ' || c == '\r' || c == '\n' || c == '\t';
+}
+
+void validate_scalar(const unsigned char *req, int len, validated_req_t *out) {
+	const unsigned char *field = req + 1;
+	int avail = field_avail(len);
+	int n = 0;
+	while (n < avail && field[n] != '\0') {
+		n++;
+	}
+	while (n > 0 && is_trailing_space(field[n - 1])) {
+		n--;
+	}
+	out->type = fold_type(req, len);
+	out->len = (uint8_t)n;
+	out->forbidden = 0;
+	for (int i = 0; i < n; ++i) {
+		unsigned char c = field[i];
+		if (c == '@' || c == '$' || c == '%' || c == '#') {
+			out->forbidden = 1;
+		}
+		out->key[i] = (char)((c >= 'A' && c <= 'Z') ? (c | 0x20) : c);
+	}
+	memset(out->key + n, 0, (size_t)(VALIDATE_FIELD + 1 - n));
+}
+
+#if defined(VALIDATE_X86)
+
+// Dalle maschere (bit i = byte i del campo) ricava lunghezza e flag
+static void validate_finish(uint64_t nul, uint64_t ws, uint64_t forb, validated_req_t *out) {
+	uint64_t live = nul ? (((uint64_t)1 << __builtin_ctzll(nul)) - 1) : ~(uint64_t)0;
+	uint64_t nonws = ~ws & live;
+	int n = nonws ? 64 - __builtin_clzll(nonws) : 0;
+	uint64_t lenmask = n == 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+	out->len = (uint8_t)n;
+	out->forbidden = (forb & lenmask) != 0;
+	memset(out->key + n, 0, (size_t)(VALIDATE_FIELD + 1 - n));
+}
+
+// Campo da 64 byte leggibile: diretto se completo, altrimenti copia con
+// padding a zero (come il memset di extractcity)
+static const unsigned char *field_ptr(const unsigned char *req, int len, unsigned char *tmp) {
+	int avail = field_avail(len);
+	if (avail == VALIDATE_FIELD) {
+		return req + 1;
+	}
+	memset(tmp, 0, VALIDATE_FIELD);
+	memcpy(tmp, req + 1, (size_t)avail);
+	return tmp;
+}
+
+void validate_sse2(const unsigned char *req, int len, validated_req_t *out) {
+	unsigned char tmp[VALIDATE_FIELD];
+	const unsigned char *field = field_ptr(req, len, tmp);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i upper_bias = _mm_set1_epi8((char)(128 - 'A'));
+	const __m128i upper_lim = _mm_set1_epi8((char)(-128 + 26));
+	const __m128i bit5 = _mm_set1_epi8(0x20);
+	uint64_t nul = 0, ws = 0, forb = 0;
+
+	for (int i = 0; i < 4; ++i) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(field + i * 16));
+		__m128i s = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+		__m128i f = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('@')), _mm_cmpeq_epi8(v, _mm_set1_epi8('$'))),
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')), _mm_cmpeq_epi8(v, _mm_set1_epi8('#'))));
+		// 'A'..'Z' -> confronto con segno dopo lo spostamento dell'intervallo
+		__m128i up = _mm_cmplt_epi8(_mm_add_epi8(v, upper_bias), upper_lim);
+		_mm_storeu_si128((__m128i *)(out->key + i * 16), _mm_or_si128(v, _mm_and_si128(up, bit5)));
+		nul |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) << (i * 16);
+		ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(s) << (i * 16);
+		forb |= (uint64_t)(uint16_t)_mm_movemask_epi8(f) << (i * 16);
+	}
+	out->type = fold_type(req, len);
+	validate_finish(nul, ws, forb, out);
+}
+
+__attribute__((target("avx2")))
+void validate_avx2(const unsigned char *req, int len, validated_req_t *out) {
+	unsigned char tmp[VALIDATE_FIELD];
+	const unsigned char *field = field_ptr(req, len, tmp);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i upper_bias = _mm256_set1_epi8((char)(128 - 'A'));
+	const __m256i upper_lim = _mm256_set1_epi8((char)(-128 + 26));
+	const __m256i bit5 = _mm256_set1_epi8(0x20);
+	uint64_t nul = 0, ws = 0, forb = 0;
+
+	for (int i = 0; i < 2; ++i) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(field + i * 32));
+		__m256i s = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))),
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+		__m256i f = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('@')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$'))),
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('%')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#'))));
+		__m256i up = _mm256_cmpgt_epi8(upper_lim, _mm256_add_epi8(v, upper_bias));
+		_mm256_storeu_si256((__m256i *)(out->key + i * 32), _mm256_or_si256(v, _mm256_and_si256(up, bit5)));
+		nul |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) << (i * 32);
+		ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(s) << (i * 32);
+		forb |= (uint64_t)(uint32_t)_mm256_movemask_epi8(f) << (i * 32);
+	}
+	out->type = fold_type(req, len);
+	validate_finish(nul, ws, forb, out);
+}
+
+typedef void (*validate_fn)(const unsigned char *, int, validated_req_t *);
+
+static validate_fn validate_select(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return validate_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return validate_sse2;
+	}
+	return validate_scalar;
+}
+
+#else
+
+// Senza intrinseci x86 le varianti SIMD ricadono sulla versione scalare
+void validate_sse2(const unsigned char *req, int len, validated_req_t *out) {
+	validate_scalar(req, len, out);
+}
+
+void validate_avx2(const unsigned char *req, int len, validated_req_t *out) {
+	validate_scalar(req, len, out);
+}
+
+typedef void (*validate_fn)(const unsigned char *, int, validated_req_t *);
+
+static validate_fn validate_select(void) {
+	return validate_scalar;
+}
+
+#endif
+
+static validate_fn validate_impl_fn = NULL;
+
+static void validate_init(void) {
+	validate_impl_fn = validate_select();
+}
+
+#if !defined(_WIN32)
+#include <pthread.h>
+// La prima chiamata può arrivare insieme dal loop principale e dai thread
+// dei trasporti: la scelta avviene una sola volta e ne è ordinata prima
+static pthread_once_t validate_once = PTHREAD_ONCE_INIT;
+
+static validate_fn validate_get(void) {
+	pthread_once(&validate_once, validate_init);
+	return validate_impl_fn;
+}
+#else
+// Su Windows il server è a thread singolo
+static validate_fn validate_get(void) {
+	if (validate_impl_fn == NULL) {
+		validate_init();
+	}
+	return validate_impl_fn;
+}
+#endif
+
+void validate_batch(const unsigned char *const *req, const int *lens, int n, validated_req_t *out) {
+	validate_fn fn = validate_get();
+	for (int i = 0; i < n; ++i) {
+		fn(req[i], lens[i], &out[i]);
+	}
+}
+
+const char *validate_impl(void) {
+	validate_fn fn = validate_get();
+	return fn == validate_avx2 ? "avx2" : fn == validate_sse2 ? "sse2" : "scalar";
+}
+
+unsigned int validated_city_status(const validated_req_t *v, int *city_idx) {
+	// Solo dati costanti: la funzione è chiamata in parallelo dal loop
+	// principale e dai thread dei trasporti (pipeline, shm, xdp)
+	static const char names[CITY_COUNT][VALIDATE_FIELD + 1] = CITY_NAMES;
+
+	*city_idx = -1;
+	if (v->len == 0) {
+		return STATUS_CITY_NOT_AVAILABLE;
+	}
+	if (v->forbidden) {
+		return STATUS_INVALID_REQUEST;
+	}
+	// Confronto con i nomi convertiti in minuscolo al volo (la chiave lo è già)
+	for (int c = 0; c < CITY_COUNT; ++c) {
+		const char *n = names[c];
+		int i = 0;
+		while (i < v->len && n[i] != '\0') {
+			unsigned char ch = (unsigned char)n[i];
+			if ((char)((ch >= 'A' && ch <= 'Z') ? (ch | 0x20) : ch) != v->key[i]) {
+				break;
+			}
+			i++;
+		}
+		if (i == v->len && n[i] == '\0') {
+			*city_idx = c;
+			return STATUS_SUCCESS;
+		}
+	}
+	return STATUS_CITY_NOT_AVAILABLE;
+}
+
+unsigned int validated_status(const validated_req_t *v, int *city_idx) {
+	// Stesso ordine di controlli di build_weather_response
+	if (v->type == '\0') {
+		*city_idx = -1;
+		return STATUS_INVALID_REQUEST;
+	}
+	return validated_city_status(v, city_idx);
+}
@@ -0,0 +1,45 @@
+/*
+ * validate.h
+ *
+ * Kernel di validazione delle richieste standard: in una sola passata sul
+ * campo città da 64 byte calcola lunghezza (fino al primo '\0', senza
+ * spazi finali), presenza di caratteri vietati (@ $ % #) e chiave in
+ * minuscolo, più il tipo in minuscolo. Implementazioni AVX2, SSE2 e
+ * scalare, scelta a runtime in base alla CPU.
+ */
+
+#ifndef VALIDATE_H_
+#define VALIDATE_H_
+
+#include <stdint.h>
+
+#define VALIDATE_FIELD 64 // byte del campo città
+#define VALIDATE_BATCH 32 // richieste validate per passata in process_batch
+
+typedef struct {
+	uint8_t len;        // lunghezza della città normalizzata
+	uint8_t forbidden;  // 1 se contiene caratteri vietati
+	char type;          // tipo in minuscolo, '\0' se non valido
+	char key[VALIDATE_FIELD + 1]; // città in minuscolo, terminata da '\0'
+} validated_req_t;
+
+// Valida n datagram di richiesta (req[i] lungo lens[i] byte).
+void validate_batch(const unsigned char *const *req, const int *lens, int n, validated_req_t *out);
+
+// Implementazioni singole, esposte per benchmark e confronto differenziale
+void validate_scalar(const unsigned char *req, int len, validated_req_t *out);
+void validate_sse2(const unsigned char *req, int len, validated_req_t *out);
+void validate_avx2(const unsigned char *req, int len, validated_req_t *out);
+
+// Nome dell'implementazione scelta a runtime ("avx2", "sse2", "scalar")
+const char *validate_impl(void);
+
+// Esito della validazione secondo le regole di build_weather_response:
+// restituisce lo STATUS_* e in *city_idx l'indice della città (o -1).
+unsigned int validated_status(const validated_req_t *v, int *city_idx);
+
+// Come validated_status ma senza il controllo del tipo (richieste
+// compatte, dove il tipo è per misura).
+unsigned int validated_city_status(const validated_req_t *v, int *city_idx);
+
+#endif /* VALIDATE_H_ */
@@ -0,0 +1,379 @@
+/*
+ * weather.c
+ *
+ * Logica applicativa del server indipendente dal trasporto: generazione
+ * dei valori, validazione di tipo e città, costruzione e serializzazione
+ * delle risposte (standard, compatte e storico).
+ */
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "protocol.h"
+#include "history.h"
+#include "validate.h"
+#include "capture.h"
+#include "units.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Intervalli in units.h, condivisi con le tabelle delle richieste compatte
+float get_temperature(void) {
+	return UNITS_DECODE(rand() % UNITS_T_SPAN, UNITS_T_MIN); // -10.0 to 40.0 °C
+}
+
+float get_humidity(void) {
+	return UNITS_DECODE(rand() % UNITS_H_SPAN, UNITS_H_MIN); // 20.0 to 100.0 %
+}
+
+float get_wind(void) {
+	return UNITS_DECODE(rand() % UNITS_W_SPAN, UNITS_W_MIN); // 0.0 to 100.0 km/h
+}
+
+float get_pressure(void) {
+	return UNITS_DECODE(rand() % UNITS_P_SPAN, UNITS_P_MIN); // 950.0 to 1050.0 hPa
+}
+
+// Copia il campo città (byte 1..64 del datagram) in city[65], garantendo
+// la terminazione e rimuovendo spazi/newline finali.
+void extractcity(const unsigned char *reqbuf, int rcvd, char city[65]) {
+	memset(city, 0, 65);
+	memcpy(city, &reqbuf[1], (rcvd > 1 && (rcvd - 1) < 65) ? (size_t)(rcvd - 1) : (size_t)64);
+	city[64] = '\0'; // Garantisce terminazione
+	// Normalizza city rimuovendo trailing null/spazi
+	int clen = (int)strlen(city);
+	while (clen > 0 && (city[clen-1] == ' ' || city[clen-1] == '\r' || city[clen-1] == '\n' || city[clen-1] == '\t')) {
+		city[clen-1] = '\0';
+		clen--;
+	}
+}
+
+// Scrive un float in rete come bit pattern uint32 in network order.
+static void putfloat(unsigned char *dst, float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	bits = htonl(bits);
+	memcpy(dst, &bits, 4);
+}
+
+// Genera un valore casuale per il tipo di misura (già validato).
+float generate_value(char type) {
+	switch (type) {
+		case 't': return get_temperature();
+		case 'h': return get_humidity();
+		case 'w': return get_wind();
+		case 'p': return get_pressure();
+		default:  return 0.0f;
+	}
+}
+
+// Serializzazione binaria risposta: 4 byte status (network), 1 byte type,
+// 4 byte float (network bit pattern). Restituisce RESPONSE_SIZE.
+int serialize_weather_response(const weather_response_t *r, unsigned char *resp) {
+	uint32_t net_status = htonl(r->status);
+	memcpy(resp, &net_status, 4);
+	resp[4] = (r->status == STATUS_SUCCESS) ? (unsigned char)r->type : '\0';
+	putfloat(&resp[5], r->value);
+	return RESPONSE_SIZE;
+}
+
+// Risposta standard a partire da una richiesta già validata: genera il
+// valore e lo registra nello storico solo in caso di successo.
+static int build_validated_response(const validated_req_t *v, unsigned char *resp) {
+	int idx;
+	weather_response_t r;
+	r.status = validated_status(v, &idx);
+	r.type = v->type;
+	r.value = 0.0f;
+	if (r.status == STATUS_SUCCESS) {
+		r.value = generate_value(v->type);
+		history_record_now(idx, v->type, r.value);
+	}
+	return serialize_weather_response(&r, resp);
+}
+
+// Risposta a una richiesta REQ_COMPACT (formato in protocol.h) a partire
+// dalla validazione del campo città: un campione per tipo, registrato nello
+// storico, servito già convertito dalle tabelle di units.c.
+static int build_compact_response(const unsigned char *req, int reqlen, const validated_req_t *v,
+		unsigned char *resp, size_t respcap) {
+	int n = reqlen > 65 ? req[65] : 0;
+	unsigned int status = STATUS_SUCCESS;
+	unsigned char fmt[COMPACT_MAX_ITEMS];
+	int idx = -1;
+	if (n < 1 || n > COMPACT_MAX_ITEMS || reqlen != COMPACT_REQUEST_SIZE(n)
+			|| respcap < (size_t)COMPACT_RESPONSE_SIZE(n)) {
+		status = STATUS_INVALID_REQUEST;
+	} else {
+		for (int i = 0; i < n && status == STATUS_SUCCESS; ++i) {
+			int granted = units_negotiate((char)tolower(req[66 + 2 * i]), req[67 + 2 * i]);
+			if (granted < 0) {
+				status = STATUS_INVALID_REQUEST;
+			} else {
+				fmt[i] = (unsigned char)granted;
+			}
+		}
+		if (status == STATUS_SUCCESS) {
+			status = validated_city_status(v, &idx);
+		}
+	}
+
+	resp[0] = (unsigned char)status;
+	resp[1] = 0;
+	if (status != STATUS_SUCCESS) {
+		return COMPACT_RESPONSE_SIZE(0);
+	}
+	int raw[HISTORY_TYPES] = { -1, -1, -1, -1 };
+	for (int i = 0; i < n; ++i) {
+		char type = (char)tolower(req[66 + 2 * i]);
+		int t = history_type_index(type);
+		if (raw[t] < 0) {
+			raw[t] = units_sample(type);
+			history_record_now(idx, type, units_value(type, raw[t]));
+		}
+		uint16_t net_value = htons((uint16_t)units_convert(raw[t], fmt[i]));
+		unsigned char *item = &resp[2 + 4 * i];
+		item[0] = (unsigned char)type;
+		item[1] = fmt[i];
+		memcpy(&item[2], &net_value, 2);
+	}
+	resp[1] = (unsigned char)n;
+	return COMPACT_RESPONSE_SIZE(n);
+}
+
+// Percorso di elaborazione comune a tutti i trasporti (UDP, Unix, memoria
+// condivisa): dal datagram di richiesta alla risposta serializzata, senza
+// I/O né log. Restituisce il numero di byte scritti in resp.
+int process_request(const unsigned char *req, int reqlen, unsigned char *resp, size_t respcap) {
+	int resplen;
+	process_batch(&req, &reqlen, 1, &resp, respcap, &resplen);
+	return resplen;
+}
+
+// Come process_request su n datagram: le richieste standard e compatte del
+// lotto sono validate insieme dal kernel vettoriale (stesso campo città),
+// le altre seguono il proprio percorso.
+void process_batch(const unsigned char *const *req, const int *lens, int n,
+		unsigned char *const *resp, size_t respcap, int *resplens) {
+	const unsigned char *std_req[VALIDATE_BATCH];
+	int std_len[VALIDATE_BATCH];
+	int std_pos[VALIDATE_BATCH];
+	validated_req_t v[VALIDATE_BATCH];
+
+	for (int base = 0; base < n; base += VALIDATE_BATCH) {
+		int end = base + VALIDATE_BATCH < n ? base + VALIDATE_BATCH : n;
+		int m = 0;
+		for (int i = base; i < end; ++i) {
+			if (lens[i] > 0 && req[i][0] == REQ_HISTORY) {
+				resplens[i] = build_history_response(req[i], lens[i], resp[i], respcap);
+			} else {
+				std_req[m] = req[i];
+				std_len[m] = lens[i];
+				std_pos[m++] = i;
+			}
+		}
+		validate_batch(std_req, std_len, m, v);
+		for (int k = 0; k < m; ++k) {
+			int i = std_pos[k];
+			resplens[i] = lens[i] > 0 && req[i][0] == REQ_COMPACT
+					? build_compact_response(req[i], lens[i], &v[k], resp[i], respcap)
+					: build_validated_response(&v[k], resp[i]);
+		}
+		// Cattura (-C): richieste e risposte nell'ordine di arrivo
+		if (atomic_load(&capture_active)) {
+			for (int i = base; i < end; ++i) {
+				capture_record(req[i], lens[i], resp[i], resplens[i]);
+			}
+		}
+	}
+}
+
+float typecheck(char type){
+	switch (type){
+		case 't':
+			get_temperature();
+			break;
+		case 'h':
+			get_humidity();
+			break;
+		case 'w':
+			get_wind();
+			break;
+		case 'p':
+			get_pressure();
+			break;
+		default:
+			printf("Richiesta non valida");
+			return 2;
+	}
+	return 0;
+}
+
+static const char *valid_cities[CITY_COUNT] = CITY_NAMES;
+
+// Restituisce la posizione della città (case insensitive) nell'elenco
+// delle città disponibili, -1 se non presente.
+int cityindex(const char *city) {
+	for (size_t i = 0; i < sizeof(valid_cities)/sizeof(valid_cities[0]); ++i) {
+		const char *a = city;
+		const char *b = valid_cities[i];
+		while (*a && *b) {
+			if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
+				break;
+			}
+			a++; b++;
+		}
+		if (*a == '\0' && *b == '\0') {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+char citycheck(const char *city) {
+	return cityindex(city) >= 0 ? 0 : 2; // 0 valida (case insensitive), 2 non valida
+}
+
+// Funzione che combina validazione e generazione valore secondo specifica.
+weather_response_t build_weather_response(char type, const char *city) {
+	weather_response_t r;
+	r.status = STATUS_SUCCESS;
+	r.type = '\0';
+	r.value = 0.0f;
+
+	// Validazione type
+	if (type == '\0' || typecheck(type) != 0) {
+		// Richiesta non valida (tipo errato)
+		r.status = STATUS_INVALID_REQUEST;
+		return r;
+	}
+
+	// Validazione city
+	if (city == NULL || *city == '\0') {
+		// Città mancante: trattiamo come "non disponibile"
+		r.status = STATUS_CITY_NOT_AVAILABLE;
+		return r;
+	}
+	// Se la città contiene caratteri speciali vietati, la richiesta è
+	// considerata non valida (non "città non disponibile").
+	for (const char *p = city; *p != '\0'; ++p) {
+		if (*p == '@' || *p == '$' || *p == '%' || *p == '#') {
+			// Richiesta non valida per formato scorretto del campo città
+			r.status = STATUS_INVALID_REQUEST;
+			return r;
+		}
+	}
+	int idx = cityindex(city);
+	if (idx < 0) {
+		// Città ben formata ma non disponibile nel database
+		r.status = STATUS_CITY_NOT_AVAILABLE;
+		return r;
+	}
+
+	// Generazione valore meteo
+	float value = generate_value(type);
+
+	// Ogni valore generato entra nello storico della città
+	history_record_now(idx, type, value);
+
+	// Popolamento struttura in caso di successo
+	r.status = STATUS_SUCCESS;
+	r.type = type;
+	r.value = value;
+	return r;
+}
+
+// Costruisce la risposta a una richiesta REQ_HISTORY (formato in protocol.h).
+// Restituisce il numero di byte scritti in resp.
+int build_history_response(const unsigned char *req, int reqlen, unsigned char *resp, size_t respcap) {
+	uint32_t status = STATUS_SUCCESS;
+	char type = '\0';
+	unsigned char mode = 0;
+	int idx = -1;
+
+	if (reqlen != HISTORY_REQUEST_SIZE || respcap < 8 + HISTORY_MAX_SAMPLES * 8) {
+		status = STATUS_INVALID_REQUEST;
+	} else {
+		char city[65];
+		extractcity(req, reqlen, city);
+		type = (char)tolower(req[65]);
+		mode = req[66];
+		if (history_type_index(type) < 0 || (mode != HIST_MODE_RANGE && mode != HIST_MODE_AGGR)) {
+			status = STATUS_INVALID_REQUEST;
+		} else if ((idx = cityindex(city)) < 0) {
+			status = STATUS_CITY_NOT_AVAILABLE;
+		}
+	}
+
+	uint32_t net_status = htonl(status);
+	memcpy(resp, &net_status, 4);
+	resp[4] = (status == STATUS_SUCCESS) ? (unsigned char)type : '\0';
+	resp[5] = mode;
+	resp[6] = resp[7] = 0;
+	if (status != STATUS_SUCCESS) {
+		return 8;
+	}
+
+	uint32_t from, to;
+	memcpy(&from, &req[67], 4);
+	memcpy(&to, &req[71], 4);
+	from = ntohl(from);
+	to = ntohl(to);
+
+	uint16_t count;
+	size_t len = 8;
+	if (mode == HIST_MODE_AGGR) {
+		history_aggr_t ag;
+		count = (uint16_t)history_aggregate(idx, type, from, to, &ag);
+		putfloat(&resp[8], ag.min);
+		putfloat(&resp[12], ag.max);
+		putfloat(&resp[16], ag.avg);
+		len += 12;
+	} else {
+		uint32_t ts[HISTORY_MAX_SAMPLES];
+		float values[HISTORY_MAX_SAMPLES];
+		count = (uint16_t)history_range(idx, type, from, to, ts, values, HISTORY_MAX_SAMPLES);
+		for (int i = 0; i < count; ++i) {
+			uint32_t net_ts = htonl(ts[i]);
+			memcpy(&resp[len], &net_ts, 4);
+			putfloat(&resp[len + 4], values[i]);
+			len += 8;
+		}
+	}
+	uint16_t net_count = htons(count);
+	memcpy(&resp[6], &net_count, 2);
+	return (int)len;
+}
+
+// Prepara le strutture del percorso caldo prima di servire traffico (ad
+// esempio dopo un riavvio a caldo): implementazione di validazione scelta,
+// tabella delle città normalizzate e storico (ricevuto dalla generazione
+// precedente o vuoto) già in cache.
+void weather_warmup(void) {
+	static const char types[] = "thwp";
+	unsigned char req[REQUEST_SIZE];
+	const unsigned char *reqs[1] = { req };
+	int len = REQUEST_SIZE;
+	for (int i = 0; i < CITY_COUNT; ++i) {
+		memset(req, 0, sizeof(req));
+		req[0] = 't';
+		memcpy(&req[1], valid_cities[i], strlen(valid_cities[i]));
+		validated_req_t v;
+		int idx;
+		validate_batch(reqs, &len, 1, &v);
+		validated_status(&v, &idx);
+		cityindex(valid_cities[i]);
+		for (int t = 0; t < 4; ++t) {
+			float value;
+			uint32_t ts;
+			history_latest(i, types[t], &value, &ts);
+		}
+	}
+}
@@ -0,0 +1,462 @@
+/*
+ * xdp_server.c
+ *
+ * Backend AF_XDP senza libbpf: il programma XDP è assemblato a mano come
+ * sequenza di istruzioni eBPF e caricato con la syscall bpf(), insieme
+ * alla mappa XSKMAP che lo collega al socket. Il thread di servizio
+ * preleva i pacchetti dall'anello RX, costruisce la risposta con
+ * process_request, riscrive intestazioni e payload nello stesso frame e
+ * lo accoda in TX; i frame completati tornano nell'anello di riempimento.
+ */
+
+#include "xdp_server.h"
+
+#if defined(__linux__)
+
+#include "protocol.h"
+#include "auth.h"
+#include "capture.h"
+#include "diag.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+// Codifica delle istruzioni eBPF (sottoinsieme di include/linux/filter.h)
+#define INSN(c, d, s, o, i) ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define MOV64_REG(d, s)     INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define MOV64_IMM(d, i)     INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define ALU64_IMM(op, d, i) INSN(BPF_ALU64 | (op) | BPF_K, d, 0, 0, i)
+#define ALU64_REG(op, d, s) INSN(BPF_ALU64 | (op) | BPF_X, d, s, 0, 0)
+#define LDX(sz, d, s, o)    INSN(BPF_LDX | (sz) | BPF_MEM, d, s, o, 0)
+#define JMP_IMM(op, d, i, o) INSN(BPF_JMP | (op) | BPF_K, d, 0, o, i)
+#define JMP_REG(op, d, s, o) INSN(BPF_JMP | (op) | BPF_X, d, s, o, 0)
+#define CALL(f)             INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define EXIT()              INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+#define LD_MAP_FD(d, fd)    INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), INSN(0, 0, 0, 0, 0)
+
+typedef struct {
+	uint32_t *producer;
+	uint32_t *consumer;
+	void *ring;
+	uint32_t mask;
+	void *map;
+	size_t map_len;
+} xdp_ring_t;
+
+static int xsk_fd = -1;
+static int map_fd = -1;
+static int prog_fd = -1;
+static int link_fd = -1;
+static unsigned char *umem = NULL;
+static xdp_ring_t rx_ring, tx_ring, fill_ring, comp_ring;
+static pthread_t xdp_thread;
+static atomic_int xdp_running = 0;
+static unsigned long long xdp_served = 0, xdp_dropped = 0;
+
+static long sys_bpf(int cmd, union bpf_attr *attr) {
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// Programma XDP: UDP/IPv4 non frammentato verso la porta -> XSKMAP[coda],
+// altrimenti XDP_PASS. r2 = data, r3 = data_end, r5 = lunghezza header IP.
+static int load_program(int port) {
+	struct bpf_insn prog[] = {
+		MOV64_REG(BPF_REG_6, BPF_REG_1),
+		LDX(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data)),
+		LDX(BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end)),
+		MOV64_REG(BPF_REG_4, BPF_REG_2),
+		ALU64_IMM(BPF_ADD, BPF_REG_4, 14 + 20 + 8),
+		JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 20),                 // -> pass
+		LDX(BPF_H, BPF_REG_5, BPF_REG_2, 12),
+		JMP_IMM(BPF_JNE, BPF_REG_5, htons(ETH_P_IP), 18),
+		LDX(BPF_B, BPF_REG_5, BPF_REG_2, 14),
+		MOV64_REG(BPF_REG_4, BPF_REG_5),
+		ALU64_IMM(BPF_AND, BPF_REG_4, 0xf0),
+		JMP_IMM(BPF_JNE, BPF_REG_4, 0x40, 14),
+		ALU64_IMM(BPF_AND, BPF_REG_5, 0x0f),
+		ALU64_IMM(BPF_LSH, BPF_REG_5, 2),
+		JMP_IMM(BPF_JLT, BPF_REG_5, 20, 11),
+		LDX(BPF_B, BPF_REG_4, BPF_REG_2, 14 + 9),
+		JMP_IMM(BPF_JNE, BPF_REG_4, IPPROTO_UDP, 9),
+		LDX(BPF_H, BPF_REG_4, BPF_REG_2, 14 + 6),
+		ALU64_IMM(BPF_AND, BPF_REG_4, htons(0x3fff)),           // MF | offset
+		JMP_IMM(BPF_JNE, BPF_REG_4, 0, 6),
+		ALU64_REG(BPF_ADD, BPF_REG_2, BPF_REG_5),
+		MOV64_REG(BPF_REG_4, BPF_REG_2),
+		ALU64_IMM(BPF_ADD, BPF_REG_4, 14 + 8),
+		JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 2),
+		LDX(BPF_H, BPF_REG_4, BPF_REG_2, 14 + 2),                   // porta di destinazione
+		JMP_IMM(BPF_JEQ, BPF_REG_4, htons((uint16_t)port), 2),
+		MOV64_IMM(BPF_REG_0, XDP_PASS),                             // pass:
+		EXIT(),
+		LDX(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index)),
+		LD_MAP_FD(BPF_REG_1, map_fd),
+		MOV64_IMM(BPF_REG_3, XDP_PASS),                             // coda senza socket
+		CALL(BPF_FUNC_redirect_map),
+		EXIT(),
+	};
+	static char log[65536];
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.expected_attach_type = BPF_XDP;
+	attr.insns = (uint64_t)(uintptr_t)prog;
+	attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+	attr.license = (uint64_t)(uintptr_t)"GPL";
+	attr.log_buf = (uint64_t)(uintptr_t)log;
+	attr.log_size = sizeof(log);
+	attr.log_level = 1;
+	int fd = (int)sys_bpf(BPF_PROG_LOAD, &attr);
+	if (fd < 0) {
+		printf("Programma XDP rifiutato dal verificatore:\n%s\n", log);
+	}
+	return fd;
+}
+
+static int map_ring(xdp_ring_t *r, const struct xdp_ring_offset *off, uint32_t entries,
+		size_t desc_size, off_t pgoff) {
+	r->map_len = off->desc + entries * desc_size;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd, pgoff);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		return -1;
+	}
+	r->producer = (uint32_t *)((char *)r->map + off->producer);
+	r->consumer = (uint32_t *)((char *)r->map + off->consumer);
+	r->ring = (char *)r->map + off->desc;
+	r->mask = entries - 1;
+	return 0;
+}
+
+static int open_socket(int ifindex, int queue) {
+	xsk_fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (xsk_fd < 0) {
+		return -1;
+	}
+	umem = mmap(NULL, (size_t)XDP_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (umem == MAP_FAILED) {
+		umem = NULL;
+		return -1;
+	}
+	struct xdp_umem_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.addr = (uint64_t)(uintptr_t)umem;
+	reg.len = (uint64_t)XDP_FRAMES * XDP_FRAME_SIZE;
+	reg.chunk_size = XDP_FRAME_SIZE;
+	int fill_size = XDP_FRAMES, comp_size = XDP_FRAMES, ring_size = XDP_RING_SIZE;
+	if (setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0
+			|| setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &fill_size, sizeof(int)) < 0
+			|| setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &comp_size, sizeof(int)) < 0
+			|| setsockopt(xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(int)) < 0
+			|| setsockopt(xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(int)) < 0) {
+		return -1;
+	}
+	struct xdp_mmap_offsets off;
+	socklen_t optlen = sizeof(off);
+	if (getsockopt(xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0
+			|| map_ring(&rx_ring, &off.rx, XDP_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0
+			|| map_ring(&tx_ring, &off.tx, XDP_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0
+			|| map_ring(&fill_ring, &off.fr, XDP_FRAMES, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0
+			|| map_ring(&comp_ring, &off.cr, XDP_FRAMES, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0) {
+		return -1;
+	}
+
+	// Tutti i frame partono nell'anello di riempimento
+	uint64_t *fq = (uint64_t *)fill_ring.ring;
+	for (uint32_t i = 0; i < XDP_FRAMES; ++i) {
+		fq[i] = (uint64_t)i * XDP_FRAME_SIZE;
+	}
+	__atomic_store_n(fill_ring.producer, XDP_FRAMES, __ATOMIC_RELEASE);
+
+	struct sockaddr_xdp sxdp;
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = (uint32_t)ifindex;
+	sxdp.sxdp_queue_id = (uint32_t)queue;
+	sxdp.sxdp_flags = XDP_COPY;
+	return bind(xsk_fd, (struct sockaddr *)&sxdp, sizeof(sxdp));
+}
+
+static uint16_t ip_checksum(const unsigned char *p, int len) {
+	uint32_t sum = 0;
+	for (int i = 0; i + 1 < len; i += 2) {
+		sum += (uint32_t)(p[i] << 8 | p[i + 1]);
+	}
+	if (len & 1) {
+		sum += (uint32_t)(p[len - 1] << 8);
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return htons((uint16_t)~sum);
+}
+
+// Trasforma sul posto la richiesta nel frame in risposta. Restituisce la
+// nuova lunghezza del frame, 0 se il pacchetto non va servito.
+static int rewrite_packet(unsigned char *pkt, int len, int cap) {
+	if (len < 14 + 20 + 8) {
+		return 0;
+	}
+	unsigned char *ip = pkt + 14;
+	int ihl = (ip[0] & 0x0f) * 4;
+	if (ihl < 20 || len < 14 + ihl + 8) {
+		return 0;
+	}
+	unsigned char *udp = ip + ihl;
+	unsigned char *payload = udp + 8;
+	uint16_t udp_len;
+	memcpy(&udp_len, udp + 4, 2);
+	int paylen = (int)ntohs(udp_len) - 8;
+	if (paylen < 0 || payload + paylen > pkt + len) {
+		return 0;
+	}
+
+	// La richiesta viene copiata: la risposta si scrive sullo stesso payload
+	unsigned char req[BUFFER_SIZE];
+	unsigned char resp[BUFFER_SIZE];
+	if (paylen > (int)sizeof(req)) {
+		paylen = (int)sizeof(req); // troncata come farebbe recvfrom
+	}
+	memcpy(req, payload, (size_t)paylen);
+	if (auth_enabled && (paylen = auth_verify(req, paylen)) < 0) {
+		return 0; // non autenticato: il frame torna al pool senza risposta
+	}
+	int rlen;
+	if (paylen > 0 && (req[0] == REQ_SUBSCRIBE || req[0] == REQ_UNSUBSCRIBE)) {
+		// La tabella delle iscrizioni appartiene al loop principale
+		uint32_t net_status = htonl(STATUS_INVALID_REQUEST);
+		memset(resp, 0, SUB_ACK_SIZE);
+		memcpy(resp, &net_status, 4);
+		resp[4] = req[0];
+		rlen = SUB_ACK_SIZE;
+		if (atomic_load(&capture_active)) {
+			capture_record(req, paylen, resp, rlen);
+		}
+	} else {
+		rlen = process_request(req, paylen, resp, sizeof(resp));
+	}
+	int total = 14 + ihl + 8 + rlen;
+	if (total > cap) {
+		return 0;
+	}
+	memcpy(payload, resp, (size_t)rlen);
+
+	unsigned char tmp[6];
+	memcpy(tmp, pkt, 6);
+	memcpy(pkt, pkt + 6, 6);
+	memcpy(pkt + 6, tmp, 6);
+
+	uint32_t addr;
+	memcpy(&addr, ip + 12, 4);
+	memcpy(ip + 12, ip + 16, 4);
+	memcpy(ip + 16, &addr, 4);
+	uint16_t v16 = htons((uint16_t)(ihl + 8 + rlen));
+	memcpy(ip + 2, &v16, 2);
+	ip[8] = 64; // TTL
+	ip[10] = ip[11] = 0;
+	v16 = ip_checksum(ip, ihl);
+	memcpy(ip + 10, &v16, 2);
+
+	memcpy(tmp, udp, 2);
+	memcpy(udp, udp + 2, 2);
+	memcpy(udp + 2, tmp, 2);
+	v16 = htons((uint16_t)(8 + rlen));
+	memcpy(udp + 4, &v16, 2);
+	udp[6] = udp[7] = 0; // checksum UDP facoltativo su IPv4
+	return total;
+}
+
+// Restituisce all'anello di riempimento i frame già trasmessi
+static void recycle_completed(void) {
+	uint32_t prod = __atomic_load_n(comp_ring.producer, __ATOMIC_ACQUIRE);
+	uint32_t cons = *comp_ring.consumer;
+	if (prod == cons) {
+		return;
+	}
+	uint64_t *cq = (uint64_t *)comp_ring.ring;
+	uint64_t *fq = (uint64_t *)fill_ring.ring;
+	uint32_t fprod = *fill_ring.producer;
+	for (uint32_t c = cons; c != prod; ++c, ++fprod) {
+		fq[fprod & fill_ring.mask] = cq[c & comp_ring.mask];
+	}
+	__atomic_store_n(fill_ring.producer, fprod, __ATOMIC_RELEASE);
+	__atomic_store_n(comp_ring.consumer, prod, __ATOMIC_RELEASE);
+}
+
+static void *xdp_serve(void *arg) {
+	(void)arg;
+	struct pollfd pfd = { xsk_fd, POLLIN, 0 };
+	struct xdp_desc *rxd = (struct xdp_desc *)rx_ring.ring;
+	struct xdp_desc *txd = (struct xdp_desc *)tx_ring.ring;
+	uint64_t *fq = (uint64_t *)fill_ring.ring;
+
+	diag_register("xdp");
+	while (atomic_load_explicit(&xdp_running, memory_order_relaxed)) {
+		recycle_completed();
+		uint32_t prod = __atomic_load_n(rx_ring.producer, __ATOMIC_ACQUIRE);
+		uint32_t cons = *rx_ring.consumer;
+		if (prod == cons) {
+			poll(&pfd, 1, 100);
+			continue;
+		}
+		uint32_t n = prod - cons;
+		uint32_t tx_prod = *tx_ring.producer;
+		uint32_t tx_free = XDP_RING_SIZE - (tx_prod - __atomic_load_n(tx_ring.consumer, __ATOMIC_ACQUIRE));
+		if (n > XDP_BATCH) {
+			n = XDP_BATCH;
+		}
+		if (n > tx_free) {
+			n = tx_free; // TX pieno: si riprova dopo il prossimo invio
+		}
+		uint32_t fprod = *fill_ring.producer;
+		uint32_t queued = 0;
+		diag_enter();
+		for (uint32_t i = 0; i < n; ++i) {
+			struct xdp_desc d = rxd[(cons + i) & rx_ring.mask];
+			uint64_t offset = d.addr & (XDP_FRAME_SIZE - 1);
+			int len = rewrite_packet(umem + d.addr, (int)d.len, (int)(XDP_FRAME_SIZE - offset));
+			if (len > 0) {
+				struct xdp_desc *t = &txd[(tx_prod + queued++) & tx_ring.mask];
+				t->addr = d.addr;
+				t->len = (uint32_t)len;
+				t->options = 0;
+				xdp_served++;
+			} else {
+				fq[fprod++ & fill_ring.mask] = d.addr - offset; // frame scartato
+				xdp_dropped++;
+			}
+		}
+		diag_leave();
+		__atomic_store_n(rx_ring.consumer, cons + n, __ATOMIC_RELEASE);
+		__atomic_store_n(fill_ring.producer, fprod, __ATOMIC_RELEASE);
+		if (queued > 0) {
+			__atomic_store_n(tx_ring.producer, tx_prod + queued, __ATOMIC_RELEASE);
+			// In modalità copia la trasmissione parte solo su richiesta
+			sendto(xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+		}
+	}
+	return NULL;
+}
+
+int xdp_server_start(const char *ifname, int queue, int port) {
+	int ifindex = (int)if_nametoindex(ifname);
+	if (ifindex == 0 || xsk_fd >= 0) {
+		return -1;
+	}
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(int);
+	attr.value_size = sizeof(int);
+	attr.max_entries = (uint32_t)queue + 1;
+	map_fd = (int)sys_bpf(BPF_MAP_CREATE, &attr);
+	if (map_fd < 0 || (prog_fd = load_program(port)) < 0 || open_socket(ifindex, queue) < 0) {
+		xdp_server_stop();
+		return -1;
+	}
+
+	// Il socket entra nella mappa alla posizione della sua coda
+	uint32_t key = (uint32_t)queue;
+	uint32_t value = (uint32_t)xsk_fd;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = (uint32_t)map_fd;
+	attr.key = (uint64_t)(uintptr_t)&key;
+	attr.value = (uint64_t)(uintptr_t)&value;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+		xdp_server_stop();
+		return -1;
+	}
+
+	// Aggancio in modalità generica tramite bpf_link: si sgancia da solo
+	// alla chiusura del descrittore, anche se il processo termina male
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = (uint32_t)prog_fd;
+	attr.link_create.target_ifindex = (uint32_t)ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+	link_fd = (int)sys_bpf(BPF_LINK_CREATE, &attr);
+	if (link_fd < 0) {
+		xdp_server_stop();
+		return -1;
+	}
+
+	atomic_store(&xdp_running, 1);
+	if (pthread_create(&xdp_thread, NULL, xdp_serve, NULL) != 0) {
+		atomic_store(&xdp_running, 0);
+		xdp_server_stop();
+		return -1;
+	}
+	return 0;
+}
+
+void xdp_server_stop(void) {
+	if (atomic_exchange(&xdp_running, 0)) {
+		pthread_join(xdp_thread, NULL);
+		printf("AF_XDP: %llu risposte inviate, %llu pacchetti scartati\n", xdp_served, xdp_dropped);
+	}
+	if (link_fd >= 0) {
+		close(link_fd);
+		link_fd = -1;
+	}
+	xdp_ring_t *rings[] = { &rx_ring, &tx_ring, &fill_ring, &comp_ring };
+	for (int i = 0; i < 4; ++i) {
+		if (rings[i]->map != NULL) {
+			munmap(rings[i]->map, rings[i]->map_len);
+			rings[i]->map = NULL;
+		}
+	}
+	if (xsk_fd >= 0) {
+		close(xsk_fd);
+		xsk_fd = -1;
+	}
+	if (umem != NULL) {
+		munmap(umem, (size_t)XDP_FRAMES * XDP_FRAME_SIZE);
+		umem = NULL;
+	}
+	if (prog_fd >= 0) {
+		close(prog_fd);
+		prog_fd = -1;
+	}
+	if (map_fd >= 0) {
+		close(map_fd);
+		map_fd = -1;
+	}
+}
+
+#else
+
+int xdp_server_start(const char *ifname, int queue, int port) {
+	(void)ifname;
+	(void)queue;
+	(void)port;
+	return -1;
+}
+
+void xdp_server_stop(void) {
+}
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * xdp_server.h
+ *
+ * Percorso veloce AF_XDP (solo Linux): un programma XDP ridirige in una
+ * UMEM i datagram UDP IPv4 destinati alla porta del servizio; un thread
+ * dedicato risponde riscrivendo il pacchetto sul posto (scambio di MAC,
+ * indirizzi e porte, payload di risposta) e lo rimette in trasmissione.
+ * Tutto il resto del traffico prosegue verso lo stack del kernel.
+ * Il programma è agganciato in modalità generica (SKB) e il socket in
+ * modalità copia, così funziona su qualunque interfaccia, veth comprese.
+ */
+
+#ifndef XDP_SERVER_H_
+#define XDP_SERVER_H_
+
+#define XDP_FRAMES     4096 // frame della UMEM
+#define XDP_FRAME_SIZE 2048 // byte per frame
+#define XDP_RING_SIZE  2048 // descrittori negli anelli RX e TX
+#define XDP_BATCH      64   // pacchetti serviti per passata
+
+// Aggancia il programma XDP all'interfaccia ifname, apre il socket AF_XDP
+// sulla coda queue e avvia il thread di servizio per la porta UDP port.
+// Restituisce 0 in caso di successo, -1 in caso di errore (o se la
+// piattaforma non supporta AF_XDP).
+int xdp_server_start(const char *ifname, int queue, int port);
+
+// Ferma il thread, sgancia il programma e libera la UMEM.
+void xdp_server_stop(void);
+
+#endif /* XDP_SERVER_H_ */
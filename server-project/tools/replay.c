@@ -0,0 +1,444 @@
+/*
+ * replay.c
+ *
+ * Riproduce contro un server una cattura prodotta con -C (formato in
+ * src/capture.h): ogni richiesta viene inviata rispettando gli intervalli
+ * originali (divisi per il fattore -x) o alla massima velocità (--max),
+ * senza attendere le risposte precedenti, e la risposta si confronta con
+ * quella catturata su stato e tipo, e per le richieste compatte su tipo e
+ * formato concesso di ogni misura (il valore meteo è casuale e non viene
+ * confrontato). Riporta latenza, risposte mancanti, discrepanze e ritardo
+ * accumulato rispetto ai tempi originali.
+ *
+ * Le risposte non portano un identificativo: ogni richiesta in volo
+ * occupa uno slot con un proprio socket (e porta sorgente), al più -c
+ * richieste insieme (64 di default). Uno slot scaduto cambia porta, così
+ * una risposta tardiva non viene mai confrontata con un record successivo.
+ * Se la cattura ha più richieste contemporanee degli slot, gli invii
+ * slittano e il ritardo lo mostra.
+ *
+ * La cattura contiene le richieste senza trailer di autenticazione: contro
+ * un server in modalità -K si passa -k id:chiave e ogni record viene
+ * firmato di nuovo al momento dell'invio, con istante corrente e un
+ * contatore che parte dai nanosecondi dell'epoca Unix (come nel client).
+ *
+ * Compilazione (dalla radice del repository):
+ *   cmake --build build --target replay
+ * Uso:
+ *   build/replay [-s host] [-p porta] [-x fattore | --max] [-t timeout_ms] [-c slot]
+ *                [-k id:chiave] cattura.bin
+ */
+
+#define _GNU_SOURCE // ppoll
+
+#include "../src/capture.h"
+#include "../src/protocol.h"
+#include "../src/siphash.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_REPORTED_MISMATCHES 10
+#define DEFAULT_INFLIGHT        64
+
+typedef struct {
+	uint64_t ts;
+	const unsigned char *req;
+	const unsigned char *resp;
+	int reqlen;
+	int resplen;
+} replay_record_t;
+
+// Richiesta in volo: rec è l'indice del record, -1 se lo slot è libero
+typedef struct {
+	int fd;
+	int rec;
+	uint64_t sent;
+} replay_slot_t;
+
+static uint16_t get16le(const unsigned char *p) {
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32le(const unsigned char *p) {
+	return (uint32_t)get16le(p) | (uint32_t)get16le(p + 2) << 16;
+}
+
+static uint64_t get64le(const unsigned char *p) {
+	return (uint64_t)get32le(p) | (uint64_t)get32le(p + 4) << 32;
+}
+
+static void put32be(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static void put64be(unsigned char *p, uint64_t v) {
+	put32be(p, (uint32_t)(v >> 32));
+	put32be(p + 4, (uint32_t)v);
+}
+
+// Chiave per la nuova firma dei record (-k), come nel client
+typedef struct {
+	uint32_t id;
+	unsigned char key[SIPHASH_KEY_SIZE];
+	uint64_t counter;
+} replay_auth_t;
+
+// Legge "id:chiave" (chiave di 32 cifre esadecimali). Restituisce 0, -1
+// se il formato non è valido.
+static int parse_auth(const char *s, replay_auth_t *a) {
+	char *end;
+	unsigned long id = strtoul(s, &end, 10);
+	if (end == s || *end != ':' || id > 0xFFFFFFFFul || strlen(end + 1) != 2 * SIPHASH_KEY_SIZE) {
+		return -1;
+	}
+	const char *hex = end + 1;
+	for (int i = 0; i < SIPHASH_KEY_SIZE; ++i) {
+		unsigned byte;
+		if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1])
+				|| sscanf(&hex[2 * i], "%2x", &byte) != 1) {
+			return -1;
+		}
+		a->key[i] = (unsigned char)byte;
+	}
+	a->id = (uint32_t)id;
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	a->counter = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+	return 0;
+}
+
+// Copia la richiesta in out seguita dal trailer firmato; restituisce la
+// lunghezza del datagram
+static int sign_request(replay_auth_t *a, unsigned char *out, const unsigned char *req, int len) {
+	memcpy(out, req, (size_t)len);
+	unsigned char *t = out + len;
+	put32be(t, a->id);
+	put32be(t + 4, (uint32_t)time(NULL));
+	put64be(t + 8, ++a->counter);
+	put64be(t + AUTH_MAC_OFFSET, siphash24(a->key, out, (size_t)len + AUTH_MAC_OFFSET));
+	return len + AUTH_TRAILER_SIZE;
+}
+
+static unsigned status_of(const unsigned char *resp, int len) {
+	uint32_t st = 0;
+	if (len >= 4) {
+		memcpy(&st, resp, 4);
+	}
+	return (unsigned)ntohl(st);
+}
+
+// Confronto delle parti deterministiche della risposta: stato (4 byte) e
+// tipo/opcode (1 byte), oppure per REQ_COMPACT stato, numero di misure e
+// tipo/formato di ciascuna (valori esclusi). Un'iscrizione rimandata con
+// cookie di verifica non può essere riprodotta e vale solo l'opcode.
+static int same_response(const unsigned char *req, int reqlen, const unsigned char *a, int alen,
+		const unsigned char *b, int blen) {
+	if (reqlen > 0 && req[0] == REQ_SUBSCRIBE && blen >= 5 && status_of(b, blen) == STATUS_COOKIE_REQUIRED) {
+		// Il cookie catturato vale solo per il mittente e il server originali:
+		// la richiesta di verifica è la risposta attesa
+		return alen >= 5 && a[4] == b[4];
+	}
+	if (reqlen > 0 && req[0] == REQ_COMPACT) {
+		if (alen != blen || alen < 2 || memcmp(a, b, 2) != 0) {
+			return 0;
+		}
+		for (int off = 2; off + 4 <= alen; off += 4) {
+			if (memcmp(&a[off], &b[off], 2) != 0) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+	int cmp = alen < 5 ? alen : 5;
+	return blen >= cmp && memcmp(a, b, (size_t)cmp) == 0;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Socket connesso al server con una nuova porta sorgente
+static int open_slot(const struct sockaddr_in *addr) {
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd >= 0 && connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// Carica il file e ne indicizza i record. Restituisce il numero di record,
+// -1 se il file non è una cattura valida.
+static int load_capture(const char *path, unsigned char **data, replay_record_t **out) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	*data = (unsigned char *)malloc(size > 0 ? (size_t)size : 1);
+	if (*data == NULL || size < CAPTURE_HEADER_SIZE || fread(*data, 1, (size_t)size, f) != (size_t)size) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	if (get32le(*data) != CAPTURE_MAGIC || get16le(*data + 4) != CAPTURE_VERSION) {
+		return -1;
+	}
+
+	int cap = 1024, n = 0;
+	*out = (replay_record_t *)malloc(sizeof(replay_record_t) * (size_t)cap);
+	long off = CAPTURE_HEADER_SIZE;
+	while (*out != NULL && off + CAPTURE_RECORD_SIZE <= size) {
+		const unsigned char *p = *data + off;
+		replay_record_t r;
+		r.ts = get64le(p);
+		r.reqlen = get16le(p + 8);
+		r.resplen = get16le(p + 10);
+		r.req = p + CAPTURE_RECORD_SIZE;
+		r.resp = r.req + r.reqlen;
+		off += CAPTURE_RECORD_SIZE + r.reqlen + r.resplen;
+		if (off > size) {
+			break; // record troncato (cattura interrotta)
+		}
+		if (n == cap) {
+			cap *= 2;
+			*out = (replay_record_t *)realloc(*out, sizeof(replay_record_t) * (size_t)cap);
+			if (*out == NULL) {
+				return -1;
+			}
+		}
+		(*out)[n++] = r;
+	}
+	return *out != NULL ? n : -1;
+}
+
+int main(int argc, char *argv[]) {
+	const char *host = SERVER_IP;
+	int port = SERVER_PORT;
+	double speed = 1.0;  // fattore di accelerazione, 0 = massima velocità
+	int timeout_ms = 1000;
+	int inflight = DEFAULT_INFLIGHT;
+	const char *path = NULL;
+	replay_auth_t auth = { 0 };
+	int signing = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && (i + 1) < argc) {
+			host = argv[++i];
+		} else if (strcmp(argv[i], "-p") == 0 && (i + 1) < argc) {
+			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-x") == 0 && (i + 1) < argc) {
+			speed = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--max") == 0) {
+			speed = 0.0;
+		} else if (strcmp(argv[i], "-t") == 0 && (i + 1) < argc) {
+			timeout_ms = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-c") == 0 && (i + 1) < argc) {
+			inflight = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-k") == 0 && (i + 1) < argc) {
+			if (parse_auth(argv[++i], &auth) < 0) {
+				printf("Chiave non valida: attesa id:chiave (32 cifre esadecimali)\n");
+				return 2;
+			}
+			signing = 1;
+		} else {
+			path = argv[i];
+		}
+	}
+	if (path == NULL || speed < 0.0 || port <= 0 || port > 65535 || timeout_ms <= 0 || inflight <= 0) {
+		printf("Uso: %s [-s host] [-p porta] [-x fattore | --max] [-t timeout_ms] [-c slot] [-k id:chiave] "
+				"cattura.bin\n", argv[0]);
+		return 2;
+	}
+
+	unsigned char *data = NULL;
+	replay_record_t *recs = NULL;
+	int n = load_capture(path, &data, &recs);
+	if (n < 0) {
+		printf("Cattura non valida: %s\n", path);
+		return 2;
+	}
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+		struct hostent *he = gethostbyname(host);
+		if (he == NULL) {
+			printf("Risoluzione fallita: %s\n", host);
+			return 2;
+		}
+		memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+	}
+	replay_slot_t *slots = (replay_slot_t *)calloc((size_t)inflight, sizeof(replay_slot_t));
+	struct pollfd *pfds = (struct pollfd *)malloc(sizeof(struct pollfd) * (size_t)inflight);
+	int *busy = (int *)malloc(sizeof(int) * (size_t)inflight);
+	uint64_t *lat = (uint64_t *)malloc(sizeof(uint64_t) * (size_t)(n > 0 ? n : 1));
+	if (slots == NULL || pfds == NULL || busy == NULL || lat == NULL) {
+		printf("Memoria insufficiente\n");
+		return 2;
+	}
+	for (int s = 0; s < inflight; ++s) {
+		slots[s].rec = -1;
+		if ((slots[s].fd = open_slot(&addr)) < 0) {
+			perror("socket");
+			return 2;
+		}
+	}
+
+	int answered = 0, missing = 0, mismatches = 0;
+	uint64_t max_lag = 0;
+	unsigned char resp[BUFFER_SIZE];
+	unsigned char signed_req[BUFFER_SIZE + AUTH_TRAILER_SIZE];
+	const uint64_t timeout_ns = (uint64_t)timeout_ms * 1000000ull;
+	uint64_t start = now_ns();
+	uint64_t first_ts = n > 0 ? recs[0].ts : 0;
+	int next = 0, done = 0, nfree = inflight;
+
+	while (done < n) {
+		// Invii dovuti, finché c'è uno slot libero: il ritmo non dipende
+		// dalle risposte (al più inflight richieste in volo)
+		uint64_t now = now_ns();
+		uint64_t due = 0;
+		while (next < n && nfree > 0) {
+			const replay_record_t *r = &recs[next];
+			due = start + (speed > 0.0 ? (uint64_t)((double)(r->ts - first_ts) / speed) : 0);
+			if (due > now) {
+				break;
+			}
+			if (speed > 0.0 && now - due > max_lag) {
+				max_lag = now - due;
+			}
+			int s = 0;
+			while (slots[s].rec >= 0) {
+				s++;
+			}
+			const unsigned char *out = r->req;
+			int outlen = r->reqlen;
+			if (signing && r->reqlen <= BUFFER_SIZE) {
+				outlen = sign_request(&auth, signed_req, r->req, r->reqlen);
+				out = signed_req;
+			}
+			slots[s].sent = now_ns();
+			if (send(slots[s].fd, out, (size_t)outlen, 0) < 0) {
+				missing++;
+				done++;
+			} else {
+				slots[s].rec = next;
+				nfree--;
+			}
+			next++;
+			now = now_ns();
+		}
+
+		// Attesa della prima tra: risposta, scadenza di un timeout, prossimo invio
+		uint64_t wake = next < n && nfree > 0 ? due : UINT64_MAX;
+		int nbusy = 0;
+		for (int s = 0; s < inflight; ++s) {
+			if (slots[s].rec >= 0) {
+				pfds[nbusy].fd = slots[s].fd;
+				pfds[nbusy].events = POLLIN;
+				pfds[nbusy].revents = 0;
+				busy[nbusy++] = s;
+				if (slots[s].sent + timeout_ns < wake) {
+					wake = slots[s].sent + timeout_ns;
+				}
+			}
+		}
+		if (nbusy == 0 && next >= n) {
+			break;
+		}
+		uint64_t wait = wake > now ? wake - now : 0;
+		struct timespec ts = { (time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull) };
+		if (ppoll(pfds, (nfds_t)nbusy, &ts, NULL) < 0 && errno != EINTR) {
+			perror("ppoll");
+			break;
+		}
+
+		now = now_ns();
+		for (int k = 0; k < nbusy; ++k) {
+			replay_slot_t *slot = &slots[busy[k]];
+			const replay_record_t *r = &recs[slot->rec];
+			// Con POLLERR (porta chiusa segnalata via ICMP) recv riporta l'errore
+			int len = -1, failed = 0;
+			if (pfds[k].revents) {
+				len = (int)recv(slot->fd, resp, sizeof(resp), MSG_DONTWAIT);
+				failed = len < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+			}
+			if (len >= 0) {
+				lat[answered++] = now - slot->sent;
+				if (!same_response(r->req, r->reqlen, r->resp, r->resplen, resp, len)) {
+					if (mismatches < MAX_REPORTED_MISMATCHES) {
+						printf("Discrepanza al record %d: attesi %d byte (stato %u), ricevuti %d byte (stato %u)\n",
+								slot->rec, r->resplen, status_of(r->resp, r->resplen), len, status_of(resp, len));
+					}
+					mismatches++;
+				}
+			} else if (failed || now - slot->sent >= timeout_ns) {
+				// Risposta persa o in ritardo: lo slot cambia porta, così un
+				// arrivo tardivo non può essere attribuito a un record successivo
+				missing++;
+				close(slot->fd);
+				if ((slot->fd = open_slot(&addr)) < 0) {
+					perror("socket");
+					return 2;
+				}
+			} else {
+				continue;
+			}
+			slot->rec = -1;
+			nfree++;
+			done++;
+		}
+	}
+	double elapsed = (double)(now_ns() - start) / 1e9;
+
+	printf("Record %d, risposte %d, mancanti %d, discrepanze %d, durata %.2f s (%.0f richieste/s)\n",
+			n, answered, missing, mismatches, elapsed, elapsed > 0 ? n / elapsed : 0.0);
+	if (answered > 0) {
+		qsort(lat, (size_t)answered, sizeof(uint64_t), cmp_u64);
+		double sum = 0;
+		for (int i = 0; i < answered; ++i) {
+			sum += (double)lat[i];
+		}
+		printf("Latenza: min %.1f us  media %.1f us  p50 %.1f us  p99 %.1f us  max %.1f us\n",
+				lat[0] / 1e3, sum / answered / 1e3, lat[answered / 2] / 1e3,
+				lat[(int)((answered - 1) * 0.99)] / 1e3, lat[answered - 1] / 1e3);
+	}
+	if (speed > 0.0) {
+		printf("Ritardo massimo rispetto ai tempi originali (x%.2f): %.1f ms\n", speed, max_lag / 1e6);
+	}
+	for (int s = 0; s < inflight; ++s) {
+		close(slots[s].fd);
+	}
+	free(slots);
+	free(pfds);
+	free(busy);
+	free(lat);
+	free(recs);
+	free(data);
+	return (missing > 0 || mismatches > 0) ? 1 : 0;
+}